@@ -0,0 +1,298 @@
+#include "bench/benchserver.h"
+#include "exceptions/errnoexception.h"
+
+#include <stdexcept>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+using namespace plain;
+
+namespace {
+
+  // Reads a line from the child, blocking.
+  bool readLine(int fd, std::string &line)
+  {
+    line.clear();
+
+    char c;
+    while (true) {
+      ssize_t ret = read(fd, &c, 1);
+      if (ret == -1 && errno == EINTR) {
+	continue;
+      } else if (ret <= 0) {
+	return false;
+      } else if (c == '\n') {
+	return true;
+      }
+      line += c;
+    }
+  }
+
+  // Connects a blocking socket to the port on the loopback address.
+  int connectLoopback(int port)
+  {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+      throw ErrnoException(errno);
+    }
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+    if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+      int error = errno;
+      close(fd);
+      throw ErrnoException(error);
+    }
+
+    return fd;
+  }
+
+}
+
+struct BenchServer::Internal {
+
+  pid_t d_pid;
+  int d_port;
+
+  // The read end of the report pipe.
+  int d_reportFd;
+
+  Internal(int port)
+    : d_pid(-1), d_port(port), d_reportFd(-1)
+  {
+  }
+
+};
+
+BenchServer::BenchServer(int port, std::vector<std::string> const &args)
+  : d(new Internal(port))
+{
+  int fds[2];
+  if (pipe2(fds, O_CLOEXEC) == -1) {
+    throw ErrnoException(errno);
+  }
+
+  // Build the argument list before forking.
+  std::string portString = std::to_string(port);
+  std::vector<char*> argv;
+  argv.push_back(const_cast<char*>("plain-benchserver"));
+  argv.push_back(const_cast<char*>("--serve"));
+  argv.push_back(const_cast<char*>(portString.c_str()));
+  for (std::string const &arg : args) {
+    argv.push_back(const_cast<char*>(arg.c_str()));
+  }
+  argv.push_back(NULL);
+
+  d->d_pid = fork();
+  if (d->d_pid == -1) {
+    int error = errno;
+    close(fds[0]);
+    close(fds[1]);
+    throw ErrnoException(error);
+  }
+
+  if (d->d_pid == 0) {
+    // The child, dup2 clears close-on-exec on the report descriptor. The
+    // server log goes to /dev/null to keep the benchmark output readable.
+    dup2(fds[1], REPORT_FD);
+
+    int null = open("/dev/null", O_WRONLY);
+    if (null != -1) {
+      dup2(null, STDOUT_FILENO);
+    }
+
+    execv("/proc/self/exe", argv.data());
+    _exit(127);
+  }
+
+  close(fds[1]);
+  d->d_reportFd = fds[0];
+
+  std::string line;
+  if (!readLine(d->d_reportFd, line) || line != "ready") {
+    close(d->d_reportFd);
+    waitpid(d->d_pid, NULL, 0);
+    throw std::runtime_error("The server did not start.");
+  }
+}
+
+BenchServer::~BenchServer()
+{
+  if (d->d_pid != -1) {
+    kill(d->d_pid, SIGKILL);
+    waitpid(d->d_pid, NULL, 0);
+    close(d->d_reportFd);
+  }
+}
+
+pid_t BenchServer::pid() const
+{
+  return d->d_pid;
+}
+
+int BenchServer::port() const
+{
+  return d->d_port;
+}
+
+double BenchServer::cpuTime() const
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/stat", static_cast<int>(d->d_pid));
+
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    throw ErrnoException(errno);
+  }
+
+  char buffer[1024];
+  size_t size = fread(buffer, 1, sizeof(buffer) - 1, file);
+  fclose(file);
+  buffer[size] = 0;
+
+  // The command name may contain spaces, the fields after it start at the last ')'.
+  char const *fields = strrchr(buffer, ')');
+  unsigned long long utime = 0, stime = 0;
+
+  if (fields == NULL ||
+      sscanf(fields + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2) {
+    throw std::runtime_error("Invalid " + std::string(path) + ".");
+  }
+
+  return static_cast<double>(utime + stime) / sysconf(_SC_CLK_TCK);
+}
+
+uint64_t BenchServer::residentSize() const
+{
+  char path[64];
+  snprintf(path, sizeof(path), "/proc/%d/status", static_cast<int>(d->d_pid));
+
+  FILE *file = fopen(path, "r");
+  if (file == NULL) {
+    throw ErrnoException(errno);
+  }
+
+  char line[256];
+  unsigned long long kb = 0;
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    if (sscanf(line, "VmRSS: %llu kB", &kb) == 1) {
+      break;
+    }
+  }
+
+  fclose(file);
+  return kb * 1024;
+}
+
+std::string BenchServer::get(std::string const &uri) const
+{
+  int fd = connectLoopback(d->d_port);
+
+  std::string request = "GET " + uri + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+  if (write(fd, request.data(), request.size()) != static_cast<ssize_t>(request.size())) {
+    int error = errno;
+    close(fd);
+    throw ErrnoException(error);
+  }
+
+  // Read until the header and the Content-Length bytes of body are in.
+  std::string response;
+  size_t headerSize = std::string::npos;
+  size_t contentLength = 0;
+  char buffer[16384];
+
+  while (headerSize == std::string::npos || response.size() < headerSize + contentLength) {
+    ssize_t ret = read(fd, buffer, sizeof(buffer));
+    if (ret == -1 && errno == EINTR) {
+      continue;
+    } else if (ret <= 0) {
+      close(fd);
+      throw std::runtime_error("Incomplete response for " + uri + ".");
+    }
+
+    response.append(buffer, ret);
+
+    if (headerSize == std::string::npos) {
+      size_t end = response.find("\r\n\r\n");
+      if (end != std::string::npos) {
+	headerSize = end + 4;
+
+	char const *field = strcasestr(response.c_str(), "\r\nContent-Length:");
+	if (field != NULL && static_cast<size_t>(field - response.c_str()) < headerSize) {
+	  contentLength = strtoull(field + 17, NULL, 10);
+	}
+      }
+    }
+  }
+
+  close(fd);
+  return response.substr(headerSize, contentLength);
+}
+
+double BenchServer::stop(std::vector<std::string> &report)
+{
+  static char const s_exit[] = "GET /exit HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+  int fd = -1;
+
+  try {
+    fd = connectLoopback(d->d_port);
+    if (write(fd, s_exit, sizeof(s_exit) - 1) == -1) {
+      kill(d->d_pid, SIGTERM);
+    }
+  } catch (ErrnoException const &) {
+    kill(d->d_pid, SIGTERM);
+  }
+
+  std::string line;
+  while (readLine(d->d_reportFd, line)) {
+    report.push_back(line);
+  }
+
+  if (fd != -1) {
+    close(fd);
+  }
+
+  close(d->d_reportFd);
+
+  int status;
+  rusage usage;
+  pid_t pid = d->d_pid;
+  d->d_pid = -1;
+
+  if (wait4(pid, &status, 0, &usage) == -1) {
+    throw ErrnoException(errno);
+  }
+
+  return usage.ru_utime.tv_sec + usage.ru_utime.tv_usec * 1e-6 +
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec * 1e-6;
+}
+
+bool BenchServer::serving(int argc, char *argv[])
+{
+  return argc > 2 && strcmp(argv[1], "--serve") == 0;
+}
+
+void BenchServer::report(std::string const &line)
+{
+  std::string out = line + "\n";
+  if (write(REPORT_FD, out.data(), out.size()) == -1) {
+    throw ErrnoException(errno);
+  }
+}
@@ -0,0 +1,94 @@
+#ifndef __INC_PLAIN_BENCHSERVER_H__
+#define __INC_PLAIN_BENCHSERVER_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+#include <sys/types.h>
+
+namespace plain {
+
+  /**
+   *  A server under benchmark, running in a child process.
+   *
+   *  The benchmark executable runs itself again with "--serve port args...",
+   *  so the server CPU time and memory can be measured apart from the load
+   *  generator. The child runs the server, reports "ready" once it listens,
+   *  and stops on a GET /exit. It can report more lines to the parent on the
+   *  way out, over descriptor REPORT_FD. Its standard output goes to /dev/null.
+   */
+  class BenchServer {
+  public:
+
+    enum {
+      // The descriptor the child reports on.
+      REPORT_FD = 3,
+    };
+
+    /**
+     *  Starts the child and waits until it reports it is ready.
+     *
+     *  @param port the port the child listens on.
+     *  @param args the arguments passed to the child after the port.
+     *  @throw ErrnoException when the child can not be started.
+     *  @throw std::runtime_error when the child did not get ready.
+     */
+    BenchServer(int port, std::vector<std::string> const &args);
+
+    /**
+     *  Kills the child when it was not stopped.
+     */
+    ~BenchServer();
+
+    pid_t pid() const;
+
+    int port() const;
+
+    /**
+     *  @return the CPU time (user and system) the child used so far, in seconds.
+     */
+    double cpuTime() const;
+
+    /**
+     *  @return the resident set size of the child in bytes.
+     */
+    uint64_t residentSize() const;
+
+    /**
+     *  Sends a GET request on a new connection and returns the response body.
+     *
+     *  @throw ErrnoException on connection failures.
+     *  @throw std::runtime_error on an invalid response.
+     */
+    std::string get(std::string const &uri) const;
+
+    /**
+     *  Stops the child with a GET /exit and waits for it.
+     *
+     *  @param report the lines the child reported after getting ready.
+     *  @return the total CPU time of the child in seconds.
+     */
+    double stop(std::vector<std::string> &report);
+
+    /**
+     *  @return true when the executable runs as the child, argv[2] is then the port.
+     */
+    static bool serving(int argc, char *argv[]);
+
+    /**
+     *  Reports a line to the parent, for use in the child.
+     */
+    static void report(std::string const &line);
+
+  private:
+
+    struct Internal;
+    std::unique_ptr<Internal> d;
+
+  };
+
+}
+
+#endif // __INC_PLAIN_BENCHSERVER_H__
@@ -0,0 +1,504 @@
+#include "bench/loadgenerator.h"
+#include "bench/benchserver.h"
+#include "core/main.h"
+#include "core/application.h"
+#include "core/log.h"
+#include "exceptions/errnoexception.h"
+#include "io/poll.h"
+#include "net/httpserver.h"
+#include "net/httprequesthandler.h"
+#include "net/httprequest.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+
+/*
+ *  Connection scaling benchmark.
+ *
+ *  Ramps the number of idle keep-alive connections to a server in steps and,
+ *  at every step, runs a fixed number of active connections against it. It
+ *  reports what a connection costs at that scale: the server RSS, RSS and
+ *  kernel TCP memory per connection, the accept rate of the ramp, and CPU per
+ *  request, epoll_pwait cost, timeout list cost and loop iteration time under
+ *  the active load, the latter from the server metrics.
+ *
+ *  Everything runs over loopback. The idle connections come from 127.0.0.2
+ *  and up, so more connections can be opened than there are ephemeral ports.
+ *  The number of connections is limited by the descriptor limit, of both the
+ *  benchmark and the server.
+ */
+
+using namespace plain;
+
+namespace {
+
+  enum {
+    // Connections opened before waiting for them to be accepted, one less than the server listen backlog.
+    CONNECT_BATCH_SIZE = 63,
+
+    // Idle connections per source address, less than the ephemeral port range.
+    CONNECTIONS_PER_ADDRESS = 25000,
+
+    // Descriptors kept free for the active connections and the metric requests.
+    RESERVED_DESCRIPTORS = 64,
+  };
+
+  char s_okay[] = "HTTP/1.1 200 Okay\r\nContent-Length: 2\r\nConnection: keep-alive\r\n\r\nOK";
+
+  struct Options {
+    std::vector<size_t> steps;
+    size_t activeConnections;
+    double duration;
+    int port;
+    double serverTimeout;
+
+    Options()
+      : steps({ 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000, 500000 }),
+	activeConnections(64),
+	duration(5),
+	port(18081),
+	serverTimeout(3600)
+    {
+    }
+  };
+
+  // The request handler of the serving child.
+  class ConnHandler : public HttpRequestHandler {
+  public:
+
+    virtual void request(HttpRequest const &request)
+    {
+      if (strcmp(request.uri(), "/exit") == 0) {
+	Main::instance().stop(0);
+	drop(request);
+      } else {
+	respondWithStaticString(request, s_okay, sizeof(s_okay) - 1);
+      }
+    }
+
+  };
+
+  // The serving child: port timeout.
+  class ConnServer : public Application {
+
+    std::shared_ptr<HttpServer> d_httpServer;
+
+  public:
+
+    virtual void create(int argc, char *argv[])
+    {
+      // Idle connections should not time out during the run.
+      Main::instance().poll().setTimeout(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(strtod(argv[3], NULL))));
+
+      d_httpServer = std::make_shared<HttpServer>(atoi(argv[2]), std::make_shared<ConnHandler>());
+      d_httpServer->setStatusUri("/status");
+
+      BenchServer::report("ready");
+    }
+
+    virtual void destroy()
+    {
+      d_httpServer.reset();
+    }
+
+  };
+
+  // The server metrics at one point in time.
+  class Status {
+
+    std::string d_text;
+
+  public:
+
+    Status(BenchServer const &server)
+      : d_text("\n" + server.get("/status"))
+    {
+    }
+
+    /**
+     *  @param key the metric name with labels, for example plain_poll_wait_seconds_sum{timeout="zero"}.
+     *  @return the value, zero when the metric is not found.
+     */
+    double value(std::string const &key) const
+    {
+      size_t position = d_text.find("\n" + key + " ");
+      if (position == std::string::npos) {
+	return 0;
+      }
+
+      return strtod(d_text.c_str() + position + key.size() + 2, NULL);
+    }
+
+  };
+
+  // The mean of a summary over the interval between two status snapshots.
+  double mean(Status const &s0, Status const &s1, std::string const &name, std::string const &labels = "")
+  {
+    std::string suffix = labels.empty() ? "" : "{" + labels + "}";
+    double count = s1.value(name + "_count" + suffix) - s0.value(name + "_count" + suffix);
+    double sum = s1.value(name + "_sum" + suffix) - s0.value(name + "_sum" + suffix);
+
+    return count > 0 ? sum / count : 0;
+  }
+
+  // The TCP socket buffer memory of the whole system, in bytes.
+  uint64_t tcpMemory()
+  {
+    FILE *file = fopen("/proc/net/sockstat", "r");
+    if (file == NULL) {
+      return 0;
+    }
+
+    char line[256];
+    unsigned long long pages = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+      char const *mem = strstr(line, " mem ");
+      if (strncmp(line, "TCP:", 4) == 0 && mem != NULL) {
+	pages = strtoull(mem + 5, NULL, 10);
+	break;
+      }
+    }
+
+    fclose(file);
+    return pages * sysconf(_SC_PAGESIZE);
+  }
+
+  // Raises the file descriptor limit, the server inherits it and sizes its tables from it.
+  size_t raiseFileLimit()
+  {
+    rlimit l;
+
+    if (getrlimit(RLIMIT_NOFILE, &l) == -1) {
+      throw ErrnoException(errno);
+    }
+
+    if (l.rlim_cur < l.rlim_max) {
+      l.rlim_cur = l.rlim_max;
+      setrlimit(RLIMIT_NOFILE, &l);
+    }
+
+    return l.rlim_cur;
+  }
+
+  // Sends a request on a connection and waits for the response.
+  void request(int fd)
+  {
+    static char const s_request[] = "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+    if (write(fd, s_request, sizeof(s_request) - 1) != sizeof(s_request) - 1) {
+      throw ErrnoException(errno);
+    }
+
+    size_t received = 0;
+    while (received < sizeof(s_okay) - 1) {
+      pollfd p = { fd, POLLIN, 0 };
+      if (poll(&p, 1, 10000) == 0) {
+	throw std::runtime_error("Timeout waiting for a response.");
+      }
+
+      char buffer[256];
+      ssize_t ret = read(fd, buffer, sizeof(buffer));
+      if (ret == 0 || (ret == -1 && errno != EAGAIN && errno != EINTR)) {
+	throw std::runtime_error("Connection closed waiting for a response.");
+      } else if (ret > 0) {
+	received += ret;
+      }
+    }
+  }
+
+  // Opens idle connections until there are count of them, returns the number of failures.
+  size_t openConnections(Options const &options, std::vector<int> &connections, size_t count)
+  {
+    size_t errors = 0;
+
+    while (connections.size() < count) {
+      std::vector<pollfd> batch;
+
+      while (batch.size() < CONNECT_BATCH_SIZE && connections.size() + batch.size() < count) {
+	int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if (fd == -1) {
+	  throw ErrnoException(errno);
+	}
+
+	// Spread the connections over the source addresses, the port is picked on connect.
+	int one = 1;
+	setsockopt(fd, IPPROTO_IP, IP_BIND_ADDRESS_NO_PORT, &one, sizeof(one));
+
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK + 1 + (connections.size() + batch.size()) / CONNECTIONS_PER_ADDRESS);
+
+	if (bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1) {
+	  int error = errno;
+	  close(fd);
+	  throw ErrnoException(error);
+	}
+
+	address.sin_port = htons(options.port);
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+	if (connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == -1 && errno != EINPROGRESS) {
+	  int error = errno;
+	  close(fd);
+	  throw ErrnoException(error);
+	}
+
+	pollfd p = { fd, POLLOUT, 0 };
+	batch.push_back(p);
+      }
+
+      // Wait for the batch to be established.
+      size_t pending = batch.size();
+      while (pending > 0) {
+	int ret = poll(batch.data(), batch.size(), 10000);
+	if (ret == -1) {
+	  if (errno == EINTR) {
+	    continue;
+	  }
+	  throw ErrnoException(errno);
+	} else if (ret == 0) {
+	  throw std::runtime_error("Timeout establishing connections.");
+	}
+
+	for (pollfd &p : batch) {
+	  if (p.fd < 0 || p.revents == 0) {
+	    continue;
+	  }
+
+	  int error = 0;
+	  socklen_t length = sizeof(error);
+	  getsockopt(p.fd, SOL_SOCKET, SO_ERROR, &error, &length);
+
+	  if (error == 0) {
+	    connections.push_back(p.fd);
+	  } else {
+	    close(p.fd);
+	    ++errors;
+	  }
+
+	  // Negative descriptors are ignored by poll.
+	  p.fd = -1;
+	  --pending;
+	}
+      }
+
+      // Connections are accepted in order, so when the last one gets a response
+      // the server accepted the whole batch. Without this the benchmark can fill
+      // the listen backlog before the server runs, certainly on a single CPU, and
+      // then measures SYN retransmits instead of accepts.
+      if (!connections.empty()) {
+	request(connections.back());
+      }
+    }
+
+    return errors;
+  }
+
+  void runStep(Options const &options, BenchServer &server, std::vector<int> &connections, size_t count, uint64_t baseResidentSize)
+  {
+    using namespace std::chrono;
+
+    size_t initial = connections.size();
+    uint64_t tcp0 = tcpMemory();
+
+    // Ramp up the idle connections and make sure the server accepted them all.
+    // Every status request is an accepted connection as well.
+    Status before(server);
+    double accepts0 = before.value("plain_http_accepts_total");
+    steady_clock::time_point t0 = steady_clock::now();
+
+    size_t errors = openConnections(options, connections, count);
+    size_t added = connections.size() - initial;
+
+    size_t requests = 0;
+    while (true) {
+      Status status(server);
+      ++requests;
+
+      if (status.value("plain_http_accepts_total") - accepts0 - requests >= added) {
+	break;
+      }
+
+      std::this_thread::sleep_for(milliseconds(1));
+    }
+
+    double rampTime = duration<double>(steady_clock::now() - t0).count();
+    uint64_t idleResidentSize = server.residentSize();
+    uint64_t tcp1 = tcpMemory();
+
+    // Run the active connections.
+    LoadGenerator::Options load;
+    load.port = options.port;
+    load.connections = options.activeConnections;
+    load.duration = options.duration;
+
+    std::unique_ptr<LoadGenerator::Results> results(new LoadGenerator::Results);
+
+    Status s0(server);
+    double cpu0 = server.cpuTime();
+
+    {
+      LoadGenerator generator(load);
+      generator.run(*results);
+    }
+
+    double cpu1 = server.cpuTime();
+    Status s1(server);
+
+    double waits = s1.value("plain_poll_waits_total") - s0.value("plain_poll_waits_total");
+    double events = s1.value("plain_poll_events_total") - s0.value("plain_poll_events_total");
+
+    printf("%8zu %8.1f %8.0f %8.0f %9.0f %9.0f %8.2f %8.2f %8.0f %7.1f %8.0f %8.1f %6zu\n",
+	   connections.size(),
+	   idleResidentSize / double(1 << 20),
+	   connections.empty() ? 0.0 : (static_cast<double>(idleResidentSize) - baseResidentSize) / connections.size(),
+	   added == 0 ? 0.0 : (static_cast<double>(tcp1) - tcp0) / added,
+	   added / rampTime,
+	   results->requests / results->elapsed,
+	   results->latency.quantile(0.99) * 1e-6,
+	   results->requests == 0 ? 0.0 : (cpu1 - cpu0) * 1e6 / results->requests,
+	   mean(s0, s1, "plain_poll_wait_seconds", "timeout=\"zero\"") * 1e9,
+	   waits > 0 ? events / waits : 0.0,
+	   mean(s0, s1, "plain_poll_timeout_scan_seconds") * 1e9,
+	   mean(s0, s1, "plain_poll_iteration_seconds") * 1e6,
+	   errors + results->errors);
+    fflush(stdout);
+  }
+
+  void usage(char const *program)
+  {
+    std::cerr << "usage: " << program << " [-s steps] [-a connections] [-d seconds] [-T seconds] [-P port]\n"
+	      << "\n"
+	      << "  -s steps        comma separated idle connection counts\n"
+	      << "                  (default 1000,2000,5000,10000,20000,50000,100000,200000,500000,\n"
+	      << "                  limited by the descriptor limit)\n"
+	      << "  -a connections  active connections at every step (default 64)\n"
+	      << "  -d seconds      duration of the active load at every step (default 5)\n"
+	      << "  -T seconds      the server idle timeout (default 3600)\n"
+	      << "  -P port         the server port (default 18081)\n";
+  }
+
+  int serve(int argc, char *argv[])
+  {
+    if (argc != 4) {
+      std::cerr << "plain-connbench: the server takes port timeout\n";
+      return 1;
+    }
+
+    ConnServer server;
+    return Main::instance().run(server, argc, argv);
+  }
+
+}
+
+int main(int argc, char *argv[])
+{
+  if (BenchServer::serving(argc, argv)) {
+    return serve(argc, argv);
+  }
+
+  Options options;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "s:a:d:T:P:")) != -1) {
+    switch (opt) {
+    case 's': {
+      options.steps.clear();
+      for (char *step = strtok(optarg, ","); step != NULL; step = strtok(NULL, ",")) {
+	options.steps.push_back(strtoul(step, NULL, 10));
+      }
+      break;
+    }
+
+    case 'a':
+      options.activeConnections = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'd':
+      options.duration = strtod(optarg, NULL);
+      break;
+
+    case 'T':
+      options.serverTimeout = strtod(optarg, NULL);
+      break;
+
+    case 'P':
+      options.port = atoi(optarg);
+      break;
+
+    default:
+      usage(argv[0]);
+      return 1;
+    };
+  }
+
+  std::sort(options.steps.begin(), options.steps.end());
+
+  // The load generator gets a broken connection when the server goes away.
+  signal(SIGPIPE, SIG_IGN);
+
+  std::vector<int> connections;
+
+  try {
+    size_t limit = raiseFileLimit();
+    size_t maxConnections = limit > options.activeConnections + RESERVED_DESCRIPTORS ? limit - options.activeConnections - RESERVED_DESCRIPTORS : 0;
+
+    BenchServer server(options.port, { std::to_string(options.serverTimeout) });
+
+    Status status(server);
+    uint64_t baseResidentSize = server.residentSize();
+
+    printf("descriptor limit %zu, %zu active connections, %.1f s per step\n", limit, options.activeConnections, options.duration);
+    printf("server rss %.1f MB, poll table %.1f MB, client table %.1f MB (allocated for the descriptor limit)\n",
+	   baseResidentSize / double(1 << 20),
+	   status.value("plain_poll_table_bytes") / (1 << 20),
+	   status.value("plain_http_client_table_bytes") / (1 << 20));
+    printf("%8s %8s %8s %8s %9s %9s %8s %8s %8s %7s %8s %8s %6s\n",
+	   "idle", "rss MB", "rss B/c", "tcp B/c", "accept/s", "req/s", "p99 ms", "cpu us/r", "wait ns", "ev/wait", "tmo ns", "iter us", "errors");
+
+    for (size_t step : options.steps) {
+      if (step > maxConnections) {
+	printf("%8zu skipped, over the descriptor limit\n", step);
+	continue;
+      }
+
+      runStep(options, server, connections, std::max(step, connections.size()), baseResidentSize);
+    }
+
+    for (int fd : connections) {
+      close(fd);
+    }
+    connections.clear();
+
+    std::vector<std::string> report;
+    server.stop(report);
+  } catch (std::exception const &e) {
+    std::cerr << "plain-connbench: " << e.what() << "\n";
+    return 1;
+  }
+
+  Log::instance().flush();
+
+  return 0;
+}
@@ -0,0 +1,453 @@
+#include "bench/loadgenerator.h"
+#include "bench/benchserver.h"
+#include "core/main.h"
+#include "core/application.h"
+#include "core/log.h"
+#include "core/metrics.h"
+#include "exceptions/errnoexception.h"
+#include "net/httpserver.h"
+#include "net/httprequesthandler.h"
+#include "net/httprequest.h"
+
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/*
+ *  Large file throughput benchmark.
+ *
+ *  Generates files of the given sizes and, for every combination of transfer
+ *  strategy, pipe buffer size, chunk size and splice count, starts a server
+ *  that serves the file and runs the load generator against it over loopback.
+ *
+ *  The server runs in a BenchServer child process so its CPU time can be
+ *  measured separately from the load generator.
+ *
+ *  With -x a run fails when a single connection transfers a file of at least
+ *  the drop behind threshold and no pages were dropped behind it, this is
+ *  part of make check.
+ */
+
+using namespace plain;
+
+namespace {
+
+  char const *const s_strategyNames[] = { "splice", "sendfile" };
+
+  struct Options {
+    std::vector<uint64_t> sizes;
+    std::vector<HttpServer::TransferStrategy> strategies;
+    std::vector<size_t> pipeBufferSizes;
+    std::vector<size_t> chunkSizes;
+    std::vector<size_t> spliceCounts;
+    std::string directory;
+    int port;
+    size_t connections;
+    double duration;
+    bool check;
+
+    Options()
+      : directory("/tmp/plain-filebench"),
+	port(18080),
+	connections(4),
+	duration(5),
+	check(false)
+    {
+    }
+  };
+
+  // The request handler of the serving child, all requests get the file.
+  class FileHandler : public HttpRequestHandler {
+
+    std::string d_path;
+
+  public:
+
+    FileHandler(std::string const &path)
+      : d_path(path)
+    {
+    }
+
+    virtual void request(HttpRequest const &request)
+    {
+      if (strcmp(request.uri(), "/exit") == 0) {
+	Main::instance().stop(0);
+	drop(request);
+      } else {
+	respondWithFile(request, d_path);
+      }
+    }
+
+  };
+
+  // The serving child: port file strategy pipe chunk count.
+  class FileServer : public Application {
+
+    std::shared_ptr<HttpServer> d_httpServer;
+
+    static uint64_t transferCalls(char const *op)
+    {
+      std::string labels = std::string("op=\"") + op + "\"";
+      return Metrics::instance().counter("plain_http_transfer_calls_total", "Number of system calls transfering response data.", labels).value();
+    }
+
+  public:
+
+    virtual void create(int argc, char *argv[])
+    {
+      HttpServer::TransferOptions transfer;
+      transfer.strategy = static_cast<HttpServer::TransferStrategy>(atoi(argv[4]));
+      transfer.pipeBufferSize = strtoul(argv[5], NULL, 10);
+      transfer.chunkSize = strtoul(argv[6], NULL, 10);
+      transfer.spliceCount = strtoul(argv[7], NULL, 10);
+
+      d_httpServer = std::make_shared<HttpServer>(atoi(argv[2]), std::make_shared<FileHandler>(argv[3]));
+      d_httpServer->setTransferOptions(transfer);
+
+      BenchServer::report("ready");
+    }
+
+    virtual void destroy()
+    {
+      uint64_t calls = transferCalls("write") + transferCalls("splice") + transferCalls("sendfile");
+      uint64_t waits = Metrics::instance().counter("plain_poll_waits_total", "Number of epoll_pwait calls.").value();
+      uint64_t dropped = Metrics::instance().counter("plain_http_dropped_bytes_total", "Number of bytes of large files dropped from the page cache behind the transfer.").value();
+
+      BenchServer::report("syscalls " + std::to_string(calls) + " " + std::to_string(waits));
+      BenchServer::report("dropped " + std::to_string(dropped));
+
+      d_httpServer.reset();
+    }
+
+  };
+
+  void usage(char const *program)
+  {
+    std::cerr << "usage: " << program << " [-c connections] [-d seconds] [-s sizes] [-t strategies]\n"
+	      << "       [-p pipe sizes] [-k chunk sizes] [-n splice counts] [-D directory] [-P port] [-x]\n"
+	      << "\n"
+	      << "  Lists are comma separated, sizes take a K, M or G suffix.\n"
+	      << "\n"
+	      << "  -c connections  number of keep-alive connections (default 4)\n"
+	      << "  -d seconds      duration of every run (default 5)\n"
+	      << "  -s sizes        file sizes (default 1M,16M,128M)\n"
+	      << "  -t strategies   splice and/or sendfile (default splice,sendfile)\n"
+	      << "  -p pipe sizes   splice pipe buffer sizes (default the server default)\n"
+	      << "  -k chunk sizes  bytes per transfer call (default the server default)\n"
+	      << "  -n counts       transfer calls per event callback (default the server default)\n"
+	      << "  -D directory    where the files are generated (default /tmp/plain-filebench)\n"
+	      << "  -P port         the server port (default 18080)\n"
+	      << "  -x              fail when a single connection did not drop a large file\n"
+	      << "                  from the page cache behind its transfer\n";
+  }
+
+  uint64_t parseSize(std::string const &s)
+  {
+    char *end;
+    uint64_t size = strtoull(s.c_str(), &end, 10);
+
+    switch (*end) {
+    case 'k': case 'K': return size << 10;
+    case 'm': case 'M': return size << 20;
+    case 'g': case 'G': return size << 30;
+    case 0: return size;
+    default:
+      throw std::runtime_error("Invalid size " + s + ".");
+    }
+  }
+
+  std::vector<std::string> split(char const *list)
+  {
+    std::vector<std::string> items;
+    std::string s(list);
+    size_t begin = 0;
+
+    while (begin <= s.size()) {
+      size_t end = s.find(',', begin);
+      if (end == std::string::npos) {
+	end = s.size();
+      }
+      if (end > begin) {
+	items.push_back(s.substr(begin, end - begin));
+      }
+      begin = end + 1;
+    }
+
+    return items;
+  }
+
+  template<class T>
+  void parseSizes(char const *list, std::vector<T> &out)
+  {
+    out.clear();
+    for (std::string const &item : split(list)) {
+      out.push_back(parseSize(item));
+    }
+  }
+
+  // Creates the file of the given size unless it exists, the contents do not matter.
+  std::string generateFile(std::string const &directory, uint64_t size)
+  {
+    std::string path = directory + "/file-" + std::to_string(size);
+
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && static_cast<uint64_t>(st.st_size) == size) {
+      return path;
+    }
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd == -1) {
+      throw ErrnoException(errno);
+    }
+
+    std::vector<char> block(1 << 20);
+    for (size_t i = 0; i < block.size(); ++i) {
+      block[i] = static_cast<char>(i * 2654435761u >> 24);
+    }
+
+    uint64_t written = 0;
+    while (written < size) {
+      ssize_t ret = write(fd, block.data(), std::min<uint64_t>(block.size(), size - written));
+      if (ret == -1) {
+	int error = errno;
+	close(fd);
+	throw ErrnoException(error);
+      }
+      written += ret;
+    }
+
+    close(fd);
+    return path;
+  }
+
+  std::string formatSize(uint64_t size)
+  {
+    if (size >= (1 << 30) && size % (1 << 30) == 0) {
+      return std::to_string(size >> 30) + "G";
+    } else if (size >= (1 << 20) && size % (1 << 20) == 0) {
+      return std::to_string(size >> 20) + "M";
+    } else if (size >= (1 << 10) && size % (1 << 10) == 0) {
+      return std::to_string(size >> 10) + "K";
+    }
+    return std::to_string(size);
+  }
+
+  /*
+   *  @return false when the run should have dropped pages behind the transfer
+   *          and did not.
+   */
+  bool runOne(Options const &options, std::string const &path, uint64_t size, HttpServer::TransferOptions const &transfer)
+  {
+    std::vector<std::string> args = {
+      path,
+      std::to_string(transfer.strategy),
+      std::to_string(transfer.pipeBufferSize),
+      std::to_string(transfer.chunkSize),
+      std::to_string(transfer.spliceCount),
+    };
+
+    BenchServer server(options.port, args);
+
+    LoadGenerator::Options load;
+    load.port = options.port;
+    load.uri = "/file";
+    load.connections = options.connections;
+    load.duration = options.duration;
+
+    std::unique_ptr<LoadGenerator::Results> results(new LoadGenerator::Results);
+
+    {
+      LoadGenerator generator(load);
+      generator.run(*results);
+    }
+
+    std::vector<std::string> report;
+    double cpu = server.stop(report);
+
+    uint64_t syscalls = 0;
+    uint64_t dropped = 0;
+    for (std::string const &line : report) {
+      unsigned long long calls, waits, bytes;
+      if (sscanf(line.c_str(), "syscalls %llu %llu", &calls, &waits) == 2) {
+	syscalls = calls + waits;
+      } else if (sscanf(line.c_str(), "dropped %llu", &bytes) == 1) {
+	dropped = bytes;
+      }
+    }
+
+    double mb = results->bytes / double(1 << 20);
+
+    printf("%6s %-8s %6s %6s %5zu %10.1f %8.1f %9.3f %10.1f %9.2f %9.2f %6llu\n",
+	   formatSize(size).c_str(),
+	   s_strategyNames[transfer.strategy],
+	   transfer.strategy == HttpServer::TRANSFER_SPLICE ? formatSize(transfer.pipeBufferSize).c_str() : "-",
+	   formatSize(transfer.chunkSize).c_str(),
+	   transfer.spliceCount,
+	   mb / results->elapsed,
+	   results->requests / results->elapsed,
+	   mb > 0 ? cpu / (mb / 1024) : 0.0,
+	   mb > 0 ? syscalls / mb : 0.0,
+	   results->latency.quantile(0.5) * 1e-6,
+	   results->latency.quantile(0.99) * 1e-6,
+	   static_cast<unsigned long long>(results->errors));
+    fflush(stdout);
+
+    // A lone transfer does not share its read, so nothing keeps the pages it sent.
+    if (options.check && options.connections == 1 && size >= transfer.dropBehindThreshold &&
+	results->bytes >= transfer.dropBehindThreshold && dropped == 0) {
+      std::cerr << "plain-filebench: nothing was dropped behind the transfer of " << formatSize(size) << "\n";
+      return false;
+    }
+
+    return true;
+  }
+
+  int serve(int argc, char *argv[])
+  {
+    if (argc != 8) {
+      std::cerr << "plain-filebench: the server takes port file strategy pipe chunk count\n";
+      return 1;
+    }
+
+    FileServer server;
+    return Main::instance().run(server, argc, argv);
+  }
+
+}
+
+int main(int argc, char *argv[])
+{
+  if (BenchServer::serving(argc, argv)) {
+    return serve(argc, argv);
+  }
+
+  Options options;
+  HttpServer::TransferOptions defaults;
+
+  options.sizes = { 1 << 20, 16 << 20, 128 << 20 };
+  options.strategies = { HttpServer::TRANSFER_SPLICE, HttpServer::TRANSFER_SENDFILE };
+  options.pipeBufferSizes = { defaults.pipeBufferSize };
+  options.chunkSizes = { defaults.chunkSize };
+  options.spliceCounts = { defaults.spliceCount };
+
+  try {
+    int opt;
+    while ((opt = getopt(argc, argv, "c:d:s:t:p:k:n:D:P:x")) != -1) {
+      switch (opt) {
+      case 'c':
+	options.connections = strtoul(optarg, NULL, 10);
+	break;
+
+      case 'd':
+	options.duration = strtod(optarg, NULL);
+	break;
+
+      case 's':
+	parseSizes(optarg, options.sizes);
+	break;
+
+      case 't':
+	options.strategies.clear();
+	for (std::string const &name : split(optarg)) {
+	  if (name == "splice") {
+	    options.strategies.push_back(HttpServer::TRANSFER_SPLICE);
+	  } else if (name == "sendfile") {
+	    options.strategies.push_back(HttpServer::TRANSFER_SENDFILE);
+	  } else {
+	    throw std::runtime_error("Unknown strategy " + name + ".");
+	  }
+	}
+	break;
+
+      case 'p':
+	parseSizes(optarg, options.pipeBufferSizes);
+	break;
+
+      case 'k':
+	parseSizes(optarg, options.chunkSizes);
+	break;
+
+      case 'n':
+	parseSizes(optarg, options.spliceCounts);
+	break;
+
+      case 'D':
+	options.directory = optarg;
+	break;
+
+      case 'P':
+	options.port = atoi(optarg);
+	break;
+
+      case 'x':
+	options.check = true;
+	break;
+
+      default:
+	usage(argv[0]);
+	return 1;
+      };
+    }
+
+    if (mkdir(options.directory.c_str(), 0755) == -1 && errno != EEXIST) {
+      throw ErrnoException(errno);
+    }
+
+    // The load generator gets a broken connection when the server goes away.
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%zu connections, %.1f s per run\n", options.connections, options.duration);
+    printf("%6s %-8s %6s %6s %5s %10s %8s %9s %10s %9s %9s %6s\n",
+	   "size", "strategy", "pipe", "chunk", "count", "MB/s", "req/s", "cpu s/GB", "syscall/MB", "p50 ms", "p99 ms", "errors");
+
+    bool passed = true;
+
+    for (uint64_t size : options.sizes) {
+      std::string path = generateFile(options.directory, size);
+
+      for (HttpServer::TransferStrategy strategy : options.strategies) {
+	// The pipe buffer size only applies to splice.
+	std::vector<size_t> pipeBufferSizes = options.pipeBufferSizes;
+	if (strategy != HttpServer::TRANSFER_SPLICE) {
+	  pipeBufferSizes.resize(1);
+	}
+
+	for (size_t pipeBufferSize : pipeBufferSizes) {
+	  for (size_t chunkSize : options.chunkSizes) {
+	    for (size_t spliceCount : options.spliceCounts) {
+	      HttpServer::TransferOptions transfer;
+	      transfer.strategy = strategy;
+	      transfer.pipeBufferSize = pipeBufferSize;
+	      transfer.chunkSize = chunkSize;
+	      transfer.spliceCount = spliceCount;
+
+	      passed = runOne(options, path, size, transfer) && passed;
+	    }
+	  }
+	}
+      }
+    }
+
+    if (!passed) {
+      return 1;
+    }
+  } catch (std::exception const &e) {
+    std::cerr << "plain-filebench: " << e.what() << "\n";
+    return 1;
+  }
+
+  Log::instance().flush();
+
+  return 0;
+}
@@ -0,0 +1,135 @@
+#ifndef __INC_PLAIN_HEADERCORPUS_H__
+#define __INC_PLAIN_HEADERCORPUS_H__
+
+#include <stddef.h>
+
+namespace plain {
+
+  /**
+   *  Request header corpora for the micro benchmarks.
+   *
+   *  The headers are modeled on what current browsers, command line clients and
+   *  crawlers send, the field order and sizes matter for the scanner and parser.
+   */
+  struct HeaderCorpus {
+    char const *name;
+    char const *const *headers;
+    size_t count;
+  };
+
+  static char const *const s_browserHeaders[] = {
+    // Chrome.
+    "GET / HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "sec-ch-ua: \"Chromium\";v=\"124\", \"Google Chrome\";v=\"124\", \"Not-A.Brand\";v=\"99\"\r\n"
+    "sec-ch-ua-mobile: ?0\r\n"
+    "sec-ch-ua-platform: \"Linux\"\r\n"
+    "Upgrade-Insecure-Requests: 1\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/124.0.0.0 Safari/537.36\r\n"
+    "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,image/apng,*/*;q=0.8,application/signed-exchange;v=b3;q=0.7\r\n"
+    "Sec-Fetch-Site: none\r\n"
+    "Sec-Fetch-Mode: navigate\r\n"
+    "Sec-Fetch-User: ?1\r\n"
+    "Sec-Fetch-Dest: document\r\n"
+    "Accept-Encoding: gzip, deflate, br, zstd\r\n"
+    "Accept-Language: en-US,en;q=0.9,nl;q=0.8\r\n"
+    "Cookie: session=5f1c2a9e0b7d4c3a8e6f; _ga=GA1.1.123456789.1700000000; theme=dark\r\n"
+    "\r\n",
+
+    // Firefox.
+    "GET /static/css/main.css HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (X11; Linux x86_64; rv:125.0) Gecko/20100101 Firefox/125.0\r\n"
+    "Accept: text/css,*/*;q=0.1\r\n"
+    "Accept-Language: en-US,en;q=0.5\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Referer: https://www.example.com/\r\n"
+    "Connection: keep-alive\r\n"
+    "Sec-Fetch-Dest: style\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "If-Modified-Since: Tue, 02 Apr 2024 10:11:12 GMT\r\n"
+    "If-None-Match: \"65f1a2b3-4c2d\"\r\n"
+    "\r\n",
+
+    // Safari.
+    "GET /images/logo.png HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Accept: image/webp,image/avif,image/jxl,image/heic,image/heic-sequence,video/*;q=0.8,image/png,image/svg+xml,image/*;q=0.8,*/*;q=0.5\r\n"
+    "Sec-Fetch-Site: same-origin\r\n"
+    "Accept-Language: en-GB,en;q=0.9\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "Sec-Fetch-Mode: no-cors\r\n"
+    "User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_15_7) AppleWebKit/605.1.15 (KHTML, like Gecko) Version/17.4 Safari/605.1.15\r\n"
+    "Referer: https://www.example.com/\r\n"
+    "Connection: keep-alive\r\n"
+    "Sec-Fetch-Dest: image\r\n"
+    "\r\n",
+  };
+
+  static char const *const s_curlHeaders[] = {
+    "GET / HTTP/1.1\r\n"
+    "Host: localhost:8080\r\n"
+    "User-Agent: curl/8.5.0\r\n"
+    "Accept: */*\r\n"
+    "\r\n",
+
+    "GET /lost.mkv HTTP/1.1\r\n"
+    "Host: 127.0.0.1:8080\r\n"
+    "User-Agent: curl/7.88.1\r\n"
+    "Accept: */*\r\n"
+    "Range: bytes=0-1048575\r\n"
+    "\r\n",
+
+    "GET /index.html HTTP/1.0\r\n"
+    "User-Agent: Wget/1.21.4\r\n"
+    "Accept: */*\r\n"
+    "Accept-Encoding: identity\r\n"
+    "Host: localhost:8080\r\n"
+    "Connection: Keep-Alive\r\n"
+    "\r\n",
+  };
+
+  static char const *const s_botHeaders[] = {
+    "GET /robots.txt HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "Connection: keep-alive\r\n"
+    "User-Agent: Mozilla/5.0 (compatible; Googlebot/2.1; +http://www.google.com/bot.html)\r\n"
+    "Accept: text/plain,text/html,*/*;q=0.8\r\n"
+    "From: googlebot(at)googlebot.com\r\n"
+    "Accept-Encoding: gzip, deflate, br\r\n"
+    "\r\n",
+
+    "GET /sitemap.xml HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: Mozilla/5.0 (compatible; bingbot/2.0; +http://www.bing.com/bingbot.htm)\r\n"
+    "Accept: */*\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n",
+
+    "GET /api/health HTTP/1.1\r\n"
+    "Host: www.example.com\r\n"
+    "User-Agent: python-requests/2.31.0\r\n"
+    "Accept-Encoding: gzip, deflate\r\n"
+    "Accept: */*\r\n"
+    "Connection: keep-alive\r\n"
+    "\r\n",
+
+    "GET /.env HTTP/1.1\r\n"
+    "Host: 203.0.113.7\r\n"
+    "User-Agent: Go-http-client/1.1\r\n"
+    "Accept-Encoding: gzip\r\n"
+    "\r\n",
+  };
+
+  static HeaderCorpus const s_headerCorpora[] = {
+    { "browser", s_browserHeaders, sizeof(s_browserHeaders) / sizeof(s_browserHeaders[0]) },
+    { "curl", s_curlHeaders, sizeof(s_curlHeaders) / sizeof(s_curlHeaders[0]) },
+    { "bot", s_botHeaders, sizeof(s_botHeaders) / sizeof(s_botHeaders[0]) },
+  };
+
+}
+
+#endif // __INC_PLAIN_HEADERCORPUS_H__
@@ -0,0 +1,557 @@
+#include "loadgenerator.h"
+#include "io/poll.h"
+#include "core/log.h"
+
+#include "exceptions/errnoexception.h"
+
+#include <vector>
+#include <deque>
+#include <chrono>
+#include <stdexcept>
+
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+using namespace plain;
+
+struct LoadGenerator::Internal {
+
+  enum {
+    // The maximum size of a response header.
+    MAX_HEADER_SIZE = 8192,
+
+    // The size of the buffer response data is read into.
+    READ_BUFFER_SIZE = 64 * 1024,
+
+    // The number of reads per event, so a large response does not hold up the other connections.
+    READS_PER_EVENT = 16,
+  };
+
+  enum ConnectionState {
+    // Not connected, it will be (re)connected by the main loop.
+    STATE_CLOSED,
+
+    STATE_CONNECTING,
+
+    // Connected and waiting for a request to become due.
+    STATE_IDLE,
+
+    // Writing the request.
+    STATE_SENDING,
+
+    // Reading the response.
+    STATE_RECEIVING,
+
+    // The response was received and the connection is closed after it.
+    STATE_FINISHED,
+  };
+
+  typedef std::chrono::steady_clock::time_point TimePoint;
+
+  struct Connection {
+    Internal *internal;
+
+    ConnectionState state;
+    int fd;
+
+    // The request being sent and the number of its bytes written.
+    std::string const *request;
+    size_t sendPosition;
+
+    // Set when the request does not keep the connection alive.
+    bool closeAfterResponse;
+
+    // The response header, as far as it has been received.
+    char header[MAX_HEADER_SIZE];
+    size_t headerFill;
+    bool headerReceived;
+
+    // Response body accounting.
+    uint64_t contentLength;
+    uint64_t bodyReceived;
+
+    // The time the current request was due and the time it was sent.
+    TimePoint due;
+    TimePoint sent;
+
+    // Open loop schedule, the next time a request is due and the due
+    // requests that are waiting for the connection.
+    TimePoint nextDue;
+    std::deque<TimePoint> backlog;
+  };
+
+  Options d_options;
+
+  // The resolved server address.
+  sockaddr_storage d_address;
+  socklen_t d_addressLength;
+
+  // The request that is sent over and over.
+  std::string d_request;
+
+  Poll d_poll;
+
+  std::vector<std::unique_ptr<Connection>> d_connections;
+
+  // Replay: the index of the next request to become due, and the due
+  // requests that are waiting for an idle connection.
+  size_t d_replayNext;
+  std::deque<std::pair<TimePoint, size_t>> d_replayBacklog;
+
+  // Replay: per request, whether it asks for a keep-alive connection.
+  std::vector<bool> d_replayKeepAlive;
+
+  // Open loop: the time between two requests on a single connection.
+  std::chrono::steady_clock::duration d_interval;
+
+  // Results.
+  uint64_t d_requests;
+  uint64_t d_bytes;
+  uint64_t d_errors;
+  uint64_t d_connects;
+  Metrics::Histogram d_latency;
+  Metrics::Histogram d_serviceTime;
+
+  // Shared buffer for reading responses.
+  char d_readBuffer[READ_BUFFER_SIZE];
+
+  Internal(Options const &options)
+    : d_options(options),
+      d_addressLength(0),
+      d_replayNext(0),
+      d_requests(0),
+      d_bytes(0),
+      d_errors(0),
+      d_connects(0)
+  {
+    if (options.mode == MODE_OPEN_LOOP && options.rate <= 0) {
+      throw std::runtime_error("open loop mode needs a positive request rate");
+    }
+
+    if (options.mode == MODE_REPLAY && options.replay.empty()) {
+      throw std::runtime_error("replay mode needs requests");
+    }
+
+    // The server closes connections that are not explicitly kept alive, so
+    // the connection is closed after such a request to not race the server.
+    for (ReplayRequest const &request : options.replay) {
+      d_replayKeepAlive.push_back(strcasestr(request.header.c_str(), "\r\nConnection: keep-alive") != NULL);
+    }
+
+    resolve();
+
+    d_request = "GET " + options.uri + " HTTP/1.1\r\n"
+      "Host: " + options.host + "\r\n"
+      "Connection: keep-alive\r\n"
+      "\r\n";
+
+    for (size_t i = 0; i < options.connections; ++i) {
+      std::unique_ptr<Connection> connection(new Connection);
+      connection->internal = this;
+      connection->state = STATE_CLOSED;
+      connection->fd = -1;
+      d_connections.push_back(std::move(connection));
+    }
+
+    double interval = options.rate > 0 ? options.connections / options.rate : 0;
+    d_interval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(interval));
+  }
+
+  ~Internal()
+  {
+    for (auto &connection : d_connections) {
+      if (connection->fd != -1) {
+	d_poll.close(connection->fd);
+      }
+    }
+  }
+
+  void resolve()
+  {
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+
+    addrinfo *result = NULL;
+    std::string port = std::to_string(d_options.port);
+
+    int ret = getaddrinfo(d_options.host.c_str(), port.c_str(), &hints, &result);
+
+    if (ret != 0) {
+      throw std::runtime_error("failed to resolve " + d_options.host + ": " + gai_strerror(ret));
+    }
+
+    memcpy(&d_address, result->ai_addr, result->ai_addrlen);
+    d_addressLength = result->ai_addrlen;
+
+    freeaddrinfo(result);
+  }
+
+  void connect(Connection *connection)
+  {
+    int fd = socket(d_address.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+
+    if (fd == -1) {
+      throw ErrnoException(errno);
+    }
+
+    int flag = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    int ret = ::connect(fd, reinterpret_cast<sockaddr const *>(&d_address), d_addressLength);
+
+    if (ret == -1 && errno != EINPROGRESS) {
+      LOG_WARNING("Failed to connect: %s.", strerror(errno));
+      ::close(fd);
+      ++d_errors;
+      return;
+    }
+
+    connection->fd = fd;
+    connection->state = STATE_CONNECTING;
+    resetResponse(connection);
+
+    d_poll.add(fd, Poll::IN | Poll::OUT, _onEvent, connection);
+  }
+
+  void resetResponse(Connection *connection)
+  {
+    connection->request = &d_request;
+    connection->sendPosition = 0;
+    connection->closeAfterResponse = false;
+    connection->headerFill = 0;
+    connection->headerReceived = false;
+    connection->contentLength = 0;
+    connection->bodyReceived = 0;
+  }
+
+  // Sends the next request if one is due and the connection is idle.
+  void sendNext(Connection *connection)
+  {
+    if (connection->state != STATE_IDLE) {
+      return;
+    }
+
+    TimePoint now = std::chrono::steady_clock::now();
+
+    std::string const *request = &d_request;
+    bool closeAfterResponse = false;
+
+    if (d_options.mode == MODE_OPEN_LOOP) {
+      if (connection->backlog.empty()) {
+	return;
+      }
+
+      connection->due = connection->backlog.front();
+      connection->backlog.pop_front();
+    } else if (d_options.mode == MODE_REPLAY) {
+      if (d_replayBacklog.empty()) {
+	return;
+      }
+
+      connection->due = d_replayBacklog.front().first;
+      request = &d_options.replay[d_replayBacklog.front().second].header;
+      closeAfterResponse = !d_replayKeepAlive[d_replayBacklog.front().second];
+      d_replayBacklog.pop_front();
+    } else {
+      connection->due = now;
+    }
+
+    connection->sent = now;
+    connection->state = STATE_SENDING;
+    resetResponse(connection);
+    connection->request = request;
+    connection->closeAfterResponse = closeAfterResponse;
+
+    send(connection);
+  }
+
+  // Writes the remainder of the request, returns false when the write would block.
+  bool send(Connection *connection)
+  {
+    std::string const &request = *connection->request;
+
+    while (connection->sendPosition < request.size()) {
+      ssize_t ret = ::write(connection->fd,
+			    request.data() + connection->sendPosition,
+			    request.size() - connection->sendPosition);
+
+      if (ret == -1) {
+	if (errno == EAGAIN) {
+	  return false;
+	} else if (errno == EINTR) {
+	  continue;
+	}
+
+	// The connection failed, this is noticed by the next read.
+	return true;
+      }
+
+      connection->sendPosition += ret;
+    }
+
+    connection->state = STATE_RECEIVING;
+    return true;
+  }
+
+  // Parses the Content-Length header field.
+  static uint64_t contentLength(char const *header, size_t size)
+  {
+    static char const s_field[] = "\r\ncontent-length:";
+    size_t fieldLength = sizeof(s_field) - 1;
+
+    for (size_t i = 0; i + fieldLength <= size; ++i) {
+      if (strncasecmp(header + i, s_field, fieldLength) == 0) {
+	return strtoull(header + i + fieldLength, NULL, 10);
+      }
+    }
+
+    return 0;
+  }
+
+  // Accounts for received response data, returns false when the response is invalid.
+  bool received(Connection *connection, char const *data, size_t count)
+  {
+    d_bytes += count;
+
+    if (!connection->headerReceived) {
+      size_t offset = connection->headerFill >= 3 ? connection->headerFill - 3 : 0;
+      size_t copy = std::min<size_t>(count, MAX_HEADER_SIZE - connection->headerFill);
+
+      memcpy(connection->header + connection->headerFill, data, copy);
+      connection->headerFill += copy;
+
+      char const *end = static_cast<char const *>(memmem(connection->header + offset,
+							   connection->headerFill - offset,
+							   "\r\n\r\n", 4));
+
+      if (end == NULL) {
+	return connection->headerFill < MAX_HEADER_SIZE;
+      }
+
+      size_t headerSize = end + 4 - connection->header;
+
+      connection->headerReceived = true;
+      connection->contentLength = contentLength(connection->header, headerSize);
+
+      // The rest of the data is body.
+      size_t consumed = headerSize - (connection->headerFill - copy);
+      data += consumed;
+      count -= consumed;
+    }
+
+    connection->bodyReceived += count;
+
+    if (connection->bodyReceived >= connection->contentLength) {
+      completed(connection);
+    }
+
+    return true;
+  }
+
+  // Accounts for a complete response and sends the next request.
+  void completed(Connection *connection)
+  {
+    TimePoint now = std::chrono::steady_clock::now();
+
+    d_latency.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - connection->due).count());
+    d_serviceTime.record(std::chrono::duration_cast<std::chrono::nanoseconds>(now - connection->sent).count());
+    ++d_requests;
+
+    if (connection->closeAfterResponse) {
+      connection->state = STATE_FINISHED;
+      return;
+    }
+
+    connection->state = STATE_IDLE;
+    sendNext(connection);
+  }
+
+  // Marks the connection closed, the poll system closes the descriptor.
+  void closed(Connection *connection, bool error)
+  {
+    if (error || connection->state == STATE_SENDING || connection->state == STATE_RECEIVING) {
+      ++d_errors;
+    }
+
+    connection->state = STATE_CLOSED;
+    connection->fd = -1;
+  }
+
+  static void _onEvent(int fd, uint32_t events, void *data, Poll::AsyncResult &asyncResult)
+  {
+    Connection *connection = reinterpret_cast<Connection*>(data);
+    connection->internal->onEvent(connection, events, asyncResult);
+  }
+
+  void onEvent(Connection *connection, uint32_t events, Poll::AsyncResult &asyncResult)
+  {
+    if (connection->state == STATE_CONNECTING) {
+      int error = 0;
+      socklen_t length = sizeof(error);
+      getsockopt(connection->fd, SOL_SOCKET, SO_ERROR, &error, &length);
+
+      if (error != 0) {
+	LOG_WARNING("Failed to connect: %s.", strerror(error));
+	closed(connection, true);
+	asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
+	return;
+      }
+
+      ++d_connects;
+      connection->state = STATE_IDLE;
+      sendNext(connection);
+    }
+
+    // Writes that do not block are done directly, so the write event is only needed
+    // to continue a request that blocked.
+    if (connection->state == STATE_SENDING) {
+      send(connection);
+    }
+
+    for (size_t i = 0; i < READS_PER_EVENT; ++i) {
+      ssize_t ret = ::read(connection->fd, d_readBuffer, READ_BUFFER_SIZE);
+
+      if (ret == -1) {
+	if (errno == EAGAIN) {
+	  asyncResult.completed(static_cast<Poll::EventResultMask>(Poll::READ_COMPLETED | Poll::WRITE_COMPLETED));
+	  return;
+	} else if (errno == EINTR) {
+	  continue;
+	}
+
+	closed(connection, true);
+	asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
+	return;
+      } else if (ret == 0) {
+	closed(connection, false);
+	asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
+	return;
+      }
+
+      if (connection->state == STATE_RECEIVING) {
+	if (!received(connection, d_readBuffer, ret)) {
+	  LOG_WARNING("Response header too large.");
+	  closed(connection, true);
+	  asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
+	  return;
+	}
+
+	if (connection->state == STATE_FINISHED) {
+	  closed(connection, false);
+	  asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
+	  return;
+	}
+      } else {
+	d_bytes += ret;
+      }
+    }
+
+    // More data might be waiting, yield to the other connections.
+    asyncResult.completed(Poll::WRITE_COMPLETED);
+  }
+
+  // Replay: true when all requests were sent and completed.
+  bool replayed() const
+  {
+    if (d_replayNext < d_options.replay.size() || !d_replayBacklog.empty()) {
+      return false;
+    }
+
+    for (auto const &connection : d_connections) {
+      if (connection->state == STATE_SENDING || connection->state == STATE_RECEIVING) {
+	return false;
+      }
+    }
+
+    return true;
+  }
+
+  void run(Results &results)
+  {
+    TimePoint start = std::chrono::steady_clock::now();
+    TimePoint end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(d_options.duration));
+
+    // Spread the first requests of the connections over the first interval.
+    for (size_t i = 0; i < d_connections.size(); ++i) {
+      d_connections[i]->nextDue = start + d_interval * i / d_connections.size();
+    }
+
+    TimePoint now = start;
+
+    while ((d_options.mode == MODE_REPLAY && d_options.duration <= 0) || now < end) {
+
+      // Wake up regularly in open loop mode, so requests are sent when they are due.
+      d_poll.update(d_options.mode != MODE_CLOSED_LOOP ? 1 : 10);
+
+      now = std::chrono::steady_clock::now();
+
+      if (d_options.mode == MODE_REPLAY) {
+	if (replayed()) {
+	  break;
+	}
+
+	while (d_replayNext < d_options.replay.size()) {
+	  TimePoint due = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(d_options.replay[d_replayNext].offset));
+
+	  if (due > now) {
+	    break;
+	  }
+
+	  d_replayBacklog.push_back(std::make_pair(due, d_replayNext++));
+	}
+      }
+
+      for (auto &connection : d_connections) {
+	if (connection->state == STATE_CLOSED) {
+	  connect(connection.get());
+	}
+
+	if (d_options.mode == MODE_OPEN_LOOP) {
+	  while (connection->nextDue <= now) {
+	    connection->backlog.push_back(connection->nextDue);
+	    connection->nextDue += d_interval;
+	  }
+	}
+
+	sendNext(connection.get());
+      }
+    }
+
+    results.requests = d_requests;
+    results.bytes = d_bytes;
+    results.errors = d_errors;
+    results.connects = d_connects;
+    results.elapsed = std::chrono::duration<double>(now - start).count();
+
+    results.backlog = d_replayBacklog.size() + d_options.replay.size() - d_replayNext;
+    for (auto const &connection : d_connections) {
+      results.backlog += connection->backlog.size();
+    }
+
+    d_latency.snapshot(results.latency);
+    d_serviceTime.snapshot(results.serviceTime);
+  }
+
+};
+
+LoadGenerator::LoadGenerator(Options const &options)
+  : d(new Internal(options))
+{
+}
+
+LoadGenerator::~LoadGenerator()
+{
+}
+
+void LoadGenerator::run(Results &results)
+{
+  d->run(results);
+}
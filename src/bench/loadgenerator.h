@@ -0,0 +1,135 @@
+#ifndef __INC_PLAIN_LOADGENERATOR_H__
+#define __INC_PLAIN_LOADGENERATOR_H__
+
+#include "core/metrics.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace plain {
+
+  /**
+   *  HTTP load generator built on Poll.
+   *
+   *  It opens a number of keep-alive connections to a server and sends GET
+   *  requests over them, one request at a time per connection, from a single
+   *  event loop.
+   *
+   *  In closed loop mode every connection sends its next request as soon as the
+   *  previous response is received, which measures the maximum throughput.
+   *
+   *  In open loop mode requests are sent at a fixed total rate, spread over the
+   *  connections. When a request is due while its connection is still busy it is
+   *  queued, and its latency is measured from the time it was due instead of the
+   *  time it was sent. This corrects for coordinated omission: a stalled server
+   *  can not hide its stall by stopping the load generator from sending.
+   *
+   *  Replay mode is open loop with recorded requests: every request is sent as
+   *  is, at its own time, over the first idle connection.
+   */
+  class LoadGenerator {
+  public:
+
+    enum Mode {
+      MODE_CLOSED_LOOP,
+      MODE_OPEN_LOOP,
+      MODE_REPLAY,
+    };
+
+    struct ReplayRequest {
+      // The time the request is due, in seconds from the start of the run.
+      double offset;
+
+      // The raw request header, including the terminating empty line.
+      std::string header;
+    };
+
+    struct Options {
+      // The server address, host is a numeric address or a host name.
+      std::string host;
+      int port;
+
+      // The uri to request.
+      std::string uri;
+
+      // The number of concurrent connections.
+      size_t connections;
+
+      // The duration of the run in seconds. In replay mode zero runs until all requests are done.
+      double duration;
+
+      Mode mode;
+
+      // The total request rate in requests per second, for open loop mode.
+      double rate;
+
+      // The requests to send in replay mode, ordered by offset.
+      std::vector<ReplayRequest> replay;
+
+      Options()
+	: host("127.0.0.1"),
+	  port(8080),
+	  uri("/"),
+	  connections(64),
+	  duration(10),
+	  mode(MODE_CLOSED_LOOP),
+	  rate(1000)
+      {
+      }
+    };
+
+    struct Results {
+      // The number of completed requests.
+      uint64_t requests;
+
+      // The number of bytes received, including headers.
+      uint64_t bytes;
+
+      // The number of failed connects, resets and responses cut short.
+      uint64_t errors;
+
+      // The number of established connections.
+      uint64_t connects;
+
+      // The number of requests that were due but not sent when the run ended (open loop and replay only).
+      uint64_t backlog;
+
+      // The length of the run in seconds.
+      double elapsed;
+
+      // Latency from the time a request was due until its response was complete,
+      // in nanoseconds. In closed loop mode a request is due when it is sent.
+      Metrics::Histogram::Snapshot latency;
+
+      // Latency from the time a request was sent until its response was complete.
+      Metrics::Histogram::Snapshot serviceTime;
+    };
+
+    /**
+     *  @throw std::runtime_error when the host can not be resolved.
+     */
+    LoadGenerator(Options const &options);
+
+    ~LoadGenerator();
+
+    /**
+     *  Runs the load for the configured duration.
+     *
+     *  @param results the results of the run.
+     *  @throw ErrnoException on unexpected system call failures.
+     */
+    void run(Results &results);
+
+  private:
+
+    struct Internal;
+    std::unique_ptr<Internal> d;
+
+  };
+
+}
+
+#endif // __INC_PLAIN_LOADGENERATOR_H__
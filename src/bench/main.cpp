@@ -0,0 +1,196 @@
+#include "bench/loadgenerator.h"
+#include "core/log.h"
+#include "net/requestcapture.h"
+
+#include <iostream>
+#include <stdexcept>
+#include <algorithm>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+using namespace plain;
+
+static void usage(char const *program)
+{
+  std::cerr << "usage: " << program << " [-c connections] [-d seconds] [-r rate] [-u uri] [-R capture [-x speed]] [host] [port]\n"
+	    << "\n"
+	    << "  -c connections  number of keep-alive connections (default 64)\n"
+	    << "  -d seconds      duration of the run (default 10)\n"
+	    << "  -r rate         open loop mode with a fixed total rate in requests per second,\n"
+	    << "                  latency is corrected for coordinated omission\n"
+	    << "                  (default closed loop mode)\n"
+	    << "  -u uri          the uri to request (default /)\n"
+	    << "  -R capture      replay the requests of a capture file at their recorded times,\n"
+	    << "                  until all are done unless -d is given\n"
+	    << "  -x speed        replay speed, 2 replays twice as fast (default 1)\n"
+	    << "  host port       the server (default 127.0.0.1 8080)\n";
+}
+
+// Loads a capture file as replay requests, with their offsets scaled by the speed.
+static void loadReplay(char const *path, double speed, LoadGenerator::Options &options)
+{
+  std::vector<RequestCapture::Request> requests;
+  RequestCapture::read(path, requests);
+
+  if (requests.empty()) {
+    throw std::runtime_error(std::string(path) + " contains no requests");
+  }
+
+  // Captures can be appended to, so order the requests by time.
+  std::stable_sort(requests.begin(), requests.end(),
+		   [](RequestCapture::Request const &a, RequestCapture::Request const &b) { return a.time < b.time; });
+
+  for (RequestCapture::Request &request : requests) {
+    LoadGenerator::ReplayRequest replay;
+    replay.offset = (request.time - requests.front().time) * 1e-6 / speed;
+    replay.header = std::move(request.header);
+    options.replay.push_back(std::move(replay));
+  }
+}
+
+// Raises the file descriptor limit, the poll system sizes its table from it.
+static void raiseFileLimit()
+{
+  rlimit l;
+
+  if (getrlimit(RLIMIT_NOFILE, &l) == 0 && l.rlim_cur < l.rlim_max) {
+    l.rlim_cur = l.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &l);
+  }
+}
+
+static void printLatency(char const *name, Metrics::Histogram::Snapshot const &snapshot)
+{
+  printf("%-14s %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+	 name,
+	 snapshot.count ? snapshot.sum * 1e-3 / snapshot.count : 0.0,
+	 snapshot.quantile(0.5) * 1e-3,
+	 snapshot.quantile(0.9) * 1e-3,
+	 snapshot.quantile(0.99) * 1e-3,
+	 snapshot.quantile(0.999) * 1e-3,
+	 snapshot.max * 1e-3);
+}
+
+int main(int argc, char *argv[])
+{
+  LoadGenerator::Options options;
+
+  char const *capture = NULL;
+  double speed = 1;
+  bool duration = false;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "c:d:r:u:R:x:")) != -1) {
+    switch (opt) {
+    case 'c':
+      options.connections = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'd':
+      options.duration = strtod(optarg, NULL);
+      duration = true;
+      break;
+
+    case 'r':
+      options.mode = LoadGenerator::MODE_OPEN_LOOP;
+      options.rate = strtod(optarg, NULL);
+      break;
+
+    case 'u':
+      options.uri = optarg;
+      break;
+
+    case 'R':
+      capture = optarg;
+      break;
+
+    case 'x':
+      speed = strtod(optarg, NULL);
+      break;
+
+    default:
+      usage(argv[0]);
+      return 1;
+    };
+  }
+
+  if (optind < argc) {
+    options.host = argv[optind++];
+  }
+
+  if (optind < argc) {
+    options.port = atoi(argv[optind++]);
+  }
+
+  raiseFileLimit();
+
+  std::unique_ptr<LoadGenerator::Results> results(new LoadGenerator::Results);
+
+  try {
+    if (capture != NULL) {
+      if (speed <= 0) {
+	throw std::runtime_error("the replay speed should be positive");
+      }
+
+      options.mode = LoadGenerator::MODE_REPLAY;
+      loadReplay(capture, speed, options);
+
+      if (!duration) {
+	options.duration = 0;
+      }
+    }
+
+    LoadGenerator generator(options);
+
+    if (options.mode == LoadGenerator::MODE_REPLAY) {
+      printf("%zu connections, replay of %zu requests over %.1f s at %gx, http://%s:%d\n",
+	     options.connections,
+	     options.replay.size(),
+	     options.replay.back().offset,
+	     speed,
+	     options.host.c_str(), options.port);
+    } else {
+      printf("%zu connections, %s, %.1f s, http://%s:%d%s\n",
+	     options.connections,
+	     options.mode == LoadGenerator::MODE_OPEN_LOOP ? "open loop" : "closed loop",
+	     options.duration,
+	     options.host.c_str(), options.port, options.uri.c_str());
+    }
+
+    generator.run(*results);
+  } catch (std::exception const &e) {
+    std::cerr << "plain-bench: " << e.what() << "\n";
+    return 1;
+  }
+
+  printf("requests       %10llu\n", static_cast<unsigned long long>(results->requests));
+  printf("errors         %10llu\n", static_cast<unsigned long long>(results->errors));
+  printf("connects       %10llu\n", static_cast<unsigned long long>(results->connects));
+
+  if (options.mode == LoadGenerator::MODE_OPEN_LOOP) {
+    printf("target         %10.1f requests/s\n", options.rate);
+  }
+
+  if (options.mode != LoadGenerator::MODE_CLOSED_LOOP) {
+    printf("backlog        %10llu\n", static_cast<unsigned long long>(results->backlog));
+  }
+
+  printf("throughput     %10.1f requests/s\n", results->requests / results->elapsed);
+  printf("bandwidth      %10.2f MB/s\n", results->bytes / results->elapsed / (1024 * 1024));
+  printf("\n");
+  printf("%-14s %10s %10s %10s %10s %10s %10s\n", "latency (us)", "mean", "p50", "p90", "p99", "p999", "max");
+  printLatency("response", results->latency);
+
+  // In open loop and replay mode the latency includes the time requests waited to be sent.
+  if (options.mode != LoadGenerator::MODE_CLOSED_LOOP) {
+    printLatency("service", results->serviceTime);
+  }
+
+  Log::instance().flush();
+
+  return results->errors == 0 ? 0 : 2;
+}
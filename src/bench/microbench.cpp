@@ -0,0 +1,126 @@
+#include "microbench.h"
+
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <algorithm>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace plain;
+
+namespace {
+
+  enum {
+    // The number of measured runs of every benchmark, the best run is reported.
+    REPETITIONS = 5,
+  };
+
+  // The minimum duration of a measured run in nanoseconds.
+  const double MIN_RUN_TIME = 50e6;
+
+  std::atomic<uint64_t> s_allocations(0);
+
+  struct Benchmark {
+    char const *name;
+    MicroBenchmark::Function function;
+  };
+
+  std::vector<Benchmark> &benchmarks()
+  {
+    static std::vector<Benchmark> s_benchmarks;
+    return s_benchmarks;
+  }
+
+  double run(MicroBenchmark::Function function, size_t iterations)
+  {
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    function(iterations);
+    std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double, std::nano>(t1 - t0).count();
+  }
+
+}
+
+// Count every heap allocation of the benchmark executable.
+void *operator new(size_t size)
+{
+  s_allocations.fetch_add(1, std::memory_order_relaxed);
+
+  void *ptr = malloc(size == 0 ? 1 : size);
+
+  if (ptr == NULL) {
+    throw std::bad_alloc();
+  }
+
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+  free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+  free(ptr);
+}
+
+MicroBenchmark::MicroBenchmark(char const *name, Function function)
+{
+  Benchmark benchmark = { name, function };
+  benchmarks().push_back(benchmark);
+}
+
+uint64_t MicroBenchmark::allocations()
+{
+  return s_allocations.load(std::memory_order_relaxed);
+}
+
+size_t MicroBenchmark::runAll(char const *filter)
+{
+  size_t count = 0;
+
+  printf("%-40s %12s %12s %12s\n", "benchmark", "iterations", "ns/op", "allocs/op");
+
+  for (Benchmark const &benchmark : benchmarks()) {
+    if (filter != NULL && strstr(benchmark.name, filter) == NULL) {
+      continue;
+    }
+
+    // Calibrate the number of iterations, this also warms up the caches.
+    size_t iterations = 1;
+    double elapsed = run(benchmark.function, iterations);
+
+    while (elapsed < MIN_RUN_TIME && iterations < (1ull << 40)) {
+      double factor = elapsed > 0 ? MIN_RUN_TIME / elapsed * 1.2 : 10;
+      iterations = static_cast<size_t>(iterations * std::min(std::max(factor, 2.0), 100.0));
+      elapsed = run(benchmark.function, iterations);
+    }
+
+    double best = elapsed;
+    uint64_t allocations = 0;
+
+    for (size_t i = 0; i < REPETITIONS; ++i) {
+      uint64_t a0 = MicroBenchmark::allocations();
+      double t = run(benchmark.function, iterations);
+      allocations = MicroBenchmark::allocations() - a0;
+
+      best = std::min(best, t);
+    }
+
+    printf("%-40s %12zu %12.2f %12.3f\n",
+	   benchmark.name,
+	   iterations,
+	   best / iterations,
+	   static_cast<double>(allocations) / iterations);
+
+    ++count;
+  }
+
+  return count;
+}
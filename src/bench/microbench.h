@@ -0,0 +1,66 @@
+#ifndef __INC_PLAIN_MICROBENCH_H__
+#define __INC_PLAIN_MICROBENCH_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace plain {
+
+  /**
+   *  Minimal micro benchmark harness.
+   *
+   *  A benchmark is a function that runs the measured operation the given number
+   *  of times. The harness calibrates the number of iterations, runs every
+   *  benchmark a few times and reports the best time per operation together with
+   *  the number of heap allocations per operation. Allocations are counted by the
+   *  global operator new of the benchmark executable.
+   *
+   *    PLAIN_BENCHMARK(parseMethod)
+   *    {
+   *      for (size_t i = 0; i < iterations; ++i) {
+   *        MicroBenchmark::doNotOptimize(Http::parseMethod("GET", 3));
+   *      }
+   *    }
+   */
+  class MicroBenchmark {
+  public:
+
+    typedef void (*Function)(size_t iterations);
+
+    /**
+     *  Registers a benchmark, use PLAIN_BENCHMARK instead.
+     */
+    MicroBenchmark(char const *name, Function function);
+
+    /**
+     *  Runs all registered benchmarks whose name contains the filter.
+     *
+     *  @param filter the name filter, NULL runs all benchmarks.
+     *  @return the number of benchmarks run.
+     */
+    static size_t runAll(char const *filter);
+
+    /**
+     *  @return the number of heap allocations so far.
+     */
+    static uint64_t allocations();
+
+    /**
+     *  Prevents the compiler from optimizing away the computation of a value.
+     */
+    template<class T>
+    static void doNotOptimize(T const &value)
+    {
+      asm volatile("" : : "g"(&value) : "memory");
+    }
+
+  };
+
+}
+
+#define PLAIN_BENCHMARK(NAME)						\
+  static void NAME(size_t iterations);					\
+  static plain::MicroBenchmark s_benchmark_##NAME(#NAME, NAME);	\
+  static void NAME(size_t iterations)
+
+#endif // __INC_PLAIN_MICROBENCH_H__
@@ -0,0 +1,212 @@
+#include "bench/microbench.h"
+#include "bench/headercorpus.h"
+#include "net/http.h"
+#include "net/httprequest.h"
+#include "io/ioscheduler.h"
+#include "io/timeoutlist.h"
+
+#include <string>
+#include <vector>
+#include <chrono>
+
+#include <string.h>
+
+using namespace plain;
+
+namespace {
+
+  enum {
+    // The size of the request header buffer, as in the server.
+    HEADER_BUFFER_SIZE = 8192,
+
+    // The number of schedulables and timeout list entries used.
+    ENTRY_COUNT = 1024,
+
+    // The number of schedulables scheduled before they are run.
+    SCHEDULE_BATCH_SIZE = 64,
+  };
+
+  // The headers of a corpus, padded like the server buffer so the scanner can
+  // do 4 byte loads.
+  std::vector<std::string> const &corpus(size_t index)
+  {
+    static std::vector<std::string> s_corpora[sizeof(s_headerCorpora) / sizeof(s_headerCorpora[0])];
+
+    std::vector<std::string> &headers = s_corpora[index];
+
+    if (headers.empty()) {
+      for (size_t i = 0; i < s_headerCorpora[index].count; ++i) {
+	std::string header = s_headerCorpora[index].headers[i];
+	header.reserve(header.size() + 4);
+	headers.push_back(header);
+      }
+    }
+
+    return headers;
+  }
+
+  template<size_t CORPUS>
+  void findEndOfHeader(size_t iterations)
+  {
+    std::vector<std::string> const &headers = corpus(CORPUS);
+
+    for (size_t i = 0; i < iterations; ++i) {
+      std::string const &header = headers[i % headers.size()];
+      MicroBenchmark::doNotOptimize(Http::findEndOfHeader(header.data(), 0, header.size()));
+    }
+  }
+
+  // The parser works in place, so this includes copying the header to the buffer.
+  template<size_t CORPUS>
+  void parseHttpRequestHeaders(size_t iterations)
+  {
+    std::vector<std::string> const &headers = corpus(CORPUS);
+    char buffer[HEADER_BUFFER_SIZE];
+
+    for (size_t i = 0; i < iterations; ++i) {
+      std::string const &header = headers[i % headers.size()];
+      memcpy(buffer, header.data(), header.size());
+
+      HttpRequest request;
+      Http::parseHttpRequestHeaders(request, buffer, header.size());
+      MicroBenchmark::doNotOptimize(request);
+    }
+  }
+
+  // The copy that is part of the parse benchmarks.
+  template<size_t CORPUS>
+  void copyHeader(size_t iterations)
+  {
+    std::vector<std::string> const &headers = corpus(CORPUS);
+    char buffer[HEADER_BUFFER_SIZE];
+
+    for (size_t i = 0; i < iterations; ++i) {
+      std::string const &header = headers[i % headers.size()];
+      memcpy(buffer, header.data(), header.size());
+      MicroBenchmark::doNotOptimize(buffer);
+    }
+  }
+
+  // A schedulable callback that is done right away.
+  void scheduledDone(IoScheduler::Schedulable *schedulable, void *data, IoScheduler::ResultCallback asyncResultCallback)
+  {
+    asyncResultCallback(schedulable, IoScheduler::RESULT_DONE);
+  }
+
+  struct TimeoutEntry {
+    TimeoutEntry *timeoutNext;
+    TimeoutEntry *timeoutPrev;
+    std::chrono::steady_clock::time_point timeout;
+  };
+
+}
+
+static MicroBenchmark s_findEndOfHeaderBrowser("findEndOfHeader/browser", findEndOfHeader<0>);
+static MicroBenchmark s_findEndOfHeaderCurl("findEndOfHeader/curl", findEndOfHeader<1>);
+static MicroBenchmark s_findEndOfHeaderBot("findEndOfHeader/bot", findEndOfHeader<2>);
+
+static MicroBenchmark s_copyHeaderBrowser("copyHeader/browser", copyHeader<0>);
+static MicroBenchmark s_copyHeaderCurl("copyHeader/curl", copyHeader<1>);
+static MicroBenchmark s_copyHeaderBot("copyHeader/bot", copyHeader<2>);
+
+static MicroBenchmark s_parseBrowser("parseHttpRequestHeaders/browser", parseHttpRequestHeaders<0>);
+static MicroBenchmark s_parseCurl("parseHttpRequestHeaders/curl", parseHttpRequestHeaders<1>);
+static MicroBenchmark s_parseBot("parseHttpRequestHeaders/bot", parseHttpRequestHeaders<2>);
+
+PLAIN_BENCHMARK(parseMethod)
+{
+  static char const *const s_methods[] = { "GET", "PUT", "POST", "HEAD" };
+
+  for (size_t i = 0; i < iterations; ++i) {
+    char const *method = s_methods[i % 4];
+    MicroBenchmark::doNotOptimize(Http::parseMethod(method, strlen(method)));
+  }
+}
+
+PLAIN_BENCHMARK(parseVersion)
+{
+  static char const *const s_versions[] = { "1.1", "1.0" };
+
+  for (size_t i = 0; i < iterations; ++i) {
+    MicroBenchmark::doNotOptimize(Http::parseVersion(s_versions[i % 2], 3));
+  }
+}
+
+PLAIN_BENCHMARK(responseHeader)
+{
+  char buffer[512];
+
+  for (size_t i = 0; i < iterations; ++i) {
+    Http::Response response(buffer, sizeof(buffer), 200, "Okay");
+    response.addHeaderField("Content-Length", static_cast<size_t>(i));
+    response.addHeaderField("Connection", "keep-alive");
+    MicroBenchmark::doNotOptimize(response.size());
+  }
+}
+
+// Schedules and runs a schedulable, in batches.
+PLAIN_BENCHMARK(ioSchedulerScheduleRun)
+{
+  static IoScheduler s_scheduler;
+  static IoScheduler::Schedulable s_entries[SCHEDULE_BATCH_SIZE];
+
+  for (size_t i = 0; i < SCHEDULE_BATCH_SIZE; ++i) {
+    s_entries[i].schedCallback = scheduledDone;
+  }
+
+  for (size_t i = 0; i < iterations; ++i) {
+    s_scheduler.schedule(s_entries + i % SCHEDULE_BATCH_SIZE);
+
+    if (i % SCHEDULE_BATCH_SIZE == SCHEDULE_BATCH_SIZE - 1) {
+      while (!s_scheduler.empty()) {
+	s_scheduler.runNext();
+      }
+    }
+  }
+
+  while (!s_scheduler.empty()) {
+    s_scheduler.runNext();
+  }
+}
+
+// Moves an entry to the back of a list of ENTRY_COUNT entries, as happens every
+// time a descriptor is scheduled and completed.
+PLAIN_BENCHMARK(timeoutListRemoveAdd)
+{
+  static TimeoutList<TimeoutEntry> s_list(std::chrono::seconds(30));
+  static TimeoutEntry s_entries[ENTRY_COUNT];
+  static bool s_filled = false;
+
+  if (!s_filled) {
+    for (size_t i = 0; i < ENTRY_COUNT; ++i) {
+      s_list.add(s_entries + i, std::chrono::steady_clock::now());
+    }
+
+    s_filled = true;
+  }
+
+  for (size_t i = 0; i < iterations; ++i) {
+    TimeoutEntry *entry = s_entries + (i * 7) % ENTRY_COUNT;
+    s_list.remove(entry);
+    s_list.add(entry, std::chrono::steady_clock::now());
+  }
+}
+
+// Adds an entry and pops it when it expired.
+PLAIN_BENCHMARK(timeoutListAddPop)
+{
+  static TimeoutList<TimeoutEntry> s_list(std::chrono::steady_clock::duration::zero());
+  static TimeoutEntry s_entries[ENTRY_COUNT];
+
+  std::chrono::steady_clock::time_point t = std::chrono::steady_clock::time_point::max();
+
+  for (size_t i = 0; i < iterations; ++i) {
+    s_list.add(s_entries + i % ENTRY_COUNT, std::chrono::steady_clock::now());
+    MicroBenchmark::doNotOptimize(s_list.pop(t));
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  return MicroBenchmark::runAll(argc > 1 ? argv[1] : NULL) > 0 ? 0 : 1;
+}
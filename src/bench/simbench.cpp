@@ -0,0 +1,433 @@
+#include "core/log.h"
+#include "io/poll.h"
+#include "io/simulatedbackend.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+ *  Simulated event loop benchmark.
+ *
+ *  Runs Poll, the IoScheduler and the timeout list on a SimulatedBackend, so
+ *  there is no kernel in the loop and the virtual clock only moves when the
+ *  loop waits. Every scenario prints a checksum over the order in which the
+ *  callbacks ran: with the same options it must be the same on every run, a
+ *  different checksum after a change means the scheduling order changed.
+ *  With -c the checksums are compared to the recorded ones, this only works
+ *  with the default options and is what make check runs.
+ *
+ *  timeouts  every connection is added with a timeout, part of them get
+ *            activity first. All must time out, and not later than the poll
+ *            wait granularity after their deadline.
+ *  fairness  busy connections that never run out of work. Round robin means
+ *            every connection runs equally often and at most once per round.
+ *  events    random readiness events spread over virtual time, this measures
+ *            the loop cost per event.
+ */
+
+using namespace plain;
+
+namespace {
+
+  enum {
+    // The poll wait in milliseconds, the virtual clock jumps this far when nothing is ready.
+    WAIT_TIMEOUT = 100,
+
+    // The number of busy connections in the fairness scenario.
+    BUSY_CONNECTIONS = 1024,
+
+    // The number of runs per busy connection in the fairness scenario.
+    BUSY_ROUNDS = 100,
+  };
+
+  // The checksums of the scenarios with the default options. These only change
+  // with the scheduling order, update them when that is intended.
+  uint64_t const TIMEOUTS_CHECKSUM = 0xcf9e44d3208908eeULL;
+  uint64_t const FAIRNESS_CHECKSUM = 0x9d86d40745659e6dULL;
+  uint64_t const EVENTS_CHECKSUM = 0xb4a5d3aa3947d466ULL;
+
+  struct Options {
+    size_t connections;
+    size_t events;
+    double timeout;
+    uint64_t seed;
+    bool check;
+
+    Options()
+      : connections(100000),
+	events(1000000),
+	timeout(30),
+	seed(1),
+	check(false)
+    {
+    }
+
+    bool isDefault() const
+    {
+      Options defaults;
+
+      return connections == defaults.connections && events == defaults.events &&
+	timeout == defaults.timeout && seed == defaults.seed;
+    }
+  };
+
+  // Deterministic random numbers, the standard distributions differ between libraries.
+  class Random {
+    uint64_t d_state;
+
+  public:
+
+    Random(uint64_t seed)
+      : d_state(seed * 2 + 1)
+    {
+    }
+
+    uint64_t next(uint64_t range)
+    {
+      d_state = d_state * 6364136223846793005ULL + 1442695040888963407ULL;
+      return (d_state >> 33) % range;
+    }
+  };
+
+  // The state shared by the callbacks of a scenario.
+  struct Scenario {
+    SimulatedBackend *backend;
+    std::unique_ptr<Poll> poll;
+
+    // FNV-1a over the callback order.
+    uint64_t checksum;
+
+    uint64_t callbacks;
+
+    Scenario(size_t connections)
+      : backend(new SimulatedBackend(connections)),
+	poll(new Poll(std::unique_ptr<PollBackend>(backend))),
+	checksum(14695981039346656037ULL),
+	callbacks(0)
+    {
+    }
+
+    void ran(int fd, uint32_t events)
+    {
+      checksum = (checksum ^ static_cast<uint64_t>(fd)) * 1099511628211ULL;
+      checksum = (checksum ^ events) * 1099511628211ULL;
+      ++callbacks;
+    }
+
+    // Runs the loop until nothing is queued, scripted or done.
+    template<class Done>
+    void run(Done const &done)
+    {
+      while (!done() || poll->stats().queueLength != 0 || backend->scripted() != 0) {
+	poll->update(WAIT_TIMEOUT);
+      }
+    }
+  };
+
+  double seconds(std::chrono::steady_clock::duration duration)
+  {
+    return std::chrono::duration_cast<std::chrono::duration<double>>(duration).count();
+  }
+
+  struct TimeoutScenario : public Scenario {
+    std::chrono::steady_clock::duration timeout;
+
+    // The virtual time each connection was last active.
+    std::vector<std::chrono::steady_clock::time_point> active;
+
+    size_t timeouts;
+    std::chrono::steady_clock::duration maxLateness;
+
+    TimeoutScenario(size_t connections, std::chrono::steady_clock::duration t)
+      : Scenario(connections),
+	timeout(t),
+	active(connections),
+	timeouts(0),
+	maxLateness(std::chrono::steady_clock::duration::zero())
+    {
+    }
+
+    static void _onEvent(int fd, uint32_t events, void *data, Poll::AsyncResult &asyncResult)
+    {
+      TimeoutScenario *scenario = reinterpret_cast<TimeoutScenario*>(data);
+      scenario->ran(fd, events);
+
+      if (events & Poll::TIMEOUT) {
+	scenario->maxLateness = std::max(scenario->maxLateness, scenario->backend->now() - scenario->active[fd] - scenario->timeout);
+	++scenario->timeouts;
+	asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
+	return;
+      }
+
+      // The deadline restarts when the callback completes.
+      scenario->active[fd] = scenario->backend->now();
+      asyncResult.completed(Poll::READ_COMPLETED);
+    }
+  };
+
+  uint64_t runTimeouts(Options const &options)
+  {
+    std::chrono::steady_clock::duration timeout =
+      std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(options.timeout));
+
+    TimeoutScenario scenario(options.connections, timeout);
+    scenario.poll->setTimeout(timeout);
+    Random random(options.seed);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (size_t fd = 0; fd < options.connections; ++fd) {
+      scenario.active[fd] = scenario.backend->now();
+      scenario.poll->add(fd, Poll::IN | Poll::TIMEOUT, TimeoutScenario::_onEvent, &scenario);
+
+      // Half of the connections get a request within the first half of the timeout.
+      if (random.next(2) == 0) {
+	scenario.backend->signalAt(scenario.backend->now() + timeout / 2 * random.next(1000) / 1000, fd, Poll::IN);
+      }
+    }
+
+    scenario.run([&scenario, &options]() { return scenario.timeouts == options.connections; });
+
+    std::chrono::steady_clock::duration wall = std::chrono::steady_clock::now() - start;
+
+    printf("%-10s %10zu %10llu %10.1f %10.0f %12.1f %016llx\n",
+	   "timeouts", options.connections,
+	   static_cast<unsigned long long>(scenario.callbacks),
+	   seconds(scenario.backend->now().time_since_epoch()),
+	   seconds(wall) * 1e9 / scenario.callbacks,
+	   seconds(scenario.maxLateness) * 1e3,
+	   static_cast<unsigned long long>(scenario.checksum));
+
+    if (scenario.backend->closed() != options.connections) {
+      throw std::runtime_error("not all connections were closed");
+    }
+
+    return scenario.checksum;
+  }
+
+  struct FairnessScenario : public Scenario {
+    size_t connections;
+    uint64_t budget;
+
+    // Per connection, the number of runs and the callback count of the last run.
+    std::vector<uint64_t> runs;
+    std::vector<uint64_t> lastRun;
+
+    uint64_t maxGap;
+
+    FairnessScenario(size_t c)
+      : Scenario(c),
+	connections(c),
+	budget(c * BUSY_ROUNDS),
+	runs(c, 0),
+	lastRun(c, 0),
+	maxGap(0)
+    {
+    }
+
+    static void _onEvent(int fd, uint32_t events, void *data, Poll::AsyncResult &asyncResult)
+    {
+      FairnessScenario *scenario = reinterpret_cast<FairnessScenario*>(data);
+      scenario->ran(fd, events);
+
+      if (scenario->runs[fd] != 0) {
+	scenario->maxGap = std::max(scenario->maxGap, scenario->callbacks - scenario->lastRun[fd]);
+      }
+
+      ++scenario->runs[fd];
+      scenario->lastRun[fd] = scenario->callbacks;
+
+      // Busy until the budget is spent, then the reads run dry.
+      if (scenario->callbacks < scenario->budget) {
+	asyncResult.completed(Poll::NONE_COMPLETED);
+      } else {
+	asyncResult.completed(Poll::READ_COMPLETED);
+      }
+    }
+  };
+
+  uint64_t runFairness(Options const &options)
+  {
+    size_t connections = std::min<size_t>(options.connections, BUSY_CONNECTIONS);
+    FairnessScenario scenario(connections);
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    for (size_t fd = 0; fd < connections; ++fd) {
+      scenario.poll->add(fd, Poll::IN, FairnessScenario::_onEvent, &scenario);
+      scenario.backend->signal(fd, Poll::IN);
+    }
+
+    scenario.run([&scenario]() { return scenario.callbacks >= scenario.budget; });
+
+    std::chrono::steady_clock::duration wall = std::chrono::steady_clock::now() - start;
+
+    uint64_t minRuns = *std::min_element(scenario.runs.begin(), scenario.runs.end());
+    uint64_t maxRuns = *std::max_element(scenario.runs.begin(), scenario.runs.end());
+
+    printf("%-10s %10zu %10llu %10.1f %10.0f %12s %016llx\n",
+	   "fairness", connections,
+	   static_cast<unsigned long long>(scenario.callbacks),
+	   seconds(scenario.backend->now().time_since_epoch()),
+	   seconds(wall) * 1e9 / scenario.callbacks,
+	   "",
+	   static_cast<unsigned long long>(scenario.checksum));
+    printf("           runs per connection %llu..%llu, max gap %llu callbacks for %zu connections\n",
+	   static_cast<unsigned long long>(minRuns),
+	   static_cast<unsigned long long>(maxRuns),
+	   static_cast<unsigned long long>(scenario.maxGap),
+	   connections);
+
+    return scenario.checksum;
+  }
+
+  struct EventScenario : public Scenario {
+    EventScenario(size_t connections)
+      : Scenario(connections)
+    {
+    }
+
+    static void _onEvent(int fd, uint32_t events, void *data, Poll::AsyncResult &asyncResult)
+    {
+      EventScenario *scenario = reinterpret_cast<EventScenario*>(data);
+      scenario->ran(fd, events);
+
+      // A read of a request and the write of its response.
+      asyncResult.completed(static_cast<Poll::EventResultMask>(Poll::READ_COMPLETED | Poll::WRITE_COMPLETED));
+    }
+  };
+
+  uint64_t runEvents(Options const &options)
+  {
+    EventScenario scenario(options.connections);
+    Random random(options.seed);
+
+    for (size_t fd = 0; fd < options.connections; ++fd) {
+      scenario.poll->add(fd, Poll::IN | Poll::OUT, EventScenario::_onEvent, &scenario);
+    }
+
+    // One event per microsecond of virtual time on average.
+    for (size_t i = 0; i < options.events; ++i) {
+      scenario.backend->signalAt(scenario.backend->now() + std::chrono::microseconds(random.next(options.events)),
+				 random.next(options.connections),
+				 random.next(2) == 0 ? Poll::IN : Poll::OUT);
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    scenario.run([]() { return true; });
+
+    std::chrono::steady_clock::duration wall = std::chrono::steady_clock::now() - start;
+
+    printf("%-10s %10zu %10llu %10.1f %10.0f %12s %016llx\n",
+	   "events", options.connections,
+	   static_cast<unsigned long long>(scenario.callbacks),
+	   seconds(scenario.backend->now().time_since_epoch()),
+	   scenario.callbacks == 0 ? 0.0 : seconds(wall) * 1e9 / scenario.callbacks,
+	   "",
+	   static_cast<unsigned long long>(scenario.checksum));
+
+    return scenario.checksum;
+  }
+
+  /*
+   *  @return true when the checksum is the recorded one, prints the mismatch otherwise.
+   */
+  bool checkChecksum(char const *scenario, uint64_t checksum, uint64_t expected)
+  {
+    if (checksum == expected) {
+      return true;
+    }
+
+    fprintf(stderr, "plain-simbench: %s checksum %016llx, expected %016llx\n", scenario,
+	    static_cast<unsigned long long>(checksum),
+	    static_cast<unsigned long long>(expected));
+    return false;
+  }
+
+  void usage(char const *program)
+  {
+    std::cerr << "usage: " << program << " [-n connections] [-e events] [-T seconds] [-s seed] [-c]\n"
+	      << "\n"
+	      << "  -n connections  simulated connections (default 100000)\n"
+	      << "  -e events       readiness events in the events scenario (default 1000000)\n"
+	      << "  -T seconds      the poll timeout in the timeouts scenario (default 30)\n"
+	      << "  -s seed         the random seed (default 1)\n"
+	      << "  -c              fail when a checksum differs from the recorded one,\n"
+	      << "                  only with the default options\n";
+  }
+
+}
+
+int main(int argc, char *argv[])
+{
+  Options options;
+
+  int opt;
+  while ((opt = getopt(argc, argv, "n:e:T:s:c")) != -1) {
+    switch (opt) {
+    case 'n':
+      options.connections = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'e':
+      options.events = strtoul(optarg, NULL, 10);
+      break;
+
+    case 'T':
+      options.timeout = strtod(optarg, NULL);
+      break;
+
+    case 's':
+      options.seed = strtoull(optarg, NULL, 10);
+      break;
+
+    case 'c':
+      options.check = true;
+      break;
+
+    default:
+      usage(argv[0]);
+      return 1;
+    };
+  }
+
+  if (options.connections == 0 || (options.check && !options.isDefault())) {
+    usage(argv[0]);
+    return 1;
+  }
+
+  try {
+    printf("%-10s %10s %10s %10s %10s %12s %16s\n",
+	   "scenario", "conns", "callbacks", "virtual s", "ns/call", "late ms", "checksum");
+
+    uint64_t timeouts = runTimeouts(options);
+    uint64_t fairness = runFairness(options);
+    uint64_t events = runEvents(options);
+
+    if (options.check) {
+      bool passed = checkChecksum("timeouts", timeouts, TIMEOUTS_CHECKSUM);
+      passed = checkChecksum("fairness", fairness, FAIRNESS_CHECKSUM) && passed;
+      passed = checkChecksum("events", events, EVENTS_CHECKSUM) && passed;
+
+      if (!passed) {
+	return 1;
+      }
+    }
+  } catch (std::exception const &e) {
+    std::cerr << "plain-simbench: " << e.what() << "\n";
+    return 1;
+  }
+
+  Log::instance().flush();
+
+  return 0;
+}
@@ -0,0 +1,103 @@
+#ifndef __INC_PLAIN_ARENA_H__
+#define __INC_PLAIN_ARENA_H__
+
+#include <new>
+#include <cstddef>
+#include <cstring>
+
+namespace plain {
+
+  /**
+   *  A bump allocator on top of a caller provided buffer.
+   *
+   *  Allocations are never freed individually, instead the whole arena is
+   *  reset at once. The arena does not own its buffer.
+   */
+  class Arena {
+
+    char *d_buffer;
+    size_t d_capacity;
+    size_t d_size;
+
+  public:
+
+    Arena()
+      : d_buffer(NULL), d_capacity(0), d_size(0) {}
+
+    /**
+     *  Create a new arena on top of the specified buffer.
+     *
+     *  @param buffer the buffer to allocate from.
+     *  @param capacity the size of the buffer in bytes.
+     */
+    Arena(char *buffer, size_t capacity)
+      : d_buffer(buffer), d_capacity(capacity), d_size(0) {}
+
+    /**
+     *  Allocate a block of memory from the arena.
+     *
+     *  @param size the size of the block in bytes.
+     *  @param alignment the alignment of the block, should be a power of two.
+     *  @return a pointer to the block.
+     *
+     *  @throw std::bad_alloc when the arena is exhausted.
+     */
+    void *allocate(size_t size, size_t alignment = alignof(std::max_align_t))
+    {
+      size_t offset = (d_size + alignment - 1) & ~(alignment - 1);
+
+      if (offset > d_capacity || size > d_capacity - offset) {
+	throw std::bad_alloc();
+      }
+
+      d_size = offset + size;
+
+      return d_buffer + offset;
+    }
+
+    /**
+     *  Allocate an array of objects from the arena.
+     *
+     *  Note: no constructors are run, so this should only be used for trivial types.
+     */
+    template <class T>
+    T *allocate(size_t count)
+    {
+      return reinterpret_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+    }
+
+    /**
+     *  Copy a string into the arena.
+     *
+     *  @param str the string to copy.
+     *  @param length the length of the string in bytes.
+     *  @return the zero terminated copy.
+     */
+    char *copy(char const *str, size_t length)
+    {
+      char *res = reinterpret_cast<char*>(allocate(length + 1, 1));
+      memcpy(res, str, length);
+      res[length] = 0;
+      return res;
+    }
+
+    /**
+     *  Release all allocations at once.
+     */
+    void reset() { d_size = 0; }
+
+    /**
+     *  @return the number of bytes in use.
+     */
+    size_t size() const { return d_size; }
+
+    /**
+     *  @return the size of the underlying buffer in bytes.
+     */
+    size_t capacity() const { return d_capacity; }
+
+  };
+
+}
+
+#endif // __INC_PLAIN_ARENA_H__
@@ -0,0 +1,82 @@
+#include "core/framepool.h"
+#include "core/metrics.h"
+
+#include <new>
+
+using namespace plain;
+
+namespace {
+
+  enum {
+    CLASS_COUNT = FramePool::MAX_POOLED_SIZE / FramePool::GRANULARITY,
+  };
+
+  // A free frame, linked through its first bytes.
+  struct FreeFrame {
+    FreeFrame *next;
+  };
+
+  // The free lists of the thread, one per size class.
+  struct FreeLists {
+    FreeFrame *heads[CLASS_COUNT];
+
+    FreeLists()
+    {
+      for (size_t i = 0; i < CLASS_COUNT; ++i) {
+	heads[i] = NULL;
+      }
+    }
+
+    ~FreeLists()
+    {
+      for (size_t i = 0; i < CLASS_COUNT; ++i) {
+	while (heads[i] != NULL) {
+	  FreeFrame *frame = heads[i];
+	  heads[i] = frame->next;
+	  ::operator delete(frame);
+	}
+      }
+    }
+  };
+
+  thread_local FreeLists t_freeLists;
+
+  Metrics::Counter &s_pooledMetric = Metrics::instance().counter("plain_coroutine_frames_total", "Number of coroutine frames allocated.", "source=\"pool\"");
+  Metrics::Counter &s_heapMetric = Metrics::instance().counter("plain_coroutine_frames_total", "Number of coroutine frames allocated.", "source=\"heap\"");
+
+}
+
+void *FramePool::allocate(size_t size)
+{
+  if (size > MAX_POOLED_SIZE) {
+    s_heapMetric.add();
+    return ::operator new(size);
+  }
+
+  size_t sizeClass = (size + GRANULARITY - 1) / GRANULARITY - 1;
+  FreeFrame *frame = t_freeLists.heads[sizeClass];
+
+  if (frame == NULL) {
+    // Allocate the full class size, so the frame can be reused for the class.
+    s_heapMetric.add();
+    return ::operator new((sizeClass + 1) * GRANULARITY);
+  }
+
+  s_pooledMetric.add();
+  t_freeLists.heads[sizeClass] = frame->next;
+  return frame;
+}
+
+void FramePool::deallocate(void *frame, size_t size)
+{
+  if (size > MAX_POOLED_SIZE) {
+    ::operator delete(frame);
+    return;
+  }
+
+  size_t sizeClass = (size + GRANULARITY - 1) / GRANULARITY - 1;
+  FreeFrame *freeFrame = static_cast<FreeFrame*>(frame);
+
+  freeFrame->next = t_freeLists.heads[sizeClass];
+  t_freeLists.heads[sizeClass] = freeFrame;
+}
@@ -0,0 +1,43 @@
+#ifndef __INC_PLAIN_FRAMEPOOL_H__
+#define __INC_PLAIN_FRAMEPOOL_H__
+
+#include <stddef.h>
+
+namespace plain {
+
+  /**
+   *  Recycles coroutine frames, so starting a Task does not allocate once the
+   *  pool is warm.
+   *
+   *  Freed frames are kept on per thread free lists by size class, the pool of
+   *  a loop thread serves the frames of the tasks it runs. Frames larger than
+   *  MAX_POOLED_SIZE come from the heap.
+   */
+  class FramePool {
+  public:
+
+    enum {
+      // The frame sizes are rounded up to a multiple of this.
+      GRANULARITY = 64,
+
+      // Larger frames are not pooled.
+      MAX_POOLED_SIZE = 4096,
+    };
+
+    /**
+     *  @return a frame of at least size bytes.
+     */
+    static void *allocate(size_t size);
+
+    /**
+     *  Returns a frame to the pool of the calling thread.
+     *
+     *  @param size the size it was allocated with.
+     */
+    static void deallocate(void *frame, size_t size);
+
+  };
+
+}
+
+#endif // __INC_PLAIN_FRAMEPOOL_H__
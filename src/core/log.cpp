@@ -0,0 +1,286 @@
+#include "log.h"
+#include "ringbuffer.h"
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace plain;
+
+struct Log::Internal {
+
+  enum {
+    // The maximum length of a formatted message in bytes, longer messages are truncated.
+    MAX_MESSAGE_LENGTH = 240,
+
+    // The number of messages that fit in a thread local ring buffer.
+    RING_SIZE = 1024,
+
+    // The interval in milliseconds at which the background thread drains the ring buffers.
+    FLUSH_INTERVAL = 10,
+
+    // The size of the output buffer of the background thread.
+    OUTPUT_BUFFER_SIZE = 64 * 1024,
+  };
+
+  // A single queued message.
+  struct Record {
+    timespec time;
+    Level level;
+    unsigned length;
+    char text[MAX_MESSAGE_LENGTH];
+  };
+
+  // The ring buffer of a single producing thread.
+  struct Ring : public RingBuffer<Record, RING_SIZE> {
+    // Number of messages dropped because the ring was full.
+    std::atomic<size_t> dropped;
+
+    Ring() : dropped(0) {}
+  };
+
+  // The minimum runtime log level.
+  std::atomic<int> d_level;
+
+  // The output file descriptor.
+  std::atomic<int> d_fd;
+
+  // All ring buffers, a ring buffer is never freed so it outlives its thread.
+  std::mutex d_ringsMutex;
+  std::vector<std::unique_ptr<Ring>> d_rings;
+
+  // Serializes the consumer side of the rings.
+  std::mutex d_drainMutex;
+
+  // Output buffer, only used while holding the drain mutex.
+  char d_output[OUTPUT_BUFFER_SIZE];
+  size_t d_outputFill;
+
+  // The background flush thread.
+  std::mutex d_threadMutex;
+  std::condition_variable d_threadCondition;
+  bool d_running;
+  std::thread d_thread;
+
+  Internal()
+    : d_level(PLAIN_LOG_LEVEL),
+      d_fd(STDOUT_FILENO),
+      d_outputFill(0),
+      d_running(true)
+  {
+    d_thread = std::thread(&Internal::run, this);
+  }
+
+  ~Internal()
+  {
+    {
+      std::lock_guard<std::mutex> lk(d_threadMutex);
+      d_running = false;
+    }
+
+    d_threadCondition.notify_one();
+    d_thread.join();
+
+    drain();
+  }
+
+  // Gets the ring of the calling thread, registering one on first use.
+  Ring *ring()
+  {
+    static thread_local Ring *t_ring = NULL;
+
+    if (t_ring == NULL) {
+      std::unique_ptr<Ring> ring(new Ring);
+      t_ring = ring.get();
+
+      std::lock_guard<std::mutex> lk(d_ringsMutex);
+      d_rings.push_back(std::move(ring));
+    }
+
+    return t_ring;
+  }
+
+  void write(Level level, char const *format, va_list args)
+  {
+    if (level < d_level.load(std::memory_order_relaxed)) {
+      return;
+    }
+
+    Ring *r = ring();
+
+    Record *record = r->reserve();
+
+    if (record == NULL) {
+      r->dropped.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    clock_gettime(CLOCK_REALTIME_COARSE, &record->time);
+    record->level = level;
+
+    int ret = vsnprintf(record->text, MAX_MESSAGE_LENGTH, format, args);
+    record->length = ret < 0 ? 0 : std::min<unsigned>(ret, MAX_MESSAGE_LENGTH - 1);
+
+    r->commit();
+  }
+
+  static char const *levelName(Level level)
+  {
+    switch (level) {
+    case LEVEL_TRACE: return "TRACE";
+    case LEVEL_DEBUG: return "DEBUG";
+    case LEVEL_INFO: return "INFO";
+    case LEVEL_WARNING: return "WARNING";
+    case LEVEL_ERROR: return "ERROR";
+    default: return "?";
+    };
+  }
+
+  // Writes the output buffer to the output file descriptor.
+  void writeOutput()
+  {
+    char const *head = d_output;
+    char const *end = d_output + d_outputFill;
+
+    while (head != end) {
+      ssize_t ret = ::write(d_fd, head, end - head);
+
+      if (ret == -1) {
+	if (errno == EINTR) {
+	  continue;
+	}
+
+	// Nowhere to report this to, drop the output.
+	break;
+      }
+
+      head += ret;
+    }
+
+    d_outputFill = 0;
+  }
+
+  // Formats a line into the output buffer.
+  template <class... ARGV>
+  void print(char const *format, ARGV... argv)
+  {
+    // Make sure the largest possible line fits.
+    if (OUTPUT_BUFFER_SIZE - d_outputFill < MAX_MESSAGE_LENGTH + 64) {
+      writeOutput();
+    }
+
+    int ret = snprintf(d_output + d_outputFill, OUTPUT_BUFFER_SIZE - d_outputFill, format, argv...);
+
+    if (ret > 0) {
+      d_outputFill += std::min<size_t>(ret, OUTPUT_BUFFER_SIZE - d_outputFill - 1);
+    }
+  }
+
+  void printRecord(Record const &record)
+  {
+    tm t;
+    localtime_r(&record.time.tv_sec, &t);
+
+    print("%04d-%02d-%02d %02d:%02d:%02d.%03ld %-7s %.*s\n",
+	  t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
+	  t.tm_hour, t.tm_min, t.tm_sec,
+	  record.time.tv_nsec / 1000000,
+	  levelName(record.level),
+	  record.length, record.text);
+  }
+
+  // Drains all ring buffers to the output.
+  void drain()
+  {
+    std::lock_guard<std::mutex> dlk(d_drainMutex);
+    std::unique_lock<std::mutex> rlk(d_ringsMutex);
+
+    // New rings are only appended, so iterate by index and release the lock
+    // while draining.
+    for (size_t i = 0; i < d_rings.size(); ++i) {
+      Ring *r = d_rings[i].get();
+      rlk.unlock();
+
+      for (Record *record = r->front(); record != NULL; record = r->front()) {
+	printRecord(*record);
+	r->pop();
+      }
+
+      size_t dropped = r->dropped.exchange(0, std::memory_order_relaxed);
+      if (dropped != 0) {
+	print("%zu log messages dropped\n", dropped);
+      }
+
+      rlk.lock();
+    }
+
+    rlk.unlock();
+
+    writeOutput();
+  }
+
+  // The background thread.
+  void run()
+  {
+    std::unique_lock<std::mutex> lk(d_threadMutex);
+
+    while (d_running) {
+      d_threadCondition.wait_for(lk, std::chrono::milliseconds(FLUSH_INTERVAL));
+
+      lk.unlock();
+      drain();
+      lk.lock();
+    }
+  }
+
+};
+
+Log &Log::instance()
+{
+  static Log s_instance;
+  return s_instance;
+}
+
+Log::Log()
+  : d(new Internal)
+{
+}
+
+Log::~Log()
+{
+}
+
+void Log::write(Level level, char const *format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  d->write(level, format, args);
+  va_end(args);
+}
+
+void Log::setLevel(Level level)
+{
+  d->d_level = level;
+}
+
+void Log::setOutput(int fd)
+{
+  flush();
+  d->d_fd = fd;
+}
+
+void Log::flush()
+{
+  d->drain();
+}
@@ -0,0 +1,97 @@
+#ifndef __INC_PLAIN_LOG_H__
+#define __INC_PLAIN_LOG_H__
+
+#include <memory>
+
+/**
+ *  The minimum log level that is compiled in, messages below this level
+ *  are removed by the compiler. Defaults to LEVEL_INFO, build with
+ *  -DPLAIN_LOG_LEVEL=0 to get all trace messages.
+ */
+#ifndef PLAIN_LOG_LEVEL
+#define PLAIN_LOG_LEVEL 2
+#endif
+
+#define PLAIN_LOG(LEVEL, ...)						\
+  do {									\
+    if (LEVEL >= PLAIN_LOG_LEVEL) {					\
+      ::plain::Log::instance().write(LEVEL, __VA_ARGS__);		\
+    }									\
+  } while (0)
+
+#define LOG_TRACE(...) PLAIN_LOG(::plain::Log::LEVEL_TRACE, __VA_ARGS__)
+#define LOG_DEBUG(...) PLAIN_LOG(::plain::Log::LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_INFO(...) PLAIN_LOG(::plain::Log::LEVEL_INFO, __VA_ARGS__)
+#define LOG_WARNING(...) PLAIN_LOG(::plain::Log::LEVEL_WARNING, __VA_ARGS__)
+#define LOG_ERROR(...) PLAIN_LOG(::plain::Log::LEVEL_ERROR, __VA_ARGS__)
+
+namespace plain {
+
+  /**
+   *  Asynchronous leveled logger.
+   *
+   *  Messages are formatted by the calling thread into a thread local lock free
+   *  ring buffer. A background thread drains the ring buffers and writes the
+   *  messages out, so logging never blocks on the output. When a ring buffer is
+   *  full the message is dropped and counted.
+   *
+   *  Use the LOG_* macros instead of calling write() directly, so that messages
+   *  below PLAIN_LOG_LEVEL are compiled out.
+   */
+  class Log {
+
+    Log(Log const &) = delete;
+    Log &operator=(Log const &) = delete;
+
+    Log();
+
+  public:
+
+    enum Level {
+      LEVEL_TRACE = 0,
+      LEVEL_DEBUG = 1,
+      LEVEL_INFO = 2,
+      LEVEL_WARNING = 3,
+      LEVEL_ERROR = 4,
+      LEVEL_NONE = 5,
+    };
+
+    static Log &instance();
+
+    ~Log();
+
+    /**
+     *  Format and queue a message.
+     *
+     *  @param level the level of the message.
+     *  @param format the printf style format string, a newline is appended.
+     */
+    void write(Level level, char const *format, ...) __attribute__((format(printf, 3, 4)));
+
+    /**
+     *  Sets the minimum level at runtime, this can only raise the compile time level.
+     */
+    void setLevel(Level level);
+
+    /**
+     *  Sets the file descriptor to write the log to (default is stdout).
+     *
+     *  Note: the log does not take ownership of the file descriptor.
+     */
+    void setOutput(int fd);
+
+    /**
+     *  Writes out all queued messages before returning.
+     */
+    void flush();
+
+  private:
+
+    struct Internal;
+    std::unique_ptr<Internal> d;
+
+  };
+
+}
+
+#endif // __INC_PLAIN_LOG_H__
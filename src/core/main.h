@@ -7,6 +7,7 @@
 #define __INC_PLAIN_MAIN_H__
 
 #include <memory>
+#include <functional>
 
 namespace plain {
 
@@ -36,17 +37,25 @@ namespace plain {
     int run(Application &app, int argc, char *argv[]);
 
     /**
-     *  This stops the main loop.
+     *  This stops the main loop, this can be called from any thread.
      *
      *  @param code the exit code to use.
      */
     void stop(int code = 0);
 
     /**
-     *  Wakes up the main loop.
+     *  Wakes up the main loop, this can be called from any thread.
      */
     void wakeup();
 
+    /**
+     *  Runs the task on the main loop thread, this can be called from any thread.
+     *
+     *  Worker threads use this to hand results back to the loop. The loop is
+     *  woken up, so the task runs without waiting for the poll timeout.
+     */
+    void post(std::function<void()> task);
+
     /**
      *  @returns the IO poll system.
      */
@@ -0,0 +1,390 @@
+#include "metrics.h"
+
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+
+#include <stdio.h>
+#include <string.h>
+
+using namespace plain;
+
+struct Metrics::Internal {
+
+  enum Type {
+    TYPE_COUNTER,
+    TYPE_GAUGE,
+    TYPE_HISTOGRAM,
+  };
+
+  // The quantiles reported for histograms.
+  static constexpr double s_quantiles[] = { 0.5, 0.9, 0.99, 0.999 };
+
+  // A registered metric.
+  struct Entry {
+    std::string name;
+    std::string help;
+    std::string labels;
+    Type type;
+    Unit unit;
+    std::unique_ptr<Counter> counter;
+    std::unique_ptr<Gauge> gauge;
+    std::unique_ptr<Histogram> histogram;
+  };
+
+  mutable std::mutex d_mutex;
+
+  // The registered metrics, entries with the same name are kept together.
+  std::vector<std::unique_ptr<Entry>> d_entries;
+
+  // Finds a registered metric, returns NULL when it is not registered yet.
+  Entry *find(std::string const &name, std::string const &labels)
+  {
+    for (auto &entry : d_entries) {
+      if (entry->name == name && entry->labels == labels) {
+	return entry.get();
+      }
+    }
+
+    return NULL;
+  }
+
+  // Adds a metric after the last metric with the same name.
+  Entry *insert(std::string const &name, std::string const &help, std::string const &labels, Type type)
+  {
+    std::unique_ptr<Entry> entry(new Entry);
+    entry->name = name;
+    entry->help = help;
+    entry->labels = labels;
+    entry->type = type;
+    entry->unit = UNIT_NANOSECONDS;
+
+    auto position = d_entries.end();
+    for (auto i = d_entries.begin(); i != d_entries.end(); ++i) {
+      if ((*i)->name == name) {
+	position = i + 1;
+      }
+    }
+
+    return (*d_entries.insert(position, std::move(entry))).get();
+  }
+
+  static char const *typeName(Type type)
+  {
+    switch (type) {
+    case TYPE_COUNTER: return "counter";
+    case TYPE_GAUGE: return "gauge";
+    case TYPE_HISTOGRAM: return "summary";
+    default: return "untyped";
+    };
+  }
+
+  // Renders a histogram as a Prometheus summary, durations are rendered in seconds.
+  static void renderSummary(std::string &out, Entry const &entry)
+  {
+    std::unique_ptr<Histogram::Snapshot> snapshot(new Histogram::Snapshot);
+    entry.histogram->snapshot(*snapshot);
+
+    double scale = entry.unit == UNIT_NANOSECONDS ? 1e-9 : 1;
+
+    std::string labels = entry.labels.empty() ? "" : entry.labels + ",";
+    char buffer[64];
+
+    for (double quantile : s_quantiles) {
+      snprintf(buffer, sizeof(buffer), "quantile=\"%g\"} %.9f\n", quantile, snapshot->quantile(quantile) * scale);
+      out += entry.name + "{" + labels + buffer;
+    }
+
+    std::string suffix = entry.labels.empty() ? "" : "{" + entry.labels + "}";
+
+    snprintf(buffer, sizeof(buffer), " %.9f\n", snapshot->sum * scale);
+    out += entry.name + "_sum" + suffix + buffer;
+
+    snprintf(buffer, sizeof(buffer), " %llu\n", static_cast<unsigned long long>(snapshot->count));
+    out += entry.name + "_count" + suffix + buffer;
+  }
+
+  void render(std::string &out) const
+  {
+    std::lock_guard<std::mutex> lk(d_mutex);
+
+    std::string const *previous = NULL;
+
+    for (auto const &entry : d_entries) {
+
+      // Only print the help and type once per metric name.
+      if (previous == NULL || *previous != entry->name) {
+	out += "# HELP " + entry->name + " " + entry->help + "\n";
+	out += "# TYPE " + entry->name + " " + typeName(entry->type) + "\n";
+	previous = &entry->name;
+      }
+
+      if (entry->type == TYPE_HISTOGRAM) {
+	renderSummary(out, *entry);
+	continue;
+      }
+
+      out += entry->name;
+
+      if (!entry->labels.empty()) {
+	out += "{" + entry->labels + "}";
+      }
+
+      char buffer[32];
+      if (entry->type == TYPE_COUNTER) {
+	snprintf(buffer, sizeof(buffer), " %llu\n", static_cast<unsigned long long>(entry->counter->value()));
+      } else {
+	snprintf(buffer, sizeof(buffer), " %lld\n", static_cast<long long>(entry->gauge->value()));
+      }
+
+      out += buffer;
+    }
+  }
+
+  void renderHistograms(std::string &out) const
+  {
+    std::lock_guard<std::mutex> lk(d_mutex);
+
+    std::unique_ptr<Histogram::Snapshot> snapshot(new Histogram::Snapshot);
+    char buffer[256];
+
+    snprintf(buffer, sizeof(buffer), "%-60s %10s %10s %10s %10s %10s %10s\n",
+	     "histogram (us or value)", "count", "p50", "p90", "p99", "p999", "max");
+    out += buffer;
+
+    for (auto const &entry : d_entries) {
+      if (entry->type != TYPE_HISTOGRAM) {
+	continue;
+      }
+
+      entry->histogram->snapshot(*snapshot);
+
+      std::string name = entry->name;
+      if (!entry->labels.empty()) {
+	name += "{" + entry->labels + "}";
+      }
+
+      double scale = entry->unit == UNIT_NANOSECONDS ? 1e-3 : 1;
+
+      snprintf(buffer, sizeof(buffer), "%-60s %10llu %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+	       name.c_str(),
+	       static_cast<unsigned long long>(snapshot->count),
+	       snapshot->quantile(0.5) * scale,
+	       snapshot->quantile(0.9) * scale,
+	       snapshot->quantile(0.99) * scale,
+	       snapshot->quantile(0.999) * scale,
+	       snapshot->max * scale);
+      out += buffer;
+    }
+  }
+
+};
+
+constexpr double Metrics::Internal::s_quantiles[];
+
+Metrics::Counter::Counter()
+{
+  for (size_t i = 0; i < MAX_THREADS; ++i) {
+    d_slots[i].value = 0;
+  }
+}
+
+uint64_t Metrics::Counter::value() const
+{
+  uint64_t sum = 0;
+
+  for (size_t i = 0; i < MAX_THREADS; ++i) {
+    sum += d_slots[i].value.load(std::memory_order_relaxed);
+  }
+
+  return sum;
+}
+
+Metrics::Gauge::Gauge()
+{
+  for (size_t i = 0; i < MAX_THREADS; ++i) {
+    d_slots[i].value = 0;
+  }
+}
+
+int64_t Metrics::Gauge::value() const
+{
+  int64_t sum = 0;
+
+  for (size_t i = 0; i < MAX_THREADS; ++i) {
+    sum += d_slots[i].value.load(std::memory_order_relaxed);
+  }
+
+  return sum;
+}
+
+Metrics::Histogram::Histogram()
+{
+  for (size_t i = 0; i < MAX_THREADS; ++i) {
+    d_counts[i] = NULL;
+  }
+}
+
+Metrics::Histogram::~Histogram()
+{
+  for (size_t i = 0; i < MAX_THREADS; ++i) {
+    delete d_counts[i].load();
+  }
+}
+
+Metrics::Histogram::Counts *Metrics::Histogram::allocateCounts()
+{
+  Counts *counts = new Counts;
+
+  for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+    counts->buckets[i] = 0;
+  }
+
+  counts->count = 0;
+  counts->sum = 0;
+  counts->max = 0;
+
+  // Threads beyond MAX_THREADS share slots, so another thread might have been first.
+  Counts *expected = NULL;
+  if (!d_counts[threadIndex()].compare_exchange_strong(expected, counts, std::memory_order_acq_rel)) {
+    delete counts;
+    return expected;
+  }
+
+  return counts;
+}
+
+void Metrics::Histogram::snapshot(Snapshot &snapshot) const
+{
+  memset(&snapshot, 0, sizeof(snapshot));
+
+  for (size_t i = 0; i < MAX_THREADS; ++i) {
+    Counts const *counts = d_counts[i].load(std::memory_order_acquire);
+
+    if (counts == NULL) {
+      continue;
+    }
+
+    for (size_t j = 0; j < BUCKET_COUNT; ++j) {
+      snapshot.buckets[j] += counts->buckets[j].load(std::memory_order_relaxed);
+    }
+
+    snapshot.count += counts->count.load(std::memory_order_relaxed);
+    snapshot.sum += counts->sum.load(std::memory_order_relaxed);
+    snapshot.max = std::max<uint64_t>(snapshot.max, counts->max.load(std::memory_order_relaxed));
+  }
+}
+
+uint64_t Metrics::Histogram::bucketUpperBound(size_t index)
+{
+  if (index < SUB_BUCKET_COUNT) {
+    return index;
+  }
+
+  size_t shift = index / SUB_BUCKET_COUNT - 1;
+  uint64_t subBucket = index % SUB_BUCKET_COUNT + SUB_BUCKET_COUNT;
+
+  return ((subBucket + 1) << shift) - 1;
+}
+
+uint64_t Metrics::Histogram::Snapshot::quantile(double quantile) const
+{
+  if (count == 0) {
+    return 0;
+  }
+
+  // The rank of the value we are looking for (1 based).
+  uint64_t rank = std::max<uint64_t>(1, static_cast<uint64_t>(quantile * count + 0.5));
+  uint64_t seen = 0;
+
+  for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+    seen += buckets[i];
+
+    if (seen >= rank) {
+      return std::min<uint64_t>(bucketUpperBound(i), max);
+    }
+  }
+
+  return max;
+}
+
+size_t Metrics::nextThreadIndex()
+{
+  static std::atomic<size_t> s_next(0);
+  return s_next.fetch_add(1, std::memory_order_relaxed) % MAX_THREADS;
+}
+
+Metrics &Metrics::instance()
+{
+  static Metrics s_instance;
+  return s_instance;
+}
+
+Metrics::Metrics()
+  : d(new Internal)
+{
+}
+
+Metrics::~Metrics()
+{
+}
+
+Metrics::Counter &Metrics::counter(std::string const &name, std::string const &help, std::string const &labels)
+{
+  std::lock_guard<std::mutex> lk(d->d_mutex);
+
+  Internal::Entry *entry = d->find(name, labels);
+
+  if (entry == NULL) {
+    entry = d->insert(name, help, labels, Internal::TYPE_COUNTER);
+    entry->counter.reset(new Counter);
+  } else if (entry->type != Internal::TYPE_COUNTER) {
+    throw std::runtime_error("metric " + name + " is not a counter");
+  }
+
+  return *entry->counter;
+}
+
+Metrics::Gauge &Metrics::gauge(std::string const &name, std::string const &help, std::string const &labels)
+{
+  std::lock_guard<std::mutex> lk(d->d_mutex);
+
+  Internal::Entry *entry = d->find(name, labels);
+
+  if (entry == NULL) {
+    entry = d->insert(name, help, labels, Internal::TYPE_GAUGE);
+    entry->gauge.reset(new Gauge);
+  } else if (entry->type != Internal::TYPE_GAUGE) {
+    throw std::runtime_error("metric " + name + " is not a gauge");
+  }
+
+  return *entry->gauge;
+}
+
+Metrics::Histogram &Metrics::histogram(std::string const &name, std::string const &help, std::string const &labels, Unit unit)
+{
+  std::lock_guard<std::mutex> lk(d->d_mutex);
+
+  Internal::Entry *entry = d->find(name, labels);
+
+  if (entry == NULL) {
+    entry = d->insert(name, help, labels, Internal::TYPE_HISTOGRAM);
+    entry->unit = unit;
+    entry->histogram.reset(new Histogram);
+  } else if (entry->type != Internal::TYPE_HISTOGRAM) {
+    throw std::runtime_error("metric " + name + " is not a histogram");
+  }
+
+  return *entry->histogram;
+}
+
+void Metrics::render(std::string &out) const
+{
+  d->render(out);
+}
+
+void Metrics::renderHistograms(std::string &out) const
+{
+  d->renderHistograms(out);
+}
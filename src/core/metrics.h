@@ -0,0 +1,282 @@
+#ifndef __INC_PLAIN_METRICS_H__
+#define __INC_PLAIN_METRICS_H__
+
+#include <memory>
+#include <string>
+#include <atomic>
+
+#include <stdint.h>
+
+namespace plain {
+
+  /**
+   *  Registry of process wide counters and gauges.
+   *
+   *  Every metric has a cache line sized slot per thread, so updating a metric is
+   *  a single uncontended atomic add. The slots are only summed when the metrics
+   *  are rendered, which is done in the Prometheus text exposition format.
+   *
+   *  Metrics are meant to be registered once (at construction time of the
+   *  component that updates them) and then updated through the returned reference.
+   *  Registering the same name and labels again returns the same metric.
+   */
+  class Metrics {
+
+    Metrics(Metrics const &) = delete;
+    Metrics &operator=(Metrics const &) = delete;
+
+    Metrics();
+
+  public:
+
+    enum {
+      // The number of per thread slots, threads beyond this share slots.
+      MAX_THREADS = 64,
+
+      CACHE_LINE_SIZE = 64,
+    };
+
+    /**
+     *  @return the slot index of the calling thread.
+     */
+    static size_t threadIndex()
+    {
+      static thread_local size_t t_index = nextThreadIndex();
+      return t_index;
+    }
+
+    /**
+     *  A monotonically increasing counter.
+     */
+    class Counter {
+
+      struct Slot {
+	std::atomic<uint64_t> value;
+	char padding[CACHE_LINE_SIZE - sizeof(std::atomic<uint64_t>)];
+      };
+
+      Slot d_slots[MAX_THREADS];
+
+    public:
+
+      Counter();
+
+      void add(uint64_t n = 1)
+      {
+	d_slots[threadIndex()].value.fetch_add(n, std::memory_order_relaxed);
+      }
+
+      /**
+       *  @return the sum over all threads.
+       */
+      uint64_t value() const;
+
+    };
+
+    /**
+     *  A value that can go up and down, for example the number of open connections.
+     */
+    class Gauge {
+
+      struct Slot {
+	std::atomic<int64_t> value;
+	char padding[CACHE_LINE_SIZE - sizeof(std::atomic<int64_t>)];
+      };
+
+      Slot d_slots[MAX_THREADS];
+
+    public:
+
+      Gauge();
+
+      void add(int64_t n = 1)
+      {
+	d_slots[threadIndex()].value.fetch_add(n, std::memory_order_relaxed);
+      }
+
+      void sub(int64_t n = 1)
+      {
+	d_slots[threadIndex()].value.fetch_sub(n, std::memory_order_relaxed);
+      }
+
+      /**
+       *  @return the sum over all threads.
+       */
+      int64_t value() const;
+
+    };
+
+    /**
+     *  A latency histogram with HDR style log-linear buckets.
+     *
+     *  Values are recorded in nanoseconds with a relative precision of about 3%
+     *  up to about 18 minutes, larger values are clamped. The bucket counts of a
+     *  thread are allocated the first time that thread records a value.
+     */
+    class Histogram {
+    public:
+
+      enum {
+	// The number of linear sub buckets per power of two.
+	SUB_BUCKET_BITS = 5,
+	SUB_BUCKET_COUNT = 1 << SUB_BUCKET_BITS,
+
+	// The largest power of two that is tracked.
+	MAX_MAGNITUDE = 40,
+
+	BUCKET_COUNT = (MAX_MAGNITUDE - SUB_BUCKET_BITS + 2) * SUB_BUCKET_COUNT,
+      };
+
+      /**
+       *  The aggregated counts of a histogram.
+       */
+      struct Snapshot {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[BUCKET_COUNT];
+
+	/**
+	 *  @param quantile the quantile, between 0 and 1.
+	 *  @return the upper bound of the bucket containing the quantile.
+	 */
+	uint64_t quantile(double quantile) const;
+      };
+
+      Histogram();
+
+      ~Histogram();
+
+      /**
+       *  Records a value in nanoseconds.
+       */
+      void record(uint64_t value)
+      {
+	Counts *counts = d_counts[threadIndex()].load(std::memory_order_acquire);
+
+	if (counts == NULL) {
+	  counts = allocateCounts();
+	}
+
+	counts->buckets[bucketIndex(value)].fetch_add(1, std::memory_order_relaxed);
+	counts->count.fetch_add(1, std::memory_order_relaxed);
+	counts->sum.fetch_add(value, std::memory_order_relaxed);
+
+	// Only the owning thread raises the max, unless threads share a slot.
+	uint64_t max = counts->max.load(std::memory_order_relaxed);
+	while (value > max && !counts->max.compare_exchange_weak(max, value, std::memory_order_relaxed));
+      }
+
+      /**
+       *  Sums the counts of all threads.
+       */
+      void snapshot(Snapshot &snapshot) const;
+
+      /**
+       *  @return the bucket a value falls in.
+       */
+      static size_t bucketIndex(uint64_t value)
+      {
+	if (value < SUB_BUCKET_COUNT) {
+	  return value;
+	}
+
+	size_t magnitude = 63 - __builtin_clzll(value);
+
+	if (magnitude > MAX_MAGNITUDE) {
+	  return BUCKET_COUNT - 1;
+	}
+
+	size_t shift = magnitude - SUB_BUCKET_BITS;
+	return (shift + 1) * SUB_BUCKET_COUNT + ((value >> shift) - SUB_BUCKET_COUNT);
+      }
+
+      /**
+       *  @return the largest value that falls in the bucket.
+       */
+      static uint64_t bucketUpperBound(size_t index);
+
+    private:
+
+      struct Counts {
+	std::atomic<uint64_t> buckets[BUCKET_COUNT];
+	std::atomic<uint64_t> count;
+	std::atomic<uint64_t> sum;
+	std::atomic<uint64_t> max;
+      };
+
+      Counts *allocateCounts();
+
+      std::atomic<Counts*> d_counts[MAX_THREADS];
+
+    };
+
+    /**
+     *  The unit of the values recorded in a histogram.
+     */
+    enum Unit {
+      // Durations in nanoseconds, rendered in seconds (microseconds in the table).
+      UNIT_NANOSECONDS,
+
+      // Dimensionless values such as counts, rendered as is.
+      UNIT_NONE,
+    };
+
+    static Metrics &instance();
+
+    ~Metrics();
+
+    /**
+     *  Registers a counter.
+     *
+     *  @param name the metric name, for example "plain_http_accepts_total".
+     *  @param help the help text.
+     *  @param labels the Prometheus label set without braces, for example "state=\"reading\"".
+     */
+    Counter &counter(std::string const &name, std::string const &help, std::string const &labels = "");
+
+    /**
+     *  Registers a gauge.
+     *
+     *  @param name the metric name.
+     *  @param help the help text.
+     *  @param labels the Prometheus label set without braces.
+     */
+    Gauge &gauge(std::string const &name, std::string const &help, std::string const &labels = "");
+
+    /**
+     *  Registers a histogram, it is rendered as a summary.
+     *
+     *  @param name the metric name, for example "plain_http_phase_seconds".
+     *  @param help the help text.
+     *  @param labels the Prometheus label set without braces.
+     *  @param unit the unit of the recorded values.
+     */
+    Histogram &histogram(std::string const &name, std::string const &help, std::string const &labels = "", Unit unit = UNIT_NANOSECONDS);
+
+    /**
+     *  Renders all metrics in the Prometheus text exposition format.
+     *
+     *  @param out the string to append to.
+     */
+    void render(std::string &out) const;
+
+    /**
+     *  Renders a human readable percentile table of all histograms.
+     *
+     *  @param out the string to append to.
+     */
+    void renderHistograms(std::string &out) const;
+
+  private:
+
+    static size_t nextThreadIndex();
+
+    struct Internal;
+    std::unique_ptr<Internal> d;
+
+  };
+
+}
+
+#endif // __INC_PLAIN_METRICS_H__
@@ -0,0 +1,101 @@
+#ifndef __INC_PLAIN_MPSCQUEUE_H__
+#define __INC_PLAIN_MPSCQUEUE_H__
+
+#include <atomic>
+#include <utility>
+
+namespace plain {
+
+  /**
+   *  A lock free multiple producer, single consumer queue.
+   *
+   *  A linked list of heap nodes with a stub node (Vyukov). Producers only
+   *  exchange the head pointer, so a push never waits for other threads. A
+   *  push that is interrupted between the exchange and linking the node hides
+   *  the nodes after it from the consumer until it completes, pop() then
+   *  returns false although the queue is not empty.
+   *
+   *  @param T the value type, it should be default constructible and movable.
+   */
+  template <class T>
+  class MpscQueue {
+
+    struct Node {
+      std::atomic<Node*> next;
+      T value;
+
+      Node()
+	: next(NULL)
+      {
+      }
+
+      Node(T &&v)
+	: next(NULL), value(std::move(v))
+      {
+      }
+    };
+
+    // The last pushed node, written by the producers.
+    std::atomic<Node*> d_head;
+
+    // The stub, its next node holds the front value. Only used by the consumer.
+    Node *d_tail;
+
+    MpscQueue(MpscQueue const &) = delete;
+    MpscQueue &operator=(MpscQueue const &) = delete;
+
+  public:
+
+    MpscQueue()
+      : d_head(new Node), d_tail(d_head.load(std::memory_order_relaxed))
+    {
+    }
+
+    /**
+     *  Destroys the values that were not popped.
+     */
+    ~MpscQueue()
+    {
+      T value;
+      while (pop(value)) {
+      }
+
+      delete d_tail;
+    }
+
+    /**
+     *  Push a value to the back (any thread).
+     */
+    void push(T value)
+    {
+      Node *node = new Node(std::move(value));
+      Node *prev = d_head.exchange(node, std::memory_order_acq_rel);
+      prev->next.store(node, std::memory_order_release);
+    }
+
+    /**
+     *  Pop the front value (consumer thread).
+     *
+     *  @return false when there is no value.
+     */
+    bool pop(T &value)
+    {
+      Node *next = d_tail->next.load(std::memory_order_acquire);
+
+      if (next == NULL) {
+	return false;
+      }
+
+      // The next node becomes the stub.
+      value = std::move(next->value);
+      delete d_tail;
+      d_tail = next;
+
+      return true;
+    }
+
+  };
+
+}
+
+#endif // __INC_PLAIN_MPSCQUEUE_H__
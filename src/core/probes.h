@@ -0,0 +1,57 @@
+#ifndef __INC_PLAIN_PROBES_H__
+#define __INC_PLAIN_PROBES_H__
+
+/*
+ *  USDT (user level statically defined tracing) probes.
+ *
+ *  When <sys/sdt.h> (systemtap-sdt-dev) is available the probes compile to a
+ *  single nop plus a note in the ELF file, which bpftrace and perf can attach to
+ *  at runtime, for example:
+ *
+ *    bpftrace -e 'usdt:./plain:plain:splice { @[arg2 > 0] = count(); }'
+ *
+ *  Without <sys/sdt.h>, or when PLAIN_NO_PROBES is defined, the probes compile
+ *  to nothing and their arguments are not evaluated, so arguments should not
+ *  have side effects.
+ *
+ *  Probes (provider "plain"):
+ *
+ *    accept(fd, address)                         a connection was accepted.
+ *    header_parsed(fd, method, uri, uriLength)   a request header was parsed.
+ *    response_start(fd, status, contentLength)   a handler started a response.
+ *    response_end(fd, status, bytesSent)         a response was completely sent.
+ *    splice(fd, sourceFd, result, errno)         a splice call returned.
+ *    sendfile(fd, sourceFd, result, errno)       a sendfile call returned.
+ *    poll_add(fd, events)                        a descriptor was added to the poll system.
+ *    poll_modify(fd, events)                     a descriptor registration was modified.
+ *    poll_remove(fd)                             a descriptor was removed from the poll system.
+ *    sched_enqueue(schedulable, added)           a schedulable was (re)scheduled.
+ *    sched_dequeue(schedulable)                  a schedulable was taken from the run queue.
+ */
+
+#if !defined(PLAIN_NO_PROBES) && defined(__has_include)
+#  if __has_include(<sys/sdt.h>)
+#    include <sys/sdt.h>
+#    define PLAIN_HAVE_PROBES 1
+#  endif
+#endif
+
+#ifdef PLAIN_HAVE_PROBES
+
+#define PLAIN_PROBE0(name) DTRACE_PROBE(plain, name)
+#define PLAIN_PROBE1(name, a1) DTRACE_PROBE1(plain, name, a1)
+#define PLAIN_PROBE2(name, a1, a2) DTRACE_PROBE2(plain, name, a1, a2)
+#define PLAIN_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(plain, name, a1, a2, a3)
+#define PLAIN_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(plain, name, a1, a2, a3, a4)
+
+#else
+
+#define PLAIN_PROBE0(name) do {} while (0)
+#define PLAIN_PROBE1(name, a1) do {} while (0)
+#define PLAIN_PROBE2(name, a1, a2) do {} while (0)
+#define PLAIN_PROBE3(name, a1, a2, a3) do {} while (0)
+#define PLAIN_PROBE4(name, a1, a2, a3, a4) do {} while (0)
+
+#endif
+
+#endif // __INC_PLAIN_PROBES_H__
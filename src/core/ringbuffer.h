@@ -0,0 +1,110 @@
+#ifndef __INC_PLAIN_RINGBUFFER_H__
+#define __INC_PLAIN_RINGBUFFER_H__
+
+#include <atomic>
+#include <cstddef>
+
+namespace plain {
+
+  /**
+   *  A lock free single producer, single consumer ring buffer.
+   *
+   *  The producer reserves a slot, fills it in place and commits it. The consumer
+   *  peeks at the front slot, processes it in place and pops it. This way no
+   *  copies are made of the (possibly large) slots.
+   *
+   *  @param T the slot type.
+   *  @param N the number of slots, should be a power of two.
+   */
+  template <class T, size_t N>
+  class RingBuffer {
+
+    static_assert((N & (N - 1)) == 0, "ring buffer size should be a power of two");
+
+    enum {
+      CACHE_LINE_SIZE = 64,
+    };
+
+    // The consumer position, only written by the consumer.
+    std::atomic<size_t> d_head;
+    char d_headPadding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+
+    // The producer position, only written by the producer.
+    std::atomic<size_t> d_tail;
+    char d_tailPadding[CACHE_LINE_SIZE - sizeof(std::atomic<size_t>)];
+
+    T d_slots[N];
+
+  public:
+
+    RingBuffer()
+      : d_head(0), d_tail(0)
+    {
+    }
+
+    /**
+     *  Reserve the next slot for writing (producer side).
+     *
+     *  @return the slot or NULL when the buffer is full.
+     */
+    T *reserve()
+    {
+      size_t tail = d_tail.load(std::memory_order_relaxed);
+
+      if (tail - d_head.load(std::memory_order_acquire) == N) {
+	return NULL;
+      }
+
+      return d_slots + (tail & (N - 1));
+    }
+
+    /**
+     *  Publish the slot returned by reserve() to the consumer (producer side).
+     */
+    void commit()
+    {
+      d_tail.store(d_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     *  Get the oldest slot (consumer side).
+     *
+     *  @return the slot or NULL when the buffer is empty.
+     */
+    T *front()
+    {
+      size_t head = d_head.load(std::memory_order_relaxed);
+
+      if (head == d_tail.load(std::memory_order_acquire)) {
+	return NULL;
+      }
+
+      return d_slots + (head & (N - 1));
+    }
+
+    /**
+     *  Release the slot returned by front() back to the producer (consumer side).
+     */
+    void pop()
+    {
+      d_head.store(d_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    /**
+     *  @return the number of slots in use, only approximate when called concurrently.
+     */
+    size_t size() const
+    {
+      return d_tail.load(std::memory_order_acquire) - d_head.load(std::memory_order_acquire);
+    }
+
+    /**
+     *  @return the number of slots.
+     */
+    static constexpr size_t capacity() { return N; }
+
+  };
+
+}
+
+#endif // __INC_PLAIN_RINGBUFFER_H__
@@ -0,0 +1,237 @@
+#ifndef __INC_PLAIN_TASK_H__
+#define __INC_PLAIN_TASK_H__
+
+#include "core/framepool.h"
+#include "core/log.h"
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace plain {
+
+  template <class T = void>
+  class Task;
+
+  namespace detail {
+
+    /*
+     *  The promise part that does not depend on the result type.
+     */
+    struct TaskPromiseBase {
+
+      // Resumed when the task finishes, set by the awaiting task.
+      std::coroutine_handle<> continuation;
+
+      // A detached task destroys its own frame when it finishes.
+      bool detached = false;
+
+      std::exception_ptr exception;
+
+      // Resumes the awaiting task, or destroys a detached one.
+      struct FinalAwaiter {
+	bool await_ready() const noexcept { return false; }
+
+	template <class Promise>
+	std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+	{
+	  TaskPromiseBase &promise = handle.promise();
+
+	  if (promise.continuation) {
+	    return promise.continuation;
+	  }
+
+	  if (promise.detached) {
+	    handle.destroy();
+	  }
+
+	  return std::noop_coroutine();
+	}
+
+	void await_resume() const noexcept {}
+      };
+
+      static void *operator new(size_t size)
+      {
+	return FramePool::allocate(size);
+      }
+
+      static void operator delete(void *frame, size_t size)
+      {
+	FramePool::deallocate(frame, size);
+      }
+
+      // Tasks start when they are awaited or detached.
+      std::suspend_always initial_suspend() const noexcept { return {}; }
+
+      FinalAwaiter final_suspend() const noexcept { return {}; }
+
+      void unhandled_exception()
+      {
+	exception = std::current_exception();
+
+	// Nobody awaits a detached task and nothing on the loop catches, so the
+	// error is logged and the frame is destroyed at the final suspend.
+	if (detached) {
+	  try {
+	    throw;
+	  } catch (std::exception const &e) {
+	    LOG_ERROR("A detached task failed: %s.", e.what());
+	  } catch (...) {
+	    LOG_ERROR("A detached task failed.");
+	  }
+	}
+      }
+
+    };
+
+    template <class T>
+    struct TaskPromise : TaskPromiseBase {
+      std::optional<T> value;
+
+      Task<T> get_return_object();
+
+      template <class U>
+      void return_value(U &&result)
+      {
+	value.emplace(std::forward<U>(result));
+      }
+
+      T result()
+      {
+	if (exception) {
+	  std::rethrow_exception(exception);
+	}
+
+	return std::move(*value);
+      }
+    };
+
+    template <>
+    struct TaskPromise<void> : TaskPromiseBase {
+      Task<void> get_return_object();
+
+      void return_void() {}
+
+      void result()
+      {
+	if (exception) {
+	  std::rethrow_exception(exception);
+	}
+      }
+    };
+
+  }
+
+  /**
+   *  A coroutine that runs on a poll loop, it can co_await the awaitables of
+   *  io/awaitables.h and other tasks.
+   *
+   *  A task starts when it is awaited, the awaiting coroutine continues when
+   *  the task finishes and gets its result or exception. A task that is not
+   *  awaited can be detached, it then runs until it finishes on its own and
+   *  an exception it ends with is logged. The frames come from the FramePool.
+   */
+  template <class T>
+  class Task {
+  public:
+
+    typedef detail::TaskPromise<T> promise_type;
+
+    Task() {}
+
+    explicit Task(std::coroutine_handle<promise_type> handle)
+      : d_handle(handle)
+    {
+    }
+
+    Task(Task &&other) noexcept
+      : d_handle(std::exchange(other.d_handle, nullptr))
+    {
+    }
+
+    Task &operator=(Task &&other) noexcept
+    {
+      if (this != &other) {
+	if (d_handle) {
+	  d_handle.destroy();
+	}
+
+	d_handle = std::exchange(other.d_handle, nullptr);
+      }
+
+      return *this;
+    }
+
+    Task(Task const &) = delete;
+    Task &operator=(Task const &) = delete;
+
+    ~Task()
+    {
+      if (d_handle) {
+	d_handle.destroy();
+      }
+    }
+
+    /**
+     *  Starts the task and lets it finish on its own, the task object is
+     *  empty afterwards.
+     */
+    void detach()
+    {
+      std::coroutine_handle<promise_type> handle = std::exchange(d_handle, nullptr);
+
+      if (handle) {
+	handle.promise().detached = true;
+	handle.resume();
+      }
+    }
+
+    /**
+     *  @return true when the task finished.
+     */
+    bool done() const { return !d_handle || d_handle.done(); }
+
+    struct Awaiter {
+      std::coroutine_handle<promise_type> handle;
+
+      bool await_ready() const noexcept { return !handle || handle.done(); }
+
+      std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+      {
+	handle.promise().continuation = awaiting;
+	return handle;
+      }
+
+      T await_resume()
+      {
+	return handle.promise().result();
+      }
+    };
+
+    Awaiter operator co_await() && noexcept
+    {
+      return Awaiter{d_handle};
+    }
+
+  private:
+
+    std::coroutine_handle<promise_type> d_handle;
+
+  };
+
+  template <class T>
+  Task<T> detail::TaskPromise<T>::get_return_object()
+  {
+    return Task<T>(std::coroutine_handle<TaskPromise<T>>::from_promise(*this));
+  }
+
+  inline Task<void> detail::TaskPromise<void>::get_return_object()
+  {
+    return Task<void>(std::coroutine_handle<TaskPromise<void>>::from_promise(*this));
+  }
+
+}
+
+#endif // __INC_PLAIN_TASK_H__
@@ -0,0 +1,222 @@
+#include "trace.h"
+
+#include "exceptions/errnoexception.h"
+
+#include <mutex>
+#include <vector>
+#include <memory>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <cxxabi.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+using namespace plain;
+
+std::atomic<bool> Trace::s_enabled(false);
+
+namespace {
+
+  enum {
+    // The number of events kept per thread, should be a power of two.
+    RING_SIZE = 1 << 16,
+  };
+
+  struct Event {
+    uint64_t start;
+    uint64_t duration;
+    void const *symbol;
+    int32_t fd;
+    uint32_t value;
+    uint32_t type;
+  };
+
+  // The flight recorder of a single thread, only written by that thread.
+  struct Ring {
+    pid_t tid;
+    uint64_t count;
+    Event events[RING_SIZE];
+  };
+
+  struct Rings {
+    std::mutex mutex;
+
+    // A ring is never freed, so it outlives its thread.
+    std::vector<std::unique_ptr<Ring>> rings;
+
+    static Rings &instance()
+    {
+      static Rings s_instance;
+      return s_instance;
+    }
+  };
+
+  Ring *threadRing()
+  {
+    static thread_local Ring *t_ring = NULL;
+
+    if (t_ring == NULL) {
+      std::unique_ptr<Ring> ring(new Ring);
+      ring->tid = syscall(SYS_gettid);
+      ring->count = 0;
+      t_ring = ring.get();
+
+      Rings &rings = Rings::instance();
+      std::lock_guard<std::mutex> lk(rings.mutex);
+      rings.rings.push_back(std::move(ring));
+    }
+
+    return t_ring;
+  }
+
+  // Resolves a function pointer to a (demangled) symbol name.
+  std::string symbolName(void const *symbol)
+  {
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "%p", symbol);
+
+    Dl_info info;
+    if (symbol == NULL || dladdr(symbol, &info) == 0 || info.dli_sname == NULL) {
+      return buffer;
+    }
+
+    int status = 0;
+    char *demangled = abi::__cxa_demangle(info.dli_sname, NULL, NULL, &status);
+
+    std::string name = (status == 0 && demangled != NULL) ? demangled : info.dli_sname;
+    free(demangled);
+
+    return name;
+  }
+
+  // Escapes a string for use in a JSON string literal.
+  std::string escape(std::string const &str)
+  {
+    std::string res;
+
+    for (char c : str) {
+      if (c == '"' || c == '\\') {
+	res += '\\';
+      }
+      res += c;
+    }
+
+    return res;
+  }
+
+  char const *eventName(uint32_t type)
+  {
+    switch (type) {
+    case Trace::EVENT_WAIT: return "epoll_pwait";
+    case Trace::EVENT_CALLBACK: return "callback";
+    case Trace::EVENT_RUN: return "run";
+    case Trace::EVENT_TIMEOUT: return "timeout";
+    default: return "?";
+    };
+  }
+
+  char const *eventCategory(uint32_t type)
+  {
+    return type == Trace::EVENT_RUN ? "scheduler" : "poll";
+  }
+
+}
+
+void Trace::setEnabled(bool enabled)
+{
+  s_enabled = enabled;
+}
+
+uint64_t Trace::now()
+{
+  timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return static_cast<uint64_t>(t.tv_sec) * 1000000000 + t.tv_nsec;
+}
+
+void Trace::record(EventType type, uint64_t start, uint64_t duration, int fd, void const *symbol, uint32_t value)
+{
+  Ring *ring = threadRing();
+
+  Event &event = ring->events[ring->count & (RING_SIZE - 1)];
+  event.start = start;
+  event.duration = duration;
+  event.symbol = symbol;
+  event.fd = fd;
+  event.value = value;
+  event.type = type;
+
+  ++ring->count;
+}
+
+void Trace::dump(std::string const &path)
+{
+  FILE *file = fopen(path.c_str(), "w");
+
+  if (file == NULL) {
+    throw ErrnoException(errno);
+  }
+
+  Rings &rings = Rings::instance();
+  std::lock_guard<std::mutex> lk(rings.mutex);
+
+  pid_t pid = getpid();
+  bool first = true;
+
+  fprintf(file, "{\"traceEvents\":[\n");
+
+  for (auto const &ring : rings.rings) {
+
+    fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"loop %d\"}}",
+	    first ? "" : ",\n", pid, ring->tid, ring->tid);
+    first = false;
+
+    // Only the last RING_SIZE events are still in the ring.
+    uint64_t begin = ring->count > RING_SIZE ? ring->count - RING_SIZE : 0;
+
+    for (uint64_t i = begin; i != ring->count; ++i) {
+      Event const &event = ring->events[i & (RING_SIZE - 1)];
+
+      fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,",
+	      eventName(event.type), eventCategory(event.type), pid, ring->tid, event.start * 1e-3);
+
+      if (event.type == EVENT_TIMEOUT) {
+	fprintf(file, "\"ph\":\"i\",\"s\":\"t\",");
+      } else {
+	fprintf(file, "\"ph\":\"X\",\"dur\":%.3f,", event.duration * 1e-3);
+      }
+
+      fprintf(file, "\"args\":{");
+
+      switch (event.type) {
+      case EVENT_WAIT:
+	fprintf(file, "\"events\":%u", event.value);
+	break;
+
+      case EVENT_CALLBACK:
+	fprintf(file, "\"fd\":%d,\"callback\":\"%s\",\"result\":%u",
+		event.fd, escape(symbolName(event.symbol)).c_str(), event.value);
+	break;
+
+      case EVENT_RUN:
+	fprintf(file, "\"callback\":\"%s\"", escape(symbolName(event.symbol)).c_str());
+	break;
+
+      case EVENT_TIMEOUT:
+	fprintf(file, "\"fd\":%d", event.fd);
+	break;
+      };
+
+      fprintf(file, "}}");
+    }
+  }
+
+  fprintf(file, "\n]}\n");
+
+  if (fclose(file) != 0) {
+    throw ErrnoException(errno);
+  }
+}
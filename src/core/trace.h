@@ -0,0 +1,89 @@
+#ifndef __INC_PLAIN_TRACE_H__
+#define __INC_PLAIN_TRACE_H__
+
+#include <string>
+#include <atomic>
+
+#include <stdint.h>
+
+namespace plain {
+
+  /**
+   *  Opt-in event loop trace recorder.
+   *
+   *  When enabled, the event loop records what it is doing (waiting for events,
+   *  running callbacks, popping timeouts) into a per thread flight recorder ring
+   *  buffer, which only keeps the most recent events. The rings can be dumped in
+   *  the Chrome trace event format, which can be loaded in chrome://tracing or
+   *  Perfetto.
+   *
+   *  Recording is guarded by enabled(), which is a single relaxed load, so the
+   *  cost is negligible when tracing is disabled.
+   *
+   *  Main::run enables tracing when the PLAIN_TRACE environment variable is set
+   *  and dumps the trace to the file it names when the main loop exits.
+   */
+  class Trace {
+  public:
+
+    enum EventType {
+      // An epoll wait, value is the number of events returned.
+      EVENT_WAIT = 0,
+
+      // An event callback, value is the EventResultMask it completed with.
+      EVENT_CALLBACK = 1,
+
+      // A scheduler run of a schedulable.
+      EVENT_RUN = 2,
+
+      // A file descriptor timeout was popped from the timeout list.
+      EVENT_TIMEOUT = 3,
+    };
+
+    /**
+     *  @return true when recording is enabled.
+     */
+    static bool enabled() { return s_enabled.load(std::memory_order_relaxed); }
+
+    /**
+     *  Enables or disables recording.
+     */
+    static void setEnabled(bool enabled);
+
+    /**
+     *  @return the current time in nanoseconds, on the same clock as the recorded events.
+     */
+    static uint64_t now();
+
+    /**
+     *  Records an event in the ring of the calling thread.
+     *
+     *  @param type the event type.
+     *  @param start the start time as returned by now().
+     *  @param duration the duration in nanoseconds, zero for instant events.
+     *  @param fd the file descriptor involved or -1.
+     *  @param symbol the callback function involved, resolved to a symbol name when dumping.
+     *  @param value the event type specific value.
+     */
+    static void record(EventType type, uint64_t start, uint64_t duration, int fd, void const *symbol, uint32_t value);
+
+    /**
+     *  Writes the recorded events of all threads in the Chrome trace event format.
+     *
+     *  This should be called when the recording threads are idle (for example after
+     *  the main loop exited), events recorded during the dump might be garbled.
+     *
+     *  @param path the file to write to.
+     *  @throw ErrnoException when the file can not be written.
+     */
+    static void dump(std::string const &path);
+
+  private:
+
+    static std::atomic<bool> s_enabled;
+
+  };
+
+}
+
+#endif // __INC_PLAIN_TRACE_H__
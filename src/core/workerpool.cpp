@@ -0,0 +1,259 @@
+#include "core/workerpool.h"
+#include "core/main.h"
+#include "core/metrics.h"
+#include "io/poll.h"
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+using namespace plain;
+
+struct WorkerPool::Internal {
+
+  // A submitted job.
+  struct Job {
+    std::function<void()> work;
+    std::function<void()> done;
+    Poll *poll;
+    std::chrono::steady_clock::time_point submitted;
+  };
+
+  // The queue of a worker, the worker takes from the front and thieves from the back.
+  struct Queue {
+    std::mutex mutex;
+    std::deque<Job> jobs;
+
+    Metrics::Gauge &lengthMetric;
+    Metrics::Counter &submittedMetric;
+    Metrics::Counter &stolenMetric;
+    Metrics::Counter &fullMetric;
+
+    Queue(std::string const &labels)
+      : lengthMetric(Metrics::instance().gauge("plain_worker_queue_length", "Number of jobs waiting in a worker queue.", labels)),
+	submittedMetric(Metrics::instance().counter("plain_worker_submitted_total", "Number of jobs queued on a worker queue.", labels)),
+	stolenMetric(Metrics::instance().counter("plain_worker_stolen_total", "Number of jobs stolen from a worker queue by another worker.", labels)),
+	fullMetric(Metrics::instance().counter("plain_worker_queue_full_total", "Number of submits that found a worker queue full.", labels))
+    {
+    }
+  };
+
+  size_t d_queueCapacity;
+
+  std::vector<std::unique_ptr<Queue>> d_queues;
+  std::vector<std::thread> d_threads;
+
+  // Spreads submits from outside the pool over the queues.
+  std::atomic<size_t> d_next;
+
+  // The number of queued jobs, idle workers wait for it under the mutex.
+  std::mutex d_mutex;
+  std::condition_variable d_idle;
+  std::atomic<size_t> d_pending;
+  bool d_stopping;
+
+  Metrics::Counter &d_rejectedMetric;
+  Metrics::Histogram &d_queueWaitMetric;
+  Metrics::Histogram &d_runMetric;
+
+  // The pool and queue of the current worker thread.
+  static thread_local Internal *t_pool;
+  static thread_local size_t t_queue;
+
+  Internal(size_t threads, size_t queueCapacity, std::string const &name)
+    : d_queueCapacity(queueCapacity),
+      d_next(0),
+      d_pending(0),
+      d_stopping(false),
+      d_rejectedMetric(Metrics::instance().counter("plain_worker_rejected_total", "Number of jobs rejected because all worker queues were full.", "pool=\"" + name + "\"")),
+      d_queueWaitMetric(Metrics::instance().histogram("plain_worker_queue_wait_seconds", "Time jobs wait in a worker queue before they run.", "pool=\"" + name + "\"")),
+      d_runMetric(Metrics::instance().histogram("plain_worker_run_seconds", "Time jobs run on a worker.", "pool=\"" + name + "\""))
+  {
+    if (threads == 0) {
+      threads = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+      d_queues.emplace_back(new Queue("pool=\"" + name + "\",queue=\"" + std::to_string(i) + "\""));
+    }
+
+    for (size_t i = 0; i < threads; ++i) {
+      d_threads.emplace_back(&Internal::run, this, i);
+    }
+  }
+
+  ~Internal()
+  {
+    {
+      std::lock_guard<std::mutex> lk(d_mutex);
+      d_stopping = true;
+    }
+
+    d_idle.notify_all();
+
+    for (std::thread &thread : d_threads) {
+      thread.join();
+    }
+
+    // Drop the jobs that did not start.
+    for (std::unique_ptr<Queue> &queue : d_queues) {
+      queue->lengthMetric.sub(queue->jobs.size());
+    }
+  }
+
+  bool submit(Job &job)
+  {
+    size_t count = d_queues.size();
+
+    // A worker queues on its own queue, which it runs next.
+    size_t first = t_pool == this ? t_queue : d_next.fetch_add(1, std::memory_order_relaxed) % count;
+
+    for (size_t i = 0; i < count; ++i) {
+      Queue &queue = *d_queues[(first + i) % count];
+
+      std::unique_lock<std::mutex> qlk(queue.mutex);
+
+      if (queue.jobs.size() >= d_queueCapacity) {
+	qlk.unlock();
+	queue.fullMetric.add();
+	continue;
+      }
+
+      job.submitted = std::chrono::steady_clock::now();
+      queue.jobs.push_back(std::move(job));
+
+      // Count the job before a worker can take it.
+      {
+	std::lock_guard<std::mutex> lk(d_mutex);
+	++d_pending;
+      }
+
+      qlk.unlock();
+
+      queue.submittedMetric.add();
+      queue.lengthMetric.add();
+
+      d_idle.notify_one();
+      return true;
+    }
+
+    d_rejectedMetric.add();
+    return false;
+  }
+
+  // Takes a job from the queue of the worker, or else steals one.
+  bool take(size_t index, Job &job)
+  {
+    size_t count = d_queues.size();
+
+    for (size_t i = 0; i < count; ++i) {
+      Queue &queue = *d_queues[(index + i) % count];
+
+      std::unique_lock<std::mutex> qlk(queue.mutex);
+
+      if (queue.jobs.empty()) {
+	continue;
+      }
+
+      if (i == 0) {
+	job = std::move(queue.jobs.front());
+	queue.jobs.pop_front();
+      } else {
+	job = std::move(queue.jobs.back());
+	queue.jobs.pop_back();
+      }
+
+      --d_pending;
+      qlk.unlock();
+
+      if (i != 0) {
+	queue.stolenMetric.add();
+      }
+
+      queue.lengthMetric.sub();
+      return true;
+    }
+
+    return false;
+  }
+
+  // The worker thread.
+  void run(size_t index)
+  {
+    t_pool = this;
+    t_queue = index;
+
+    Job job;
+
+    while (true) {
+      if (!take(index, job)) {
+	std::unique_lock<std::mutex> lk(d_mutex);
+
+	d_idle.wait(lk, [this]() { return d_pending.load() != 0 || d_stopping; });
+
+	if (d_stopping) {
+	  return;
+	}
+
+	continue;
+      }
+
+      std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+      d_queueWaitMetric.record(std::chrono::duration_cast<std::chrono::nanoseconds>(start - job.submitted).count());
+
+      job.work();
+
+      d_runMetric.record(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+
+      // Hand the result back to the loop the job came from.
+      if (job.done) {
+	job.poll->post(std::move(job.done));
+      }
+
+      job = Job();
+    }
+  }
+
+};
+
+thread_local WorkerPool::Internal *WorkerPool::Internal::t_pool = NULL;
+thread_local size_t WorkerPool::Internal::t_queue = 0;
+
+WorkerPool::WorkerPool(size_t threads, size_t queueCapacity, std::string const &name)
+  : d(new Internal(threads, queueCapacity, name))
+{
+}
+
+WorkerPool::~WorkerPool()
+{
+}
+
+bool WorkerPool::submit(std::function<void()> work, std::function<void()> done, Poll &poll)
+{
+  Internal::Job job;
+  job.work = std::move(work);
+  job.done = std::move(done);
+  job.poll = &poll;
+
+  return d->submit(job);
+}
+
+bool WorkerPool::submit(std::function<void()> work, std::function<void()> done)
+{
+  return submit(std::move(work), std::move(done), Main::instance().poll());
+}
+
+size_t WorkerPool::size() const
+{
+  return d->d_threads.size();
+}
+
+size_t WorkerPool::pending() const
+{
+  return d->d_pending.load();
+}
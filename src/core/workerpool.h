@@ -0,0 +1,86 @@
+#ifndef __INC_PLAIN_WORKERPOOL_H__
+#define __INC_PLAIN_WORKERPOOL_H__
+
+#include <memory>
+#include <string>
+#include <functional>
+
+#include <stddef.h>
+
+namespace plain {
+
+  // Forward declaration.
+  class Poll;
+
+  /**
+   *  A bounded pool of worker threads for blocking or CPU heavy work, so it
+   *  does not hold up the poll loop.
+   *
+   *  Every worker has its own queue. Submits from outside the pool are spread
+   *  over the queues round-robin, submits from a worker go to its own queue.
+   *  A worker runs its own queue in order, an idle worker steals the most
+   *  recently queued job of another worker, which is the one that would wait
+   *  longest there. The result callback of a job runs on the loop the job
+   *  was submitted for.
+   *
+   *  The metrics are labeled with the pool name and the queue, a queue that
+   *  is often full or often stolen from shows where the back-pressure is.
+   */
+  class WorkerPool {
+  public:
+
+    enum {
+      // The default number of jobs a worker queue holds.
+      DEFAULT_QUEUE_CAPACITY = 1024,
+    };
+
+    /**
+     *  @param threads the number of worker threads, 0 uses one per core.
+     *  @param queueCapacity the number of jobs a worker queue holds.
+     *  @param name the name of the pool in the metrics.
+     */
+    WorkerPool(size_t threads = 0, size_t queueCapacity = DEFAULT_QUEUE_CAPACITY, std::string const &name = "default");
+
+    /**
+     *  Stops and joins the workers, jobs that did not start are dropped
+     *  without calling their result callback.
+     */
+    ~WorkerPool();
+
+    /**
+     *  Submits a job, this can be called from any thread.
+     *
+     *  Note: the work should not throw.
+     *
+     *  @param work runs on a worker thread.
+     *  @param done runs on the loop thread of poll after the work, it can be empty.
+     *  @param poll the loop to hand the result back to.
+     *  @return false when all queues are full, the job is not run.
+     */
+    bool submit(std::function<void()> work, std::function<void()> done, Poll &poll);
+
+    /**
+     *  Submits a job with the result handed back to the main loop.
+     */
+    bool submit(std::function<void()> work, std::function<void()> done);
+
+    /**
+     *  @return the number of worker threads.
+     */
+    size_t size() const;
+
+    /**
+     *  @return the number of jobs that are queued and not started.
+     */
+    size_t pending() const;
+
+  private:
+
+    struct Internal;
+    std::unique_ptr<Internal> d;
+
+  };
+
+}
+
+#endif // __INC_PLAIN_WORKERPOOL_H__
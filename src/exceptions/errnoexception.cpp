@@ -1,17 +1,16 @@
 
 #include "errnoexception.h"
+#include "core/log.h"
 
 #include <string.h>
 
-#include <iostream>
-
 using namespace plain;
 
 std::string _errorString(int errnum)
 {
   char buf[256] = {}; // initializes to zeros.
   char *res = strerror_r(errnum, buf, 255);
-  std::cout << "Throwing error: " << errnum << ": " << res << ".\n";
+  LOG_DEBUG("Throwing error: %d: %s.", errnum, res);
   return res;
 }
 
@@ -0,0 +1,177 @@
+#include "io/awaitables.h"
+#include "core/main.h"
+#include "core/workerpool.h"
+#include "exceptions/errnoexception.h"
+
+#include <sys/timerfd.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+
+using namespace plain;
+
+AsyncOperation::AsyncOperation(Poll &poll, int fd, Type type, void *buffer, int other, size_t length)
+  : d_poll(poll),
+    d_fd(fd),
+    d_type(type),
+    d_buffer(buffer),
+    d_other(other),
+    d_length(length),
+    d_result(0)
+{
+}
+
+bool AsyncOperation::attempt()
+{
+  ssize_t ret = -1;
+
+  switch (d_type) {
+  case OPERATION_READ:
+    ret = ::read(d_fd, d_buffer, d_length);
+    break;
+  case OPERATION_WRITE:
+    ret = ::write(d_fd, d_buffer, d_length);
+    break;
+  case OPERATION_SPLICE_TO:
+    ret = splice(d_fd, NULL, d_other, NULL, d_length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    break;
+  case OPERATION_SPLICE_FROM:
+    ret = splice(d_other, NULL, d_fd, NULL, d_length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    break;
+  }
+
+  if (ret == -1) {
+    if (errno == EAGAIN) {
+      return false;
+    }
+
+    d_result = -errno;
+  } else {
+    d_result = ret;
+  }
+
+  return true;
+}
+
+bool AsyncOperation::await_ready()
+{
+  return attempt();
+}
+
+void AsyncOperation::await_suspend(std::coroutine_handle<> handle)
+{
+  d_handle = handle;
+
+  uint32_t events = d_type == OPERATION_WRITE || d_type == OPERATION_SPLICE_FROM ? Poll::OUT : Poll::IN;
+
+  // Readiness that was already seen schedules the retry right away.
+  d_poll.modify(d_fd, events | Poll::TIMEOUT, _onEvent, this);
+}
+
+void AsyncOperation::_onEvent(int fd, uint32_t events, void *data, Poll::AsyncResult &asyncResult)
+{
+  AsyncOperation *operation = reinterpret_cast<AsyncOperation*>(data);
+
+  if (events & Poll::TIMEOUT) {
+    operation->d_result = -ETIMEDOUT;
+  } else if (!operation->attempt()) {
+    // Still not ready, wait for the next edge.
+    asyncResult.completed(operation->d_type == OPERATION_WRITE || operation->d_type == OPERATION_SPLICE_FROM ?
+			  Poll::WRITE_COMPLETED : Poll::READ_COMPLETED);
+    return;
+  }
+
+  // Stop polling until the next operation, the events that are left stay recorded.
+  operation->d_poll.modify(fd, 0);
+  asyncResult.completed(Poll::NONE_COMPLETED);
+
+  operation->d_handle.resume();
+}
+
+AsyncDescriptor::AsyncDescriptor(Poll &poll, int fd)
+  : d_poll(poll),
+    d_fd(fd)
+{
+  d_poll.add(fd, 0, NULL, NULL);
+}
+
+AsyncDescriptor::~AsyncDescriptor()
+{
+  d_poll.close(d_fd);
+}
+
+SleepOperation::SleepOperation(Poll &poll, std::chrono::nanoseconds duration)
+  : d_poll(poll),
+    d_duration(duration)
+{
+}
+
+void SleepOperation::await_suspend(std::coroutine_handle<> handle)
+{
+  int fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+
+  if (fd == -1) {
+    throw ErrnoException(errno);
+  }
+
+  itimerspec spec = {};
+  spec.it_value.tv_sec = d_duration.count() / 1000000000;
+  spec.it_value.tv_nsec = d_duration.count() % 1000000000;
+
+  if (timerfd_settime(fd, 0, &spec, NULL) == -1) {
+    int error = errno;
+    ::close(fd);
+    throw ErrnoException(error);
+  }
+
+  d_handle = handle;
+  d_poll.add(fd, Poll::IN, _onEvent, this);
+}
+
+void SleepOperation::_onEvent(int fd, uint32_t events, void *data, Poll::AsyncResult &asyncResult)
+{
+  SleepOperation *operation = reinterpret_cast<SleepOperation*>(data);
+
+  // The timer fires once, so it is done with.
+  asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
+
+  operation->d_handle.resume();
+}
+
+OffloadOperation::OffloadOperation(WorkerPool &pool, std::function<void()> work, Poll &poll)
+  : d_pool(pool),
+    d_work(std::move(work)),
+    d_poll(poll),
+    d_submitted(false)
+{
+}
+
+bool OffloadOperation::await_suspend(std::coroutine_handle<> handle)
+{
+  // The resume is posted to the loop, which is this thread, so it can not
+  // run before this returns.
+  d_submitted = d_pool.submit(std::move(d_work), [handle]() { handle.resume(); }, d_poll);
+
+  // Continue right away when the work was rejected.
+  return d_submitted;
+}
+
+SleepOperation plain::sleep(Poll &poll, std::chrono::nanoseconds duration)
+{
+  return SleepOperation(poll, duration);
+}
+
+SleepOperation plain::sleep(std::chrono::nanoseconds duration)
+{
+  return SleepOperation(Main::instance().poll(), duration);
+}
+
+OffloadOperation plain::offload(WorkerPool &pool, std::function<void()> work, Poll &poll)
+{
+  return OffloadOperation(pool, std::move(work), poll);
+}
+
+OffloadOperation plain::offload(WorkerPool &pool, std::function<void()> work)
+{
+  return OffloadOperation(pool, std::move(work), Main::instance().poll());
+}
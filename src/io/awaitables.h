@@ -0,0 +1,203 @@
+#ifndef __INC_PLAIN_AWAITABLES_H__
+#define __INC_PLAIN_AWAITABLES_H__
+
+#include "io/poll.h"
+
+#include <coroutine>
+#include <chrono>
+#include <functional>
+
+#include <sys/types.h>
+
+namespace plain {
+
+  // Forward declaration.
+  class WorkerPool;
+
+  /**
+   *  Awaits one read, write or splice on a non-blocking descriptor, see
+   *  AsyncDescriptor.
+   *
+   *  The operation is tried right away and only suspends on EAGAIN, it is then
+   *  retried from the poll loop when the descriptor becomes ready. The result
+   *  is what the system call returned, or -errno on failure and -ETIMEDOUT
+   *  when the poll timeout passed first.
+   */
+  class AsyncOperation {
+  public:
+
+    enum Type {
+      OPERATION_READ,
+      OPERATION_WRITE,
+      // Splices from the descriptor into the other descriptor.
+      OPERATION_SPLICE_TO,
+      // Splices from the other descriptor into the descriptor.
+      OPERATION_SPLICE_FROM,
+    };
+
+    AsyncOperation(Poll &poll, int fd, Type type, void *buffer, int other, size_t length);
+
+    bool await_ready();
+
+    void await_suspend(std::coroutine_handle<> handle);
+
+    ssize_t await_resume() const { return d_result; }
+
+  private:
+
+    static void _onEvent(int fd, uint32_t events, void *data, Poll::AsyncResult &asyncResult);
+
+    // Runs the system call, returns false on EAGAIN.
+    bool attempt();
+
+    Poll &d_poll;
+    int d_fd;
+    Type d_type;
+    void *d_buffer;
+    int d_other;
+    size_t d_length;
+    ssize_t d_result;
+    std::coroutine_handle<> d_handle;
+
+  };
+
+  /**
+   *  A non-blocking descriptor for use from coroutines on a poll loop.
+   *
+   *  The descriptor is added to the poll for the lifetime of this object and
+   *  closed with it. Only one operation can be awaited at a time. Operations
+   *  wait at most the poll timeout, a descriptor that timed out should be
+   *  closed.
+   */
+  class AsyncDescriptor {
+
+    AsyncDescriptor(AsyncDescriptor const &) = delete;
+    AsyncDescriptor &operator=(AsyncDescriptor const &) = delete;
+
+  public:
+
+    /**
+     *  @param fd a non-blocking descriptor, this takes ownership.
+     */
+    AsyncDescriptor(Poll &poll, int fd);
+
+    ~AsyncDescriptor();
+
+    int fd() const { return d_fd; }
+
+    /**
+     *  @return an awaitable for one read, 0 means end of file.
+     */
+    AsyncOperation read(void *buffer, size_t length)
+    {
+      return AsyncOperation(d_poll, d_fd, AsyncOperation::OPERATION_READ, buffer, -1, length);
+    }
+
+    /**
+     *  @return an awaitable for one write, it can write less than length.
+     */
+    AsyncOperation write(void const *buffer, size_t length)
+    {
+      return AsyncOperation(d_poll, d_fd, AsyncOperation::OPERATION_WRITE, const_cast<void*>(buffer), -1, length);
+    }
+
+    /**
+     *  @param destination a pipe with room, or any descriptor when this is a pipe.
+     *  @return an awaitable for one splice of the data of this descriptor.
+     */
+    AsyncOperation spliceTo(int destination, size_t length)
+    {
+      return AsyncOperation(d_poll, d_fd, AsyncOperation::OPERATION_SPLICE_TO, NULL, destination, length);
+    }
+
+    /**
+     *  @param source a pipe with data, or any descriptor when this is a pipe.
+     *  @return an awaitable for one splice into this descriptor.
+     */
+    AsyncOperation spliceFrom(int source, size_t length)
+    {
+      return AsyncOperation(d_poll, d_fd, AsyncOperation::OPERATION_SPLICE_FROM, NULL, source, length);
+    }
+
+  private:
+
+    Poll &d_poll;
+    int d_fd;
+
+  };
+
+  /**
+   *  Awaits a time on the poll loop, with a timerfd.
+   */
+  class SleepOperation {
+  public:
+
+    SleepOperation(Poll &poll, std::chrono::nanoseconds duration);
+
+    bool await_ready() const { return d_duration.count() <= 0; }
+
+    /**
+     *  @throw ErrnoException when the timer can not be created.
+     */
+    void await_suspend(std::coroutine_handle<> handle);
+
+    void await_resume() const {}
+
+  private:
+
+    static void _onEvent(int fd, uint32_t events, void *data, Poll::AsyncResult &asyncResult);
+
+    Poll &d_poll;
+    std::chrono::nanoseconds d_duration;
+    std::coroutine_handle<> d_handle;
+
+  };
+
+  /**
+   *  Awaits work run on a worker pool, the coroutine continues on the poll
+   *  loop it was suspended on. The result is false when the pool was full
+   *  and the work did not run.
+   */
+  class OffloadOperation {
+  public:
+
+    OffloadOperation(WorkerPool &pool, std::function<void()> work, Poll &poll);
+
+    bool await_ready() const { return false; }
+
+    bool await_suspend(std::coroutine_handle<> handle);
+
+    bool await_resume() const { return d_submitted; }
+
+  private:
+
+    WorkerPool &d_pool;
+    std::function<void()> d_work;
+    Poll &d_poll;
+    bool d_submitted;
+
+  };
+
+  /**
+   *  @return an awaitable that continues after the duration, on the poll loop.
+   */
+  SleepOperation sleep(Poll &poll, std::chrono::nanoseconds duration);
+
+  /**
+   *  @return an awaitable that continues after the duration, on the main loop.
+   */
+  SleepOperation sleep(std::chrono::nanoseconds duration);
+
+  /**
+   *  @return an awaitable that runs the work on the pool and continues on the poll loop.
+   */
+  OffloadOperation offload(WorkerPool &pool, std::function<void()> work, Poll &poll);
+
+  /**
+   *  @return an awaitable that runs the work on the pool and continues on the main loop.
+   */
+  OffloadOperation offload(WorkerPool &pool, std::function<void()> work);
+
+}
+
+#endif // __INC_PLAIN_AWAITABLES_H__
@@ -3,6 +3,7 @@
 #include "exceptions/errnoexception.h"
 
 #include <unistd.h>
+#include <errno.h>
 
 using namespace plain;
 
@@ -13,6 +14,9 @@ Poll::EventResultMask IoHelper::readToBuffer(int fd, char *buffer, size_t &offse
   if (ret == -1) {
     if (errno == EAGAIN) {
       return Poll::READ_COMPLETED;
+    } else if (errno == ECONNRESET) {
+      // Reset by the peer, nothing was read so this is handled like end of file.
+      return Poll::NONE_COMPLETED;
     }
 
     throw ErrnoException(errno);
@@ -1,4 +1,7 @@
 #include "ioscheduler.h"
+#include "core/metrics.h"
+#include "core/trace.h"
+#include "core/probes.h"
 
 #include <mutex>
 #include <iostream>
@@ -37,7 +40,8 @@ struct IoScheduler::Internal {
 
     /// Add the entry to the back of the scheduler list.
     /// Only if it is not already in the list.
-    void push(Schedulable *entry)
+    /// \return true if the entry was added.
+    bool push(Schedulable *entry)
     {
       // Add the entry to the secondary list.
       std::lock_guard<std::mutex> slk(mutex[s]);
@@ -45,13 +49,17 @@ struct IoScheduler::Internal {
       if (entry->schedNext != NULL) {
 	// Already scheduled.
 	//std::cout << "Push: already scheduled.\n";
-	return;
+	return false;
       }
       
+      entry->schedTime = std::chrono::steady_clock::now();
+
       tail[s].schedPrev->schedNext = entry;
       entry->schedPrev = tail[s].schedPrev;
       entry->schedNext = &tail[s];
       tail[s].schedPrev = entry;
+
+      return true;
     }
 
     Schedulable *popFront()
@@ -98,8 +106,40 @@ struct IoScheduler::Internal {
 
   SchedList d_defaultPrio;
 
+  // Metrics.
+  Metrics::Counter &d_scheduledMetric;
+  Metrics::Counter &d_runsMetric;
+  Metrics::Gauge &d_queueLengthMetric;
+  Metrics::Histogram &d_queueWaitMetric;
+
+  // Load statistics, these can be read from other threads.
+  std::atomic<size_t> d_length;
+  std::atomic<uint64_t> d_lastQueueWait;
+  std::atomic<uint64_t> d_averageQueueWait;
+
   Internal()
+    : d_scheduledMetric(Metrics::instance().counter("plain_scheduler_scheduled_total", "Number of schedulables added to the run queue.")),
+      d_runsMetric(Metrics::instance().counter("plain_scheduler_runs_total", "Number of schedulables run.")),
+      d_queueLengthMetric(Metrics::instance().gauge("plain_scheduler_queue_length", "Number of schedulables in the run queue.")),
+      d_queueWaitMetric(Metrics::instance().histogram("plain_scheduler_queue_wait_seconds", "Time schedulables wait in the run queue before they run.")),
+      d_length(0),
+      d_lastQueueWait(0),
+      d_averageQueueWait(0)
+  {
+  }
+
+  // Adds the schedulable to the run queue and accounts for it.
+  void push(Schedulable *schedulable)
   {
+    bool added = d_defaultPrio.push(schedulable);
+
+    PLAIN_PROBE2(sched_enqueue, schedulable, added);
+
+    if (added) {
+      d_scheduledMetric.add();
+      d_queueLengthMetric.add();
+      d_length.fetch_add(1, std::memory_order_relaxed);
+    }
   }
 
   void schedule(Schedulable *schedulable)
@@ -108,7 +148,7 @@ struct IoScheduler::Internal {
 
     // If it is not already scheduled, add it to the schedule.
     schedulable->priv = this;
-    d_defaultPrio.push(schedulable);
+    push(schedulable);
 
     //    std::cout << "- Schedulable " << schedulable << " scheduled.\n";
   }
@@ -131,7 +171,7 @@ struct IoScheduler::Internal {
     if (result == RESULT_NOT_DONE) {
       //      std::cout << "Readding schedulable " << schedulable << " to schedule.\n";
       schedulable->schedState = STATE_SCHEDULED;
-      d_defaultPrio.push(schedulable);
+      push(schedulable);
     }
   }
   
@@ -148,12 +188,19 @@ struct IoScheduler::Internal {
       return;      
     }
 
+    d_queueLengthMetric.sub();
+    d_length.fetch_sub(1, std::memory_order_relaxed);
+
+    PLAIN_PROBE1(sched_dequeue, schedulable);
+
     if (schedulable->schedState == STATE_UNSCHEDULED) {
       //      std::cout << "- schedulable already unscheduled.\n";
       //resultCallback(schedulable, RESULT_REMOVED);
       return;
     }
 
+    queueWaited(std::chrono::steady_clock::now() - schedulable->schedTime);
+
     // Unschedule the scheulable, because from now on it can
     // be scheduled again.
     schedulable->schedState = STATE_UNSCHEDULED;
@@ -165,7 +212,15 @@ struct IoScheduler::Internal {
     // If the schedulable has a callback, run it.
     if (callback != NULL) {
       //      std::cout << "- running schedulable.\n";
-      callback(schedulable, data, _resultCallback);
+      d_runsMetric.add();
+
+      if (Trace::enabled()) {
+	uint64_t start = Trace::now();
+	callback(schedulable, data, _resultCallback);
+	Trace::record(Trace::EVENT_RUN, start, Trace::now() - start, -1, reinterpret_cast<void const*>(callback), 0);
+      } else {
+	callback(schedulable, data, _resultCallback);
+      }
     } else {
       //      std::cout << "- not running schedulable.\n";
       resultCallback(schedulable, RESULT_DONE);
@@ -176,6 +231,19 @@ struct IoScheduler::Internal {
   {
     return d_defaultPrio.empty();
   }
+
+  // Accounts for the time a schedulable waited in the run queue.
+  void queueWaited(std::chrono::steady_clock::duration wait)
+  {
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count();
+
+    d_queueWaitMetric.record(ns);
+    d_lastQueueWait.store(ns, std::memory_order_relaxed);
+
+    // Moving average with a weight of 1/8 for the new value, only updated by the running thread.
+    uint64_t average = d_averageQueueWait.load(std::memory_order_relaxed);
+    d_averageQueueWait.store(average - average / 8 + ns / 8, std::memory_order_relaxed);
+  }
   
 };
 
@@ -207,3 +275,18 @@ bool IoScheduler::empty() const
 {
   return d->empty();
 }
+
+size_t IoScheduler::length() const
+{
+  return d->d_length.load(std::memory_order_relaxed);
+}
+
+uint64_t IoScheduler::lastQueueWait() const
+{
+  return d->d_lastQueueWait.load(std::memory_order_relaxed);
+}
+
+uint64_t IoScheduler::averageQueueWait() const
+{
+  return d->d_averageQueueWait.load(std::memory_order_relaxed);
+}
@@ -3,6 +3,9 @@
 
 #include <memory>
 #include <atomic>
+#include <chrono>
+
+#include <stdint.h>
 
 namespace plain {
 
@@ -96,6 +99,11 @@ namespace plain {
       Schedulable *schedNext;
       Schedulable *schedPrev;
 
+      /**
+       *  The time at which the schedulable was added to the run queue.
+       */
+      std::chrono::steady_clock::time_point schedTime;
+
       Schedulable()
       : priv(NULL),
 	schedState(STATE_UNSCHEDULED),
@@ -143,6 +151,23 @@ namespace plain {
      *  \returns true when nothing is scheduled to run.
      */
     bool empty() const;
+
+    /**
+     *  @returns the number of schedulables in the run queue.
+     */
+    size_t length() const;
+
+    /**
+     *  @returns the time in nanoseconds the last run schedulable waited in the run queue.
+     *
+     *  While a schedulable runs, this is the time that schedulable waited.
+     */
+    uint64_t lastQueueWait() const;
+
+    /**
+     *  @returns an exponentially weighted moving average of the queue wait in nanoseconds.
+     */
+    uint64_t averageQueueWait() const;
     
   private:
 
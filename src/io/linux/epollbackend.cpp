@@ -0,0 +1,181 @@
+#include "io/linux/epollbackend.h"
+#include "exceptions/errnoexception.h"
+#include "core/log.h"
+
+#include <algorithm>
+
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+
+using namespace plain;
+
+struct EpollBackend::Internal {
+
+  enum {
+    // The maximum size of the event buffer that is used to poll for events.
+    POLL_EVENTS_SIZE = 128,
+  };
+
+  // The epoll handle.
+  int d_epoll;
+
+  // The wakeup eventfd.
+  int d_wakeup;
+
+  // The epoll event buffer, used for querying events.
+  epoll_event d_pollEvents[POLL_EVENTS_SIZE];
+
+  // The descriptor limit.
+  size_t d_capacity;
+
+  // The signal mask used for the epoll_pwait call.
+  sigset_t d_signalMask;
+
+  Internal()
+    : d_epoll(-1),
+      d_wakeup(-1),
+      d_capacity(0)
+  {
+    // Get file descriptor limits.
+    rlimit l;
+    if (getrlimit(RLIMIT_NOFILE, &l) == -1) {
+      throw ErrnoException(errno);
+    }
+
+    d_capacity = l.rlim_cur;
+
+    // Create the epoll handle.
+    d_epoll = epoll_create1(EPOLL_CLOEXEC);
+
+    if (d_epoll == -1) {
+      throw ErrnoException(errno);
+    }
+
+    // Poll the wakeup eventfd level triggered, it is read when it fires.
+    d_wakeup = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+    if (d_wakeup == -1) {
+      int error = errno;
+      ::close(d_epoll);
+      throw ErrnoException(error);
+    }
+
+    epoll_event event;
+    event.data.fd = d_wakeup;
+    event.events = EPOLLIN;
+
+    if (epoll_ctl(d_epoll, EPOLL_CTL_ADD, d_wakeup, &event) == -1) {
+      int error = errno;
+      ::close(d_wakeup);
+      ::close(d_epoll);
+      throw ErrnoException(error);
+    }
+
+    // Setup the polling signal mask.
+    sigemptyset(&d_signalMask);
+    sigaddset(&d_signalMask, SIGPIPE);
+  }
+
+  ~Internal()
+  {
+    if (d_wakeup != -1) {
+      ::close(d_wakeup);
+    }
+
+    // Close the epoll handle.
+    if (d_epoll != -1) {
+      LOG_DEBUG("Closing %d.", d_epoll);
+      ::close(d_epoll);
+    }
+  }
+
+};
+
+EpollBackend::EpollBackend()
+  : d(new Internal)
+{
+}
+
+EpollBackend::~EpollBackend()
+{
+}
+
+size_t EpollBackend::capacity() const
+{
+  return d->d_capacity;
+}
+
+void EpollBackend::add(int fd)
+{
+  epoll_event event;
+  event.data.fd = fd;
+  event.events = EPOLLIN | EPOLLOUT | EPOLLET;
+
+  if (epoll_ctl(d->d_epoll, EPOLL_CTL_ADD, fd, &event) == -1) {
+    throw ErrnoException(errno);
+  }
+}
+
+void EpollBackend::remove(int fd)
+{
+  if (epoll_ctl(d->d_epoll, EPOLL_CTL_DEL, fd, NULL) == -1) {
+    throw ErrnoException(errno);
+  }
+}
+
+void EpollBackend::close(int fd)
+{
+  LOG_DEBUG("Closing %d.", fd);
+  ::close(fd);
+}
+
+size_t EpollBackend::wait(Event *events, size_t size, int timeout)
+{
+  int ret = epoll_pwait(d->d_epoll,
+			d->d_pollEvents,
+			std::min<size_t>(size, Internal::POLL_EVENTS_SIZE),
+			timeout,
+			&d->d_signalMask);
+
+  if (ret == -1) {
+    if (errno != EINTR) {
+      throw ErrnoException(errno);
+    }
+
+    return 0;
+  }
+
+  size_t count = 0;
+
+  for (int i = 0; i < ret; ++i) {
+    int fd = d->d_pollEvents[i].data.fd;
+
+    // Reset the wakeup counter, the wakeup itself is not reported.
+    if (fd == d->d_wakeup) {
+      eventfd_t value;
+      eventfd_read(d->d_wakeup, &value);
+      continue;
+    }
+
+    events[count].fd = fd;
+    events[count].events = d->d_pollEvents[i].events;
+    ++count;
+  }
+
+  return count;
+}
+
+void EpollBackend::wakeup()
+{
+  // Fails only when the counter would overflow, the wakeup is pending then anyway.
+  eventfd_write(d->d_wakeup, 1);
+}
+
+std::chrono::steady_clock::time_point EpollBackend::now() const
+{
+  return std::chrono::steady_clock::now();
+}
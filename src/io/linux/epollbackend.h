@@ -0,0 +1,50 @@
+#ifndef __INC_PLAIN_EPOLLBACKEND_H__
+#define __INC_PLAIN_EPOLLBACKEND_H__
+
+#include "io/pollbackend.h"
+
+#include <memory>
+
+namespace plain {
+
+  /**
+   *  The epoll poll backend with the steady clock, the default for Poll.
+   *
+   *  Its capacity is the descriptor limit (RLIMIT_NOFILE). SIGPIPE is blocked
+   *  while waiting. Wakeups go through an eventfd that is polled along with
+   *  the descriptors.
+   */
+  class EpollBackend : public PollBackend {
+  public:
+
+    /**
+     *  @throw ErrnoException when the epoll handle can not be created.
+     */
+    EpollBackend();
+
+    ~EpollBackend();
+
+    virtual size_t capacity() const;
+
+    virtual void add(int fd);
+
+    virtual void remove(int fd);
+
+    virtual void close(int fd);
+
+    virtual size_t wait(Event *events, size_t size, int timeout);
+
+    virtual void wakeup();
+
+    virtual std::chrono::steady_clock::time_point now() const;
+
+  private:
+
+    struct Internal;
+    std::unique_ptr<Internal> d;
+
+  };
+
+}
+
+#endif // __INC_PLAIN_EPOLLBACKEND_H__
@@ -1,18 +1,22 @@
 #include "io/poll.h"
 #include "exceptions/errnoexception.h"
+#include "core/log.h"
+#include "core/metrics.h"
+#include "core/trace.h"
+#include "core/probes.h"
+#include "core/mpscqueue.h"
 
 #include "io/ioscheduler.h"
+#include "io/timeoutlist.h"
+#include "io/pollbackend.h"
+#include "io/linux/epollbackend.h"
 
 #include <mutex>
-#include <iostream>
 #include <atomic>
+#include <thread>
+#include <functional>
 
 #include <string.h>
-#include <unistd.h>
-#include <signal.h>
-#include <sys/epoll.h>
-#include <sys/time.h>
-#include <sys/resource.h>
 
 using namespace plain;
 
@@ -73,6 +77,11 @@ struct Poll::Internal {
     // The point in time at which this file descriptor should time out.
     std::chrono::steady_clock::time_point timeout;
 
+    // The start time and callback of the running callback when tracing, the
+    // callback event is recorded when the callback completes.
+    uint64_t traceStart;
+    EventCallback traceCallback;
+
     // The asynchronous result callback.
     virtual void completed(EventResultMask result);
 
@@ -80,50 +89,79 @@ struct Poll::Internal {
 
   std::recursive_mutex d_mutex;
 
-  // The epoll handle.
-  int d_epoll;
+  // The readiness notification and clock.
+  std::unique_ptr<PollBackend> d_backend;
 
-  // The size of the epoll event buffer, used for querying events.
+  // The size of the event buffer, used for querying events.
   size_t d_pollEventsSize;
-  epoll_event *d_pollEvents;
+  PollBackend::Event *d_pollEvents;
 
   // The file descriptor table size.
   size_t d_tableSize;
   TableEntry *d_table;
 
-  // The global file descriptor timeout.
-  std::chrono::steady_clock::duration d_timeout;
-
-  // The timeout list and its mutex.
-  std::recursive_mutex d_timeoutMutex;
-  TableEntry *d_timeoutHead;
-  TableEntry *d_timeoutTail;
-
-  // The signal mask used for the epoll_waitp call.
-  sigset_t d_signalMask;
+  // The timeout list, all file descriptors share the same timeout.
+  TimeoutList<TableEntry> d_timeouts;
 
   IoScheduler d_scheduler;
+
+  // Tasks posted to run on the loop thread.
+  MpscQueue<std::function<void()>> d_tasks;
+
+  // Set when the loop should not wait, cleared by the loop before it runs
+  // the posted tasks. Only the poster that sets it wakes up the backend.
+  std::atomic<bool> d_wakeupPending;
+
+  // The thread that runs update().
+  std::atomic<std::thread::id> d_loopThread;
+
+  // Metrics.
+  Metrics::Counter &d_waitsMetric;
+  Metrics::Counter &d_eventsMetric;
+  Metrics::Counter &d_timeoutsMetric;
+  Metrics::Counter &d_callbacksMetric;
+  Metrics::Gauge &d_descriptorsMetric;
+  Metrics::Histogram &d_eventsPerWaitMetric;
+  Metrics::Histogram &d_iterationMetric;
+  Metrics::Histogram &d_zeroWaitMetric;
+  Metrics::Histogram &d_blockingWaitMetric;
+  Metrics::Histogram &d_timeoutScanMetric;
+  Metrics::Gauge &d_tableBytesMetric;
+  Metrics::Counter &d_tasksMetric;
+  Metrics::Counter &d_wakeupsMetric;
+
+  // Load statistics of the last loop iteration, these can be read from other threads.
+  std::atomic<size_t> d_lastEvents;
+  std::atomic<uint64_t> d_lastIterationTime;
+  std::atomic<uint64_t> d_averageIterationTime;
   
-  Internal()
-    : d_pollEventsSize(DEFAULT_POLL_EVENTS_SIZE),
-      d_pollEvents(new epoll_event [ DEFAULT_POLL_EVENTS_SIZE ]),
+  Internal(std::unique_ptr<PollBackend> backend)
+    : d_backend(std::move(backend)),
+      d_pollEventsSize(DEFAULT_POLL_EVENTS_SIZE),
+      d_pollEvents(new PollBackend::Event [ DEFAULT_POLL_EVENTS_SIZE ]),
       d_tableSize(0), d_table(NULL),
-      d_timeout(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(30))),
-      d_timeoutHead(NULL), d_timeoutTail(NULL)
+      d_timeouts(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::seconds(30))),
+      d_wakeupPending(false),
+      d_waitsMetric(Metrics::instance().counter("plain_poll_waits_total", "Number of epoll_pwait calls.")),
+      d_eventsMetric(Metrics::instance().counter("plain_poll_events_total", "Number of events returned by epoll_pwait.")),
+      d_timeoutsMetric(Metrics::instance().counter("plain_poll_timeouts_total", "Number of file descriptor timeouts.")),
+      d_callbacksMetric(Metrics::instance().counter("plain_poll_callbacks_total", "Number of event callbacks run.")),
+      d_descriptorsMetric(Metrics::instance().gauge("plain_poll_descriptors", "Number of file descriptors in the poll system.")),
+      d_eventsPerWaitMetric(Metrics::instance().histogram("plain_poll_events_per_wait", "Number of events returned per epoll_pwait call.", "", Metrics::UNIT_NONE)),
+      d_iterationMetric(Metrics::instance().histogram("plain_poll_iteration_seconds", "Time a loop iteration spends outside of epoll_pwait.")),
+      d_zeroWaitMetric(Metrics::instance().histogram("plain_poll_wait_seconds", "Time spent in epoll_pwait.", "timeout=\"zero\"")),
+      d_blockingWaitMetric(Metrics::instance().histogram("plain_poll_wait_seconds", "Time spent in epoll_pwait.", "timeout=\"blocking\"")),
+      d_timeoutScanMetric(Metrics::instance().histogram("plain_poll_timeout_scan_seconds", "Time a loop iteration spends expiring timeouts.")),
+      d_tableBytesMetric(Metrics::instance().gauge("plain_poll_table_bytes", "Size of the descriptor table, it is allocated for the descriptor limit.")),
+      d_tasksMetric(Metrics::instance().counter("plain_poll_tasks_total", "Number of posted tasks run on the loop thread.")),
+      d_wakeupsMetric(Metrics::instance().counter("plain_poll_wakeups_total", "Number of cross thread wakeups of the loop.")),
+      d_lastEvents(0),
+      d_lastIterationTime(0),
+      d_averageIterationTime(0)
   {
     // Initialize the file descriptor table.
     initializeTable();
-
-    // Create the epoll handle.
-    d_epoll = epoll_create1(EPOLL_CLOEXEC);
-    
-    if (d_epoll == -1) {
-      throw ErrnoException(errno);
-    }
-
-    // Setup the polling signal mask.
-    sigemptyset(&d_signalMask);
-    sigaddset(&d_signalMask, SIGPIPE);
+    d_tableBytesMetric.add(d_tableSize * sizeof(TableEntry));
   }
 
   ~Internal()
@@ -132,12 +170,6 @@ struct Poll::Internal {
     delete [] d_pollEvents;
     d_pollEvents = NULL;
 
-    // Close the epoll handle.
-    if (d_epoll != -1) {
-      std::cout << "Closing " << d_epoll << ".\n";
-      ::close(d_epoll);
-    }
-
     if (d_table != NULL) {
       delete [] d_table;
       d_table = NULL;
@@ -156,22 +188,14 @@ struct Poll::Internal {
   // Initializes the file descriptor table.
   void initializeTable()
   {
-    // Get file descriptor limits.
-    rlimit l;
-    int ret = getrlimit(RLIMIT_NOFILE, &l);
-  
-    if (ret == -1) {
-      throw ErrnoException(errno);
-    }
-
-    d_tableSize = l.rlim_cur;
+    d_tableSize = d_backend->capacity();
 
     // Allocate a table large enough to hold all file descriptors
     // that can possible be open at one time.
-    d_table = new TableEntry [ l.rlim_cur ];
+    d_table = new TableEntry [ d_tableSize ];
 
     // Initialize the table to zero.
-    for (size_t i = 0;i < l.rlim_cur; ++i) {
+    for (size_t i = 0;i < d_tableSize; ++i) {
       TableEntry *entry = d_table + i;
 
       resetTableEntry(entry);
@@ -181,6 +205,8 @@ struct Poll::Internal {
       entry->state = TABLE_ENTRY_STATE_EMPTY;
       entry->timeoutNext = NULL;
       entry->timeoutPrev = NULL;
+      entry->traceStart = 0;
+      entry->traceCallback = NULL;
       entry->schedCallback = _schedulerCallback;
       entry->schedData = this;
       entry->internal = this;
@@ -189,7 +215,8 @@ struct Poll::Internal {
 
   void add(int fd, uint32_t events, EventCallback callback, void *data)
   {
-    std::cout << "add(" << fd << ", " << events << ").\n";
+    LOG_DEBUG("add(%d, %u).", fd, events);
+    PLAIN_PROBE2(poll_add, fd, events);
     
     // Get the table entry associated with the file descriptor.
     TableEntry *entry = d_table + fd;
@@ -202,12 +229,6 @@ struct Poll::Internal {
       throw std::runtime_error("file descriptor is already registered");
     }
 
-    // Create the epoll event structure to point to the table entry and
-    // setup the right events.
-    epoll_event event;
-    event.data.ptr = entry;
-    event.events = EPOLLIN | EPOLLOUT | EPOLLET;
-
     // Reset the structure.
     resetTableEntry(entry);
 
@@ -217,27 +238,22 @@ struct Poll::Internal {
 
     // Check if we need to add it to the timeout list.
     if (events & TIMEOUT) {
-      timeoutAdd(d_timeoutHead, d_timeoutTail, entry);
+      d_timeouts.add(entry, d_backend->now());
     }
 
     // Update the state to active.
     entry->state = TABLE_ENTRY_STATE_ACTIVE;
 
     // Add the fd to the polling queue.
-    int ret = epoll_ctl(d_epoll,
-			EPOLL_CTL_ADD,
-			fd,
-			&event);
-
-    if (ret == -1) {
-      throw ErrnoException(errno);
-    }
+    d_backend->add(fd);
 
+    d_descriptorsMetric.add();
   }
 
   void modify(int fd, uint32_t events, EventCallback callback, void *data)
   {
     //    std::cout << "modify(" << fd << ", " << events << ").\n";
+    PLAIN_PROBE2(poll_modify, fd, events);
     
     TableEntry *entry = d_table + fd;
 
@@ -255,16 +271,52 @@ struct Poll::Internal {
 
     // If necessary add the entry to the timeout list.
     if (events & TIMEOUT) {
-      timeoutAdd(d_timeoutHead, d_timeoutTail, entry);
+      d_timeouts.add(entry, d_backend->now());
     }
 
     entry->state = TABLE_ENTRY_STATE_ACTIVE;
 
     //    std::cout << "- events: " << entry->events << ", mask: " << entry->eventMask << ".\n";
     
-    if (entry->events & entry->eventMask != 0) {
+    if ((entry->events & entry->eventMask) != 0) {
       schedule(entry);
-      // TODO: wake up thread!!
+
+      // The loop thread might be waiting, while it should run the entry.
+      if (std::this_thread::get_id() != d_loopThread.load(std::memory_order_relaxed)) {
+	wakeup();
+      }
+    }
+  }
+
+  void wakeup()
+  {
+    if (!d_wakeupPending.exchange(true)) {
+      d_wakeupsMetric.add();
+      d_backend->wakeup();
+    }
+  }
+
+  void post(std::function<void()> &&task)
+  {
+    d_tasks.push(std::move(task));
+
+    // The loop thread itself does not wait while a wakeup is pending.
+    if (std::this_thread::get_id() == d_loopThread.load(std::memory_order_relaxed)) {
+      d_wakeupPending = true;
+    } else {
+      wakeup();
+    }
+  }
+
+  // Runs the posted tasks.
+  void runTasks()
+  {
+    d_wakeupPending = false;
+
+    std::function<void()> task;
+    while (d_tasks.pop(task)) {
+      d_tasksMetric.add();
+      task();
     }
   }
 
@@ -278,6 +330,8 @@ struct Poll::Internal {
   // Remove the file descriptor associated with this entry from the polling system.
   void remove(TableEntry *entry)
   {  
+    PLAIN_PROBE1(poll_remove, static_cast<int>(entry - d_table));
+
     // This makes sure no other thread interferce with the structure.
     int state = TABLE_ENTRY_STATE_ACTIVE;
     if (!std::atomic_compare_exchange_strong<int>(&entry->state,
@@ -292,26 +346,20 @@ struct Poll::Internal {
     entry->events = 0;
 
     // Remove from the timeout list if it is in it.
-    timeoutRemove(d_timeoutHead, d_timeoutTail, entry);
+    d_timeouts.remove(entry);
 
     entry->state = TABLE_ENTRY_STATE_EMPTY;
 
-    int ret = epoll_ctl(d_epoll,
-			EPOLL_CTL_DEL,
-			entry - d_table,
-			NULL);
+    d_descriptorsMetric.sub();
 
-    if (ret == -1) {
-      throw ErrnoException(errno);
-    }
+    d_backend->remove(entry - d_table);
   }
 
   // Remove and close the file descriptor.
   void close(int fd)
   {
     remove(fd);
-    std::cout << "Closing " << fd << ".\n";
-    ::close(fd);
+    d_backend->close(fd);
   }
 
   // Remove and close the file descriptor associated with this entry.
@@ -319,26 +367,26 @@ struct Poll::Internal {
   {
     // TODO: optimize, because we don't need the epoll_ctl system call.
     remove(entry);
-    int fd = entry - d_table;
-    std::cout << "Closing " << fd << ".\n";
-    ::close(fd);
+    d_backend->close(entry - d_table);
   }
 
   bool update(int timeout)
   {
     //    std::unique_lock<std::recursive_mutex> lk(d_mutex);
 
-    // There are still events to be run.
-    if (!d_scheduler.empty()) {
+    d_loopThread.store(std::this_thread::get_id(), std::memory_order_relaxed);
+
+    // There are still events or tasks to be run.
+    if (!d_scheduler.empty() || d_wakeupPending.load()) {
       timeout = 0;
     }
 
 
-    /* else if (d_timeoutHead != NULL) {
+    /* else if (d_timeouts.head() != NULL) {
       std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
 
-      if (d_timeoutHead->timeout > t) {
-	timeout = std::min<int>(timeout, std::chrono::duration_cast<std::chrono::milliseconds>(d_timeoutHead->timeout - t).count());
+      if (d_timeouts.head()->timeout > t) {
+	timeout = std::min<int>(timeout, std::chrono::duration_cast<std::chrono::milliseconds>(d_timeouts.head()->timeout - t).count());
       } else {
 	timeout = 0;
       }
@@ -349,113 +397,84 @@ struct Poll::Internal {
 
     //    std::cout << "epoll_pwait(t=" << timeout << ").\n";
     
+    uint64_t traceStart = Trace::enabled() ? Trace::now() : 0;
+    std::chrono::steady_clock::time_point waitStart = d_backend->now();
+
     // Poll for events.
-    int ret = epoll_pwait(d_epoll,
-			  d_pollEvents,
-			  d_pollEventsSize,
-			  timeout,
-			  &d_signalMask);
-
-    if (ret == -1) {
-      if (errno != EINTR) {
-	throw ErrnoException(errno);
-      } else {
-	ret = 0;
-      }
+    size_t ret = d_backend->wait(d_pollEvents, d_pollEventsSize, timeout);
+
+    // The loop iteration starts when the wait returns.
+    std::chrono::steady_clock::time_point t = d_backend->now();
+
+    // Waits with a zero timeout measure the cost of epoll_pwait itself.
+    uint64_t wait = std::chrono::duration_cast<std::chrono::nanoseconds>(t - waitStart).count();
+    (timeout == 0 ? d_zeroWaitMetric : d_blockingWaitMetric).record(wait);
+
+    d_waitsMetric.add();
+    d_eventsPerWaitMetric.record(ret);
+    d_lastEvents.store(ret, std::memory_order_relaxed);
+
+    if (traceStart != 0) {
+      Trace::record(Trace::EVENT_WAIT, traceStart, Trace::now() - traceStart, -1, NULL, ret);
     }
 
     // If we have new events add them to the scheduler list.
     if (ret > 0) {
+      d_eventsMetric.add(ret);
       schedule(d_pollEvents, ret);
     }
 
     // Schedule timeouts.
-    std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
-    for (TableEntry *i = timeoutPop(d_timeoutHead, d_timeoutTail, t);
+    std::chrono::steady_clock::time_point timeoutStart = d_backend->now();
+
+    for (TableEntry *i = d_timeouts.pop(t);
 	 i != NULL;
-	 i = timeoutPop(d_timeoutHead, d_timeoutTail, t)) {
+	 i = d_timeouts.pop(t)) {
+      d_timeoutsMetric.add();
+
+      if (Trace::enabled()) {
+	Trace::record(Trace::EVENT_TIMEOUT, Trace::now(), 0, i - d_table, NULL, 0);
+      }
+
       scheduleTimeout(i);
     }
 
-    // Run scheduled events.
-    runEvents();
+    d_timeoutScanMetric.record(std::chrono::duration_cast<std::chrono::nanoseconds>(d_backend->now() - timeoutStart).count());
 
-    return ret == 0;
-  }
+    // Run posted tasks, they can schedule events.
+    runTasks();
 
-  // Add entry to the back of the timeout list.
-  void timeoutPushBack(TableEntry *&head, TableEntry *&tail, TableEntry *entry)
-  {
-    std::lock_guard<std::recursive_mutex> lk(d_timeoutMutex);
+    // Run scheduled events.
+    runEvents();
 
-    entry->timeoutPrev = tail;
-    entry->timeoutNext = NULL;
+    iterated(d_backend->now() - t);
 
-    if (head == NULL) {
-      head = tail = entry;
-    } else {
-      tail->timeoutNext = entry;
-      tail = entry;
-    }
+    return ret == 0;
   }
 
-  // Remove entry from the timeout list.
-  void timeoutRemove(TableEntry *&head, TableEntry *&tail, TableEntry *entry)
+  // Accounts for the time a loop iteration took.
+  void iterated(std::chrono::steady_clock::duration duration)
   {
-    std::lock_guard<std::recursive_mutex> lk(d_timeoutMutex);
-
-    if (head == entry) {
-      head = entry->timeoutNext;
-
-      if (head != NULL) {
-	head->timeoutPrev = NULL;
-      } else {
-	tail = NULL;
-      }
-    } else if (entry->timeoutPrev != NULL) {
-      entry->timeoutPrev->timeoutNext = entry->timeoutNext;
-      if (entry->timeoutNext != NULL) {
-	entry->timeoutNext->timeoutPrev = entry->timeoutPrev;
-      } else {
-	tail = entry->timeoutPrev;
-      }
-    }
-
-    entry->timeoutNext = NULL;
-    entry->timeoutPrev = NULL;
-  }
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
 
-  // Add a timeout for the entry.
-  void timeoutAdd(TableEntry *&head, TableEntry *&tail, TableEntry *entry)
-  {
-    std::lock_guard<std::recursive_mutex> lk(d_timeoutMutex);
+    d_iterationMetric.record(ns);
+    d_lastIterationTime.store(ns, std::memory_order_relaxed);
 
-    if (head != entry && entry->timeoutPrev == NULL) {
-      entry->timeout = std::chrono::steady_clock::now() + d_timeout;
-      timeoutPushBack(head, tail, entry);
-    }
+    // Moving average with a weight of 1/8 for the new value.
+    uint64_t average = d_averageIterationTime.load(std::memory_order_relaxed);
+    d_averageIterationTime.store(average - average / 8 + ns / 8, std::memory_order_relaxed);
   }
 
-  // Pop the first expired timeout from the list.
-  TableEntry *timeoutPop(TableEntry *&head, TableEntry *&tail, std::chrono::steady_clock::time_point const &t)
+  Stats stats() const
   {
-    std::lock_guard<std::recursive_mutex> lk(d_timeoutMutex);
-
-    TableEntry *front = NULL;
-
-    if (head != NULL && head->timeout < t) {
-      front = head;
-
-      head = head->timeoutNext;
-
-      if (head != NULL) {
-	head->timeoutPrev = NULL;
-      } else {
-	tail = NULL;
-      }
-    }
-
-    return front;
+    Stats stats;
+    stats.queueLength = d_scheduler.length();
+    stats.queueWait = d_scheduler.lastQueueWait();
+    stats.averageQueueWait = d_scheduler.averageQueueWait();
+    stats.events = d_lastEvents.load(std::memory_order_relaxed);
+    stats.iterationTime = d_lastIterationTime.load(std::memory_order_relaxed);
+    stats.averageIterationTime = d_averageIterationTime.load(std::memory_order_relaxed);
+    return stats;
   }
 
   void schedule(TableEntry *entry)
@@ -468,19 +487,19 @@ struct Poll::Internal {
       d_scheduler.schedule(entry);
       
       // Remove the file descriptor from the timeout list while it is scheduled.
-      timeoutRemove(d_timeoutHead, d_timeoutTail, entry);
+      d_timeouts.remove(entry);
     }
   }
   
   // Schedule the events.
-  void schedule(epoll_event *events, size_t count)
+  void schedule(PollBackend::Event *events, size_t count)
   {
     // TODO: should we reverse this loop?
-    epoll_event *end = events + count;
-    for (epoll_event *event = events; event != end; ++event) {
+    PollBackend::Event *end = events + count;
+    for (PollBackend::Event *event = events; event != end; ++event) {
 
       // Get the file descriptor table entry associated with the event.
-      TableEntry *entry = reinterpret_cast<TableEntry*>(event->data.ptr);
+      TableEntry *entry = d_table + event->fd;
 
       //      std::cout << "- adding events " << event->events << " to fd " << (entry - d_table) << ".\n";
       
@@ -533,13 +552,21 @@ struct Poll::Internal {
     EventCallback callback = entry->callback;
     void *data = entry->data;
 
-    // If the handler was not removed in the mean time, call the callback.
+    // If the handler was not removed or its mask changed in the mean time, call the callback.
     if ((entry->events & entry->eventMask) != 0 &&
 	callback != NULL) {
       entry->resultCallback = asyncResultCallback;
+      d_callbacksMetric.add();
+
+      if (Trace::enabled()) {
+	entry->traceStart = Trace::now();
+	entry->traceCallback = callback;
+      }
+
       callback(entry - d_table, entry->events, data, *entry);
     } else {
-      entry->completed(REMOVE_DESCRIPTOR);
+      // Nothing to run, the events stay recorded until the mask matches them.
+      asyncResultCallback(entry, IoScheduler::RESULT_DONE);
     } 
   }
   
@@ -550,10 +577,17 @@ void Poll::Internal::TableEntry::completed(EventResultMask result)
 {
   //  std::cout << "completed(" << result << ").\n";
   //    std::cout << "schedulerCallback result=" << result << ".\n";
+
+  // Record the callback, it might have been started before tracing was enabled.
+  if (traceStart != 0) {
+    Trace::record(Trace::EVENT_CALLBACK, traceStart, Trace::now() - traceStart,
+		  this - internal->d_table, reinterpret_cast<void const*>(traceCallback), result);
+    traceStart = 0;
+  }
     
   // Add back to the timeout list if timeout was set.
   if (eventMask & TIMEOUT) {
-    internal->timeoutAdd(internal->d_timeoutHead, internal->d_timeoutTail, this);
+    internal->d_timeouts.add(this, internal->d_backend->now());
   }
 
   // Check the result of the event handler.
@@ -564,18 +598,20 @@ void Poll::Internal::TableEntry::completed(EventResultMask result)
   } else {
 
     if (result & READ_COMPLETED) {
-      events &= ~EPOLLIN;
+      events &= ~IN;
     }
 
     if (result & WRITE_COMPLETED) {
-      events &= ~EPOLLOUT;
+      events &= ~OUT;
     }
 
   }
 
   //    std::cout << "schedulerCallback events=" << entry->events << ".\n";
 
-  if (events == 0) {
+  // Events outside of the mask are kept, they are scheduled when a modify
+  // matches them, but they should not keep the entry running.
+  if ((events & eventMask) == 0) {
     // This will remove the entry from the schedule, so it is no longer scheduled.
     resultCallback(this, IoScheduler::RESULT_DONE);
   } else {
@@ -585,7 +621,12 @@ void Poll::Internal::TableEntry::completed(EventResultMask result)
 }
 
 Poll::Poll()
-  : internal(new Internal)
+  : internal(new Internal(std::unique_ptr<PollBackend>(new EpollBackend)))
+{
+}
+
+Poll::Poll(std::unique_ptr<PollBackend> backend)
+  : internal(new Internal(std::move(backend)))
 {
 }
 
@@ -615,5 +656,25 @@ void Poll::close(int fd)
 
 bool Poll::update(int timeout)
 {
-  internal->update(timeout);
+  return internal->update(timeout);
+}
+
+void Poll::post(std::function<void()> task)
+{
+  internal->post(std::move(task));
+}
+
+void Poll::wakeup()
+{
+  internal->wakeup();
+}
+
+Poll::Stats Poll::stats() const
+{
+  return internal->stats();
+}
+
+void Poll::setTimeout(std::chrono::steady_clock::duration timeout)
+{
+  internal->d_timeouts.setTimeout(timeout);
 }
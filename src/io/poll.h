@@ -2,11 +2,17 @@
 #define __INC_PLAIN_POLL_H__
 
 #include <memory>
+#include <chrono>
+#include <functional>
 
+#include <stdint.h>
 #include <sys/epoll.h>
 
 namespace plain {
 
+  // Forward declaration.
+  class PollBackend;
+
   class Poll {
   public:
 
@@ -82,10 +88,44 @@ namespace plain {
      *  EAGAIN error code it should return WRITE_COMPLETED.
      */
     typedef void (*EventCallback)(int fd, uint32_t events, void *data, AsyncResult &asyncResult);
+
+    /**
+     *  Event loop load statistics.
+     *
+     *  A growing queue wait or queue length means the loop can not keep up with
+     *  the events, long before this shows up in the response times of clients.
+     */
+    struct Stats {
+      /// The number of descriptors waiting in the run queue.
+      size_t queueLength;
+
+      /// The time the last run descriptor waited in the run queue, in nanoseconds.
+      uint64_t queueWait;
+
+      /// Moving average of the queue wait, in nanoseconds.
+      uint64_t averageQueueWait;
+
+      /// The number of events returned by the last epoll_pwait call.
+      size_t events;
+
+      /// The time the last loop iteration spent outside of epoll_pwait, in nanoseconds.
+      uint64_t iterationTime;
+
+      /// Moving average of the loop iteration time, in nanoseconds.
+      uint64_t averageIterationTime;
+    };
    
     
+    /**
+     *  Polls with epoll and the steady clock.
+     */
     Poll();
 
+    /**
+     *  Polls with the given backend, for instance a SimulatedBackend.
+     */
+    explicit Poll(std::unique_ptr<PollBackend> backend);
+
     ~Poll();
 
     /**
@@ -130,6 +170,31 @@ namespace plain {
      */
     bool update(int timeout);
 
+    /**
+     *  Runs the task on the loop thread, during the next update(). This can
+     *  be called from any thread, tasks run in the order they were posted.
+     *  A waiting loop thread is woken up.
+     */
+    void post(std::function<void()> task);
+
+    /**
+     *  Makes the loop thread return from waiting, or not wait in the next
+     *  update(). This can be called from any thread.
+     */
+    void wakeup();
+
+    /**
+     *  @return the load statistics, this can be called from any thread.
+     */
+    Stats stats() const;
+
+    /**
+     *  Sets the time after which a descriptor polled with TIMEOUT and without
+     *  events times out (default 30 seconds). Applies to descriptors that are
+     *  (re)added to the timeout list from now on.
+     */
+    void setTimeout(std::chrono::steady_clock::duration timeout);
+
   private:
 
     struct Internal;
@@ -0,0 +1,81 @@
+#ifndef __INC_PLAIN_POLLBACKEND_H__
+#define __INC_PLAIN_POLLBACKEND_H__
+
+#include <chrono>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace plain {
+
+  /**
+   *  The readiness notification and clock used by Poll.
+   *
+   *  Descriptors are polled edge triggered for both reading and writing, the
+   *  backend reports readiness changes with the Poll::EventMask values. Poll
+   *  does the scheduling, the timeouts and the callbacks on top of this.
+   *
+   *  Note: the backend is only used from the thread that runs Poll::update(),
+   *        except for now() which is also called from completing callbacks,
+   *        and wakeup().
+   */
+  class PollBackend {
+  public:
+
+    /**
+     *  A readiness event.
+     */
+    struct Event {
+      int fd;
+      uint32_t events;
+    };
+
+    virtual ~PollBackend() {}
+
+    /**
+     *  @return the number of descriptors that can be polled, descriptors
+     *          should be below this.
+     */
+    virtual size_t capacity() const = 0;
+
+    /**
+     *  Starts polling the descriptor.
+     */
+    virtual void add(int fd) = 0;
+
+    /**
+     *  Stops polling the descriptor.
+     */
+    virtual void remove(int fd) = 0;
+
+    /**
+     *  Closes the descriptor, it was removed before.
+     */
+    virtual void close(int fd) = 0;
+
+    /**
+     *  Waits for readiness events.
+     *
+     *  @param events the buffer to fill.
+     *  @param size the size of the buffer.
+     *  @param timeout the time to wait in milliseconds, -1 waits until there are events.
+     *  @return the number of events in the buffer, 0 when the wait timed out or was interrupted.
+     */
+    virtual size_t wait(Event *events, size_t size, int timeout) = 0;
+
+    /**
+     *  Makes the wait in progress, or else the next wait, return right away.
+     *  This can be called from any thread.
+     */
+    virtual void wakeup() = 0;
+
+    /**
+     *  @return the current time, used for timeouts and the loop statistics.
+     */
+    virtual std::chrono::steady_clock::time_point now() const = 0;
+
+  };
+
+}
+
+#endif // __INC_PLAIN_POLLBACKEND_H__
@@ -0,0 +1,226 @@
+#include "io/simulatedbackend.h"
+
+#include <atomic>
+#include <vector>
+#include <deque>
+#include <queue>
+#include <functional>
+#include <stdexcept>
+
+using namespace plain;
+
+struct SimulatedBackend::Internal {
+
+  // A scripted event.
+  struct Scripted {
+    std::chrono::steady_clock::time_point time;
+
+    // Keeps events scripted for the same time in order.
+    uint64_t sequence;
+
+    int fd;
+    uint32_t events;
+
+    bool operator>(Scripted const &other) const
+    {
+      return time != other.time ? time > other.time : sequence > other.sequence;
+    }
+  };
+
+  size_t d_capacity;
+
+  // The virtual clock.
+  std::chrono::steady_clock::time_point d_now;
+
+  // Per descriptor, whether it is polled and the events not yet returned.
+  std::vector<bool> d_polled;
+  std::vector<uint32_t> d_pending;
+
+  // The descriptors with pending events, in the order they became ready. A
+  // removed descriptor can stay in here, it is skipped because it has no
+  // pending events.
+  std::deque<int> d_ready;
+
+  // The scripted events, earliest first.
+  std::priority_queue<Scripted, std::vector<Scripted>, std::greater<Scripted>> d_scripted;
+  uint64_t d_sequence;
+
+  uint64_t d_closed;
+
+  // Set by wakeup(), the next wait does not move the clock.
+  std::atomic<bool> d_woken;
+
+  Internal(size_t capacity)
+    : d_capacity(capacity),
+      d_polled(capacity, false),
+      d_pending(capacity, 0),
+      d_sequence(0),
+      d_closed(0),
+      d_woken(false)
+  {
+  }
+
+  void check(int fd) const
+  {
+    if (fd < 0 || static_cast<size_t>(fd) >= d_capacity) {
+      throw std::out_of_range("simulated descriptor out of range");
+    }
+  }
+
+  void signal(int fd, uint32_t events)
+  {
+    if (!d_polled[fd] || events == 0) {
+      return;
+    }
+
+    if (d_pending[fd] == 0) {
+      d_ready.push_back(fd);
+    }
+
+    d_pending[fd] |= events;
+  }
+
+  // Signals the scripted events that are due.
+  void release()
+  {
+    while (!d_scripted.empty() && d_scripted.top().time <= d_now) {
+      Scripted const &scripted = d_scripted.top();
+      signal(scripted.fd, scripted.events);
+      d_scripted.pop();
+    }
+  }
+
+};
+
+SimulatedBackend::SimulatedBackend(size_t capacity)
+  : d(new Internal(capacity))
+{
+}
+
+SimulatedBackend::~SimulatedBackend()
+{
+}
+
+size_t SimulatedBackend::capacity() const
+{
+  return d->d_capacity;
+}
+
+void SimulatedBackend::add(int fd)
+{
+  d->check(fd);
+
+  if (d->d_polled[fd]) {
+    throw std::runtime_error("simulated descriptor is already polled");
+  }
+
+  d->d_polled[fd] = true;
+}
+
+void SimulatedBackend::remove(int fd)
+{
+  d->check(fd);
+
+  if (!d->d_polled[fd]) {
+    throw std::runtime_error("simulated descriptor is not polled");
+  }
+
+  d->d_polled[fd] = false;
+  d->d_pending[fd] = 0;
+}
+
+void SimulatedBackend::close(int fd)
+{
+  d->check(fd);
+  ++d->d_closed;
+}
+
+size_t SimulatedBackend::wait(Event *events, size_t size, int timeout)
+{
+  d->release();
+
+  bool woken = d->d_woken.exchange(false);
+
+  // Nothing is ready, so let the virtual time pass.
+  if (d->d_ready.empty() && timeout != 0 && !woken) {
+    std::chrono::steady_clock::time_point until = timeout > 0 ?
+      d->d_now + std::chrono::milliseconds(timeout) : std::chrono::steady_clock::time_point::max();
+
+    if (!d->d_scripted.empty() && d->d_scripted.top().time < until) {
+      until = d->d_scripted.top().time;
+    }
+
+    // Waiting forever without anything scripted returns right away.
+    if (until != std::chrono::steady_clock::time_point::max() && until > d->d_now) {
+      d->d_now = until;
+    }
+
+    d->release();
+  }
+
+  size_t count = 0;
+
+  while (count < size && !d->d_ready.empty()) {
+    int fd = d->d_ready.front();
+    d->d_ready.pop_front();
+
+    if (d->d_pending[fd] != 0) {
+      events[count].fd = fd;
+      events[count].events = d->d_pending[fd];
+      d->d_pending[fd] = 0;
+      ++count;
+    }
+  }
+
+  return count;
+}
+
+void SimulatedBackend::wakeup()
+{
+  d->d_woken = true;
+}
+
+std::chrono::steady_clock::time_point SimulatedBackend::now() const
+{
+  return d->d_now;
+}
+
+void SimulatedBackend::advance(std::chrono::steady_clock::duration duration)
+{
+  d->d_now += duration;
+}
+
+void SimulatedBackend::signal(int fd, uint32_t events)
+{
+  d->check(fd);
+  d->signal(fd, events);
+}
+
+void SimulatedBackend::signalAt(std::chrono::steady_clock::time_point time, int fd, uint32_t events)
+{
+  d->check(fd);
+
+  Internal::Scripted scripted;
+  scripted.time = time;
+  scripted.sequence = d->d_sequence++;
+  scripted.fd = fd;
+  scripted.events = events;
+
+  d->d_scripted.push(scripted);
+}
+
+bool SimulatedBackend::polled(int fd) const
+{
+  d->check(fd);
+  return d->d_polled[fd];
+}
+
+uint64_t SimulatedBackend::closed() const
+{
+  return d->d_closed;
+}
+
+size_t SimulatedBackend::scripted() const
+{
+  return d->d_scripted.size();
+}
@@ -0,0 +1,92 @@
+#ifndef __INC_PLAIN_SIMULATEDBACKEND_H__
+#define __INC_PLAIN_SIMULATEDBACKEND_H__
+
+#include "io/pollbackend.h"
+
+#include <memory>
+
+namespace plain {
+
+  /**
+   *  An in memory poll backend with a virtual clock and scripted readiness.
+   *
+   *  Descriptors are plain numbers below the capacity, nothing is opened or
+   *  closed. Readiness is signalled now or scripted at a virtual time, events
+   *  for the same descriptor are merged until they are returned, like with
+   *  edge triggered epoll. Events for descriptors that are not polled are
+   *  dropped.
+   *
+   *  The clock only moves when advance() is called or when wait() has to wait:
+   *  it then jumps to the first scripted event, or by the timeout when that
+   *  comes first. Runs are therefore deterministic and take no wall time. A
+   *  wakeup() makes the next wait return without moving the clock.
+   */
+  class SimulatedBackend : public PollBackend {
+  public:
+
+    /**
+     *  @param capacity the number of descriptors that can be polled.
+     */
+    SimulatedBackend(size_t capacity);
+
+    ~SimulatedBackend();
+
+    virtual size_t capacity() const;
+
+    virtual void add(int fd);
+
+    virtual void remove(int fd);
+
+    virtual void close(int fd);
+
+    virtual size_t wait(Event *events, size_t size, int timeout);
+
+    virtual void wakeup();
+
+    virtual std::chrono::steady_clock::time_point now() const;
+
+    /**
+     *  Moves the virtual clock forward.
+     */
+    void advance(std::chrono::steady_clock::duration duration);
+
+    /**
+     *  Signals readiness of the descriptor now.
+     *
+     *  @param events the Poll::EventMask events.
+     */
+    void signal(int fd, uint32_t events);
+
+    /**
+     *  Scripts readiness of the descriptor at a virtual time, events scripted
+     *  for the same time are delivered in the order they were scripted.
+     *
+     *  @param events the Poll::EventMask events.
+     */
+    void signalAt(std::chrono::steady_clock::time_point time, int fd, uint32_t events);
+
+    /**
+     *  @return true when the descriptor is polled.
+     */
+    bool polled(int fd) const;
+
+    /**
+     *  @return the number of descriptors closed through close().
+     */
+    uint64_t closed() const;
+
+    /**
+     *  @return the number of scripted events that are not due yet.
+     */
+    size_t scripted() const;
+
+  private:
+
+    struct Internal;
+    std::unique_ptr<Internal> d;
+
+  };
+
+}
+
+#endif // __INC_PLAIN_SIMULATEDBACKEND_H__
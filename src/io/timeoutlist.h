@@ -0,0 +1,150 @@
+#ifndef __INC_PLAIN_TIMEOUTLIST_H__
+#define __INC_PLAIN_TIMEOUTLIST_H__
+
+#include <mutex>
+#include <chrono>
+
+namespace plain {
+
+  /**
+   *  Intrusive doubly linked list of entries with a fixed timeout.
+   *
+   *  Because every entry gets the same timeout, entries are added at the back and
+   *  the list stays ordered by deadline, so all operations are O(1).
+   *
+   *  T should have the fields:
+   *
+   *    T *timeoutNext;
+   *    T *timeoutPrev;
+   *    std::chrono::steady_clock::time_point timeout;
+   *
+   *  The link fields should be NULL before an entry is first added.
+   */
+  template<class T>
+  class TimeoutList {
+
+    std::recursive_mutex d_mutex;
+
+    T *d_head;
+    T *d_tail;
+
+    // The timeout of all entries.
+    std::chrono::steady_clock::duration d_timeout;
+
+  public:
+
+    /**
+     *  @param timeout the time after which an added entry times out.
+     */
+    TimeoutList(std::chrono::steady_clock::duration timeout)
+      : d_head(NULL), d_tail(NULL), d_timeout(timeout)
+    {
+    }
+
+    /**
+     *  Sets the timeout of entries added from now on, entries already in the list keep their deadline.
+     */
+    void setTimeout(std::chrono::steady_clock::duration timeout)
+    {
+      std::lock_guard<std::recursive_mutex> lk(d_mutex);
+      d_timeout = timeout;
+    }
+
+    /**
+     *  @return the entry that times out first, or NULL when the list is empty.
+     */
+    T *head() const { return d_head; }
+
+    /**
+     *  Adds the entry to the back of the list with a new deadline, if it is not already in the list.
+     *
+     *  @param now the current time, the deadline is relative to it.
+     */
+    void add(T *entry, std::chrono::steady_clock::time_point const &now)
+    {
+      std::lock_guard<std::recursive_mutex> lk(d_mutex);
+
+      if (d_head != entry && entry->timeoutPrev == NULL) {
+	entry->timeout = now + d_timeout;
+	pushBack(entry);
+      }
+    }
+
+    /**
+     *  Removes the entry from the list, if it is in the list.
+     */
+    void remove(T *entry)
+    {
+      std::lock_guard<std::recursive_mutex> lk(d_mutex);
+
+      if (d_head == entry) {
+	d_head = entry->timeoutNext;
+
+	if (d_head != NULL) {
+	  d_head->timeoutPrev = NULL;
+	} else {
+	  d_tail = NULL;
+	}
+      } else if (entry->timeoutPrev != NULL) {
+	entry->timeoutPrev->timeoutNext = entry->timeoutNext;
+	if (entry->timeoutNext != NULL) {
+	  entry->timeoutNext->timeoutPrev = entry->timeoutPrev;
+	} else {
+	  d_tail = entry->timeoutPrev;
+	}
+      }
+
+      entry->timeoutNext = NULL;
+      entry->timeoutPrev = NULL;
+    }
+
+    /**
+     *  Removes the first entry if it expired.
+     *
+     *  @param t the current time.
+     *  @return the expired entry, or NULL when no entry expired.
+     */
+    T *pop(std::chrono::steady_clock::time_point const &t)
+    {
+      std::lock_guard<std::recursive_mutex> lk(d_mutex);
+
+      T *front = NULL;
+
+      if (d_head != NULL && d_head->timeout < t) {
+	front = d_head;
+
+	d_head = d_head->timeoutNext;
+
+	if (d_head != NULL) {
+	  d_head->timeoutPrev = NULL;
+	} else {
+	  d_tail = NULL;
+	}
+
+	front->timeoutNext = NULL;
+      }
+
+      return front;
+    }
+
+  private:
+
+    // Add entry to the back of the list.
+    void pushBack(T *entry)
+    {
+      entry->timeoutPrev = d_tail;
+      entry->timeoutNext = NULL;
+
+      if (d_head == NULL) {
+	d_head = d_tail = entry;
+      } else {
+	d_tail->timeoutNext = entry;
+	d_tail = entry;
+      }
+    }
+
+  };
+
+}
+
+#endif // __INC_PLAIN_TIMEOUTLIST_H__
@@ -1,45 +1,113 @@
 #include "core/main.h"
 #include "core/application.h"
+#include "core/log.h"
+#include "core/metrics.h"
+#include "core/workerpool.h"
+#include "core/task.h"
+#include "io/awaitables.h"
 #include "io/poll.h"
 #include "io/socketpair.h"
 #include "net/httpserver.h"
 #include "net/httprequesthandler.h"
 #include "net/httprequest.h"
+#include "net/accesslog.h"
+#include "net/requestcapture.h"
 
 #include <memory>
+#include <string>
 #include <iostream>
 #include <thread>
 #include <chrono>
 
+#include <stdlib.h>
 #include <unistd.h>
 
 #include <cstring>
 
 char s_pageNotFound[] = "HTTP 404 Not Found\r\nContent-Length: 35\r\nConnection: keep-alive\r\n\r\n<HTML><BODY>Not Found</BODY></HTML>\0";
 
+char s_serviceUnavailable[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n";
+
 class RequestHandler : public plain::HttpRequestHandler {
+
+  // Used to sample the requests that get a Server-Timing header.
+  size_t d_requestCount = 0;
+
+  // The files are served from here, PLAIN_DATA overrides it.
+  std::string d_dataDirectory;
+
+  // Runs the blocking part of deferred requests.
+  plain::WorkerPool d_workers;
+
 public:
 
+  RequestHandler()
+    : d_dataDirectory(getenv("PLAIN_DATA") != NULL ? getenv("PLAIN_DATA") : "/home/mart/Devel/plain/data")
+  {
+  }
+
   virtual void request(plain::HttpRequest const &request)
   {
     //respondWithStaticString(request, s_pageNotFound, sizeof(s_pageNotFound));
 
-    std::cout << "Request: " << request.uri() << ".\n";
+    LOG_DEBUG("Request: %s.", request.uri());
+
+    // Report the server side timing for one in every 64 requests.
+    if (d_requestCount++ % 64 == 0) {
+      enableServerTiming(request);
+    }
     
     if (std::strcmp(request.uri(), "/lost.mkv") == 0) {
 
-      respondWithFile(request, "/home/mart/Devel/plain/data/lost0102.mkv");
+      respondWithFile(request, d_dataDirectory + "/lost0102.mkv");
+
+    } else if (std::strcmp(request.uri(), "/deferred") == 0) {
+      // Check the file on a worker and respond when the result is back on the loop.
+      plain::HttpResponseToken token = defer(request);
+      std::string path = d_dataDirectory + "/test.html";
+      std::shared_ptr<bool> found = std::make_shared<bool>(false);
+
+      bool submitted = d_workers.submit([path, found]() {
+	  *found = access(path.c_str(), R_OK) == 0;
+	}, [token, path, found]() {
+	  if (*found) {
+	    token.respondWithFile(path);
+	  } else {
+	    token.drop();
+	  }
+	});
+
+      if (!submitted) {
+	token.respondWithStaticString(s_serviceUnavailable, sizeof(s_serviceUnavailable) - 1);
+      }
+
+    } else if (std::strcmp(request.uri(), "/coroutine") == 0) {
+      // The same as /deferred, written as a coroutine.
+      respondChecked(defer(request), d_dataDirectory + "/test.html").detach();
 
     } else if (std::strcmp(request.uri(), "/exit") == 0) {
       plain::Main::instance().stop(1);
       drop(request);
     } else {
     
-      respondWithFile(request, "/home/mart/Devel/plain/data/test.html");
+      respondWithFile(request, d_dataDirectory + "/test.html");
 
     }
   }
 
+  plain::Task<> respondChecked(plain::HttpResponseToken token, std::string path)
+  {
+    bool found = false;
+
+    if (!co_await plain::offload(d_workers, [&]() { found = access(path.c_str(), R_OK) == 0; })) {
+      token.respondWithStaticString(s_serviceUnavailable, sizeof(s_serviceUnavailable) - 1);
+    } else if (found) {
+      token.respondWithFile(path);
+    } else {
+      token.drop();
+    }
+  }
+
 };
 
 class App : public plain::Application {
@@ -152,6 +220,19 @@ public:
 
     d_httpServer = std::make_shared<plain::HttpServer>(d_port, std::make_shared<RequestHandler>());
 
+    // Serve the server metrics.
+    d_httpServer->setStatusUri("/status");
+
+    // Optionally write an access log.
+    if (argc > 2) {
+      d_httpServer->setAccessLog(std::make_shared<plain::AccessLog>(argv[2]));
+    }
+
+    // Optionally capture the request headers, for replay with plain-bench -R.
+    if (argc > 3) {
+      d_httpServer->setRequestCapture(std::make_shared<plain::RequestCapture>(argv[3]));
+    }
+
     /*
     d_thread0 = std::thread([this]()
 			    {
@@ -166,6 +247,12 @@ public:
     std::cout << "-- destroy --\n";
     std::cout << "Bytes written: " << bytesWritten << ".\n";
     std::cout << "Bytes read: " << bytesRead << ".\n";
+
+    // Dump the request latency distribution.
+    std::string histograms;
+    plain::Metrics::instance().renderHistograms(histograms);
+    std::cout << histograms;
+
     d_httpServer.reset();
     //    d_thread0.join();
   }
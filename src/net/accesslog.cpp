@@ -0,0 +1,283 @@
+#include "accesslog.h"
+#include "http.h"
+#include "core/ringbuffer.h"
+#include "core/log.h"
+
+#include "exceptions/errnoexception.h"
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+using namespace plain;
+
+static_assert(sizeof(AccessLog::Record) == 128, "access log records should stay compact");
+
+struct AccessLog::Internal {
+
+  enum {
+    // The number of records in the ring buffer.
+    RING_SIZE = 8192,
+
+    // The interval in milliseconds at which the background thread drains the ring buffer.
+    FLUSH_INTERVAL = 100,
+
+    // The size of the output buffer of the background thread.
+    OUTPUT_BUFFER_SIZE = 64 * 1024,
+
+    // The maximum length of a rendered line.
+    MAX_LINE_LENGTH = 256,
+  };
+
+  // The record ring buffer.
+  RingBuffer<Record, RING_SIZE> d_ring;
+
+  // Number of records dropped because the ring was full.
+  std::atomic<size_t> d_dropped;
+
+  // Set when the log file should be reopened.
+  std::atomic<bool> d_reopen;
+
+  // The log file, only used by the background thread after construction.
+  std::string d_path;
+  size_t d_maxFileSize;
+  size_t d_fileSize;
+  int d_fd;
+
+  // Output buffer of the background thread.
+  char d_output[OUTPUT_BUFFER_SIZE];
+  size_t d_outputFill;
+
+  // The background thread.
+  std::mutex d_threadMutex;
+  std::condition_variable d_threadCondition;
+  bool d_running;
+  std::thread d_thread;
+
+  Internal(std::string const &path, size_t maxFileSize)
+    : d_dropped(0),
+      d_reopen(false),
+      d_path(path),
+      d_maxFileSize(maxFileSize),
+      d_fileSize(0),
+      d_fd(-1),
+      d_outputFill(0),
+      d_running(true)
+  {
+    open();
+
+    d_thread = std::thread(&Internal::run, this);
+  }
+
+  ~Internal()
+  {
+    {
+      std::lock_guard<std::mutex> lk(d_threadMutex);
+      d_running = false;
+    }
+
+    d_threadCondition.notify_one();
+    d_thread.join();
+
+    drain();
+
+    if (d_fd != -1) {
+      ::close(d_fd);
+    }
+  }
+
+  void open()
+  {
+    int fd = ::open(d_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (fd == -1) {
+      throw ErrnoException(errno);
+    }
+
+    if (d_fd != -1) {
+      ::close(d_fd);
+    }
+
+    d_fd = fd;
+    d_fileSize = lseek(fd, 0, SEEK_END);
+  }
+
+  // Renames the current log file and starts a new one.
+  void rotate()
+  {
+    std::string rotated = d_path + ".1";
+
+    if (rename(d_path.c_str(), rotated.c_str()) == -1) {
+      LOG_WARNING("Failed to rotate access log %s: %s.", d_path.c_str(), strerror(errno));
+    }
+
+    reopen();
+  }
+
+  // Reopens the log file, keeps the old one on failure.
+  void reopen()
+  {
+    try {
+      open();
+    } catch (std::exception const &e) {
+      LOG_WARNING("Failed to reopen access log %s: %s.", d_path.c_str(), e.what());
+    }
+  }
+
+  void writeOutput()
+  {
+    char const *head = d_output;
+    char const *end = d_output + d_outputFill;
+
+    while (head != end) {
+      ssize_t ret = ::write(d_fd, head, end - head);
+
+      if (ret == -1) {
+	if (errno == EINTR) {
+	  continue;
+	}
+
+	LOG_WARNING("Failed to write access log: %s.", strerror(errno));
+	break;
+      }
+
+      head += ret;
+    }
+
+    d_fileSize += d_outputFill;
+    d_outputFill = 0;
+
+    if (d_maxFileSize != 0 && d_fileSize >= d_maxFileSize) {
+      rotate();
+    }
+  }
+
+  static char const *methodName(uint16_t method)
+  {
+    switch (method) {
+    case Http::METHOD_GET: return "GET";
+    case Http::METHOD_PUT: return "PUT";
+    case Http::METHOD_POST: return "POST";
+    default: return "-";
+    };
+  }
+
+  // Renders a record in the Common Log Format.
+  void render(Record const &record)
+  {
+    if (OUTPUT_BUFFER_SIZE - d_outputFill < MAX_LINE_LENGTH) {
+      writeOutput();
+    }
+
+    char address[INET_ADDRSTRLEN] = "-";
+    if (record.address != 0) {
+      inet_ntop(AF_INET, &record.address, address, sizeof(address));
+    }
+
+    time_t seconds = record.time / 1000000;
+    tm t;
+    localtime_r(&seconds, &t);
+
+    char date[32];
+    strftime(date, sizeof(date), "%d/%b/%Y:%H:%M:%S %z", &t);
+
+    char status[8] = "-";
+    if (record.status != 0) {
+      snprintf(status, sizeof(status), "%u", record.status);
+    }
+
+    char bytes[24] = "-";
+    if (record.bytesSent != 0) {
+      snprintf(bytes, sizeof(bytes), "%llu", static_cast<unsigned long long>(record.bytesSent));
+    }
+
+    int ret = snprintf(d_output + d_outputFill, OUTPUT_BUFFER_SIZE - d_outputFill,
+		       "%s - - [%s] \"%s %.*s HTTP/%u.%u\" %s %s\n",
+		       address,
+		       date,
+		       methodName(record.method),
+		       static_cast<int>(std::min<size_t>(record.uriLength, URI_LENGTH)), record.uri,
+		       record.version >> 8, record.version & 0xff,
+		       status,
+		       bytes);
+
+    if (ret > 0) {
+      d_outputFill += std::min<size_t>(ret, OUTPUT_BUFFER_SIZE - d_outputFill - 1);
+    }
+  }
+
+  void drain()
+  {
+    for (Record *record = d_ring.front(); record != NULL; record = d_ring.front()) {
+      render(*record);
+      d_ring.pop();
+    }
+
+    writeOutput();
+  }
+
+  void run()
+  {
+    std::unique_lock<std::mutex> lk(d_threadMutex);
+
+    while (d_running) {
+      d_threadCondition.wait_for(lk, std::chrono::milliseconds(FLUSH_INTERVAL));
+
+      lk.unlock();
+
+      if (d_reopen.exchange(false)) {
+	reopen();
+      }
+
+      drain();
+
+      lk.lock();
+    }
+  }
+
+};
+
+AccessLog::AccessLog(std::string const &path, size_t maxFileSize)
+  : d(new Internal(path, maxFileSize))
+{
+}
+
+AccessLog::~AccessLog()
+{
+}
+
+AccessLog::Record *AccessLog::reserve()
+{
+  Record *record = d->d_ring.reserve();
+
+  if (record == NULL) {
+    d->d_dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  return record;
+}
+
+void AccessLog::commit()
+{
+  d->d_ring.commit();
+}
+
+void AccessLog::reopen()
+{
+  d->d_reopen = true;
+}
+
+size_t AccessLog::dropped() const
+{
+  return d->d_dropped.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,114 @@
+#ifndef __INC_PLAIN_ACCESSLOG_H__
+#define __INC_PLAIN_ACCESSLOG_H__
+
+#include <memory>
+#include <string>
+
+#include <stdint.h>
+
+namespace plain {
+
+  /**
+   *  Access log with off-thread formatting.
+   *
+   *  The server thread fills in a fixed size binary record per request in a lock
+   *  free ring buffer. A background thread renders the records in the Common Log
+   *  Format and writes them to the log file. The background thread also takes care
+   *  of rotating the log file, so the server thread never blocks on the log.
+   *
+   *  Note: there should only be a single thread filling in records.
+   */
+  class AccessLog {
+  public:
+
+    enum {
+      // The maximum number of URI bytes that are stored in a record.
+      URI_LENGTH = 88,
+    };
+
+    /**
+     *  The binary access log record.
+     */
+    struct Record {
+      // The wall clock time at which the response was done, in microseconds since the epoch.
+      uint64_t time;
+
+      // The number of bytes sent to the client, including the response headers.
+      uint64_t bytesSent;
+
+      // The IPv4 address of the client in network byte order.
+      uint32_t address;
+
+      // The file descriptor of the connection.
+      int32_t fd;
+
+      // The request method (Http::Method).
+      uint16_t method;
+
+      // The request version (Http::Version).
+      uint16_t version;
+
+      // The response status code, zero when unknown.
+      uint16_t status;
+
+      // The length of the request URI, this can be larger than URI_LENGTH.
+      uint16_t uriLength;
+
+      // The time in microseconds between the first byte of the request and the end of the header.
+      uint32_t headerTime;
+
+      // The time in microseconds between the end of the header and the last byte of the response.
+      uint32_t responseTime;
+
+      // The request URI, truncated to URI_LENGTH bytes.
+      char uri[URI_LENGTH];
+    };
+
+    /**
+     *  Opens the access log.
+     *
+     *  @param path the path of the log file, it is appended to.
+     *  @param maxFileSize the size in bytes at which the log file is rotated to path.1,
+     *                     zero disables size based rotation.
+     *
+     *  @throw ErrnoException when the file cannot be opened.
+     */
+    AccessLog(std::string const &path, size_t maxFileSize = 0);
+
+    ~AccessLog();
+
+    /**
+     *  Reserve the next record.
+     *
+     *  @return the record to fill in or NULL when the ring buffer is full, in which
+     *          case the request is counted as dropped.
+     */
+    Record *reserve();
+
+    /**
+     *  Publish the record returned by reserve() to the background thread.
+     */
+    void commit();
+
+    /**
+     *  Request the log file to be reopened, for use with external log rotation.
+     *
+     *  This only sets a flag, so it is safe to call from any thread (or signal handler).
+     */
+    void reopen();
+
+    /**
+     *  @return the number of records dropped because the ring buffer was full.
+     */
+    size_t dropped() const;
+
+  private:
+
+    struct Internal;
+    std::unique_ptr<Internal> d;
+
+  };
+
+}
+
+#endif // __INC_PLAIN_ACCESSLOG_H__
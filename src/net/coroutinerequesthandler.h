@@ -0,0 +1,53 @@
+#ifndef __INC_PLAIN_COROUTINEREQUESTHANDLER_H__
+#define __INC_PLAIN_COROUTINEREQUESTHANDLER_H__
+
+#include "httprequesthandler.h"
+#include "core/task.h"
+#include "core/log.h"
+
+namespace plain {
+
+  /**
+   *  A request handler written as a coroutine.
+   *
+   *  Every request is deferred and handed to handle(), which runs as a
+   *  detached Task on the poll loop. It can co_await the awaitables of
+   *  io/awaitables.h and completes the request through the token. The token
+   *  is dropped when handle() fails, which does nothing when it was completed.
+   */
+  class CoroutineRequestHandler : public HttpRequestHandler {
+  public:
+
+    /**
+     *  Should handle a HTTP request, the request stays valid until the token
+     *  is completed.
+     */
+    virtual Task<> handle(HttpRequest const &request, HttpResponseToken token) = 0;
+
+    virtual void request(HttpRequest const &request)
+    {
+      HttpResponseToken token = defer(request);
+
+      run(handle(request, token), token).detach();
+    }
+
+  private:
+
+    static Task<> run(Task<> task, HttpResponseToken token)
+    {
+      try {
+	co_await std::move(task);
+      } catch (std::exception const &e) {
+	LOG_ERROR("Handling a request failed: %s.", e.what());
+	token.drop();
+      } catch (...) {
+	LOG_ERROR("Handling a request failed.");
+	token.drop();
+      }
+    }
+
+  };
+
+}
+
+#endif // __INC_PLAIN_COROUTINEREQUESTHANDLER_H__
@@ -1,12 +1,18 @@
 #include "http.h"
 #include "httprequest.h"
+#include "core/log.h"
 
-#include <iostream>
 #include <unordered_map>
+#include <algorithm>
 #include <cstring>
 
 using namespace plain;
 
+enum {
+  // The end of header marker.
+  END_OF_HEADER_MARKER = ('\r' | '\n' << 8 | '\r' << 16 | '\n' << 24),
+};
+
 class HttpInternal {
 
   // Table used for translating header field names to enumeration values.
@@ -130,7 +136,7 @@ public:
 	throw std::runtime_error("malformed headers");
       }
 
-      std::cout << key << "=" << value << ".\n";
+      LOG_TRACE("%s=%s.", key, value);
 
       switch (lookupHeaderField(key)) {
       case Http::HEADER_FIELD_HOST: parseHeaderFieldHost(request, value); break;
@@ -179,6 +185,27 @@ HttpInternal &HttpInternal::instance()
   return s_instance;
 }
 
+int Http::findEndOfHeader(char const *buffer, size_t offset, size_t count)
+{
+  size_t marg = std::min<size_t>(offset, 4);
+  offset -= marg;
+  count += marg;
+
+  if (count < 4) {
+    return -1;
+  }
+
+  // Run through all data in the buffer, searching for the end of header sequence.
+  char const *end = buffer + offset + count - 3;
+  for (char const *i = buffer + offset; i != end; ++i) {
+    if (*reinterpret_cast<uint32_t const *>(i) == END_OF_HEADER_MARKER) {
+      return i - buffer;
+    }
+  }
+
+  return -1;
+}
+
 void Http::parseHttpRequestHeaders(HttpRequest &request, char *buffer, size_t length)
 {
   HttpInternal::instance().parseHttpRequestHeaders(request, buffer, length);
@@ -76,6 +76,17 @@ namespace plain {
       };
     }
 
+    /**
+     *  Searches for the end of header sequence ("\r\n\r\n") in newly received data.
+     *
+     *  @param buffer the receive buffer.
+     *  @param offset the offset of the new data, the search starts a few bytes earlier
+     *                so a sequence split over two reads is found.
+     *  @param count the number of new bytes.
+     *  @return the offset of the sequence in the buffer, or -1 when it is not found.
+     */
+    static int findEndOfHeader(char const *buffer, size_t offset, size_t count);
+
     static void parseHttpRequestHeaders(HttpRequest &req, char *buffer, size_t length);
     
     /**
@@ -146,6 +157,18 @@ namespace plain {
 	print("%s: %llu\r\n\r\n", key.c_str(), value);
 	d_size -= 2;	
       }
+
+      /**
+       *  Adds a string typed header field to the headers, without constructing strings.
+       *
+       *  @param key the header field name.
+       *  @param value the header field value.
+       */
+      void addHeaderField(char const *key, char const *value)
+      {
+	print("%s: %s\r\n\r\n", key, value);
+	d_size -= 2;
+      }
       
     };
 
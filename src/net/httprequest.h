@@ -2,6 +2,7 @@
 #define __INC_PLAIN_HTTPREQUEST_H__
 
 #include "http.h"
+#include "core/arena.h"
 
 namespace plain {
 
@@ -9,6 +10,8 @@ namespace plain {
 
     int d_fd;
 
+    Arena *d_arena;
+
     Http::Method d_method;
     char const *d_uri;
     Http::Version d_version;
@@ -25,6 +28,16 @@ namespace plain {
     int fd() const { return d_fd; }
 
     void setFd(int fd) { d_fd = fd; }
+
+    /**
+     *  \return the request scoped arena.
+     *
+     *  Memory allocated from the arena stays valid until the response is done,
+     *  after which the arena is reset together with the request.
+     */
+    Arena &arena() const { return *d_arena; }
+
+    void setArena(Arena *arena) { d_arena = arena; }
     
     /**
      *  \return the request method.
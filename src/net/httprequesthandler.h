@@ -1,6 +1,8 @@
 #ifndef __INC_PLAIN_HTTPREQUESTHANDLER_H__
 #define __INC_PLAIN_HTTPREQUESTHANDLER_H__
 
+#include "httpresponsetoken.h"
+
 namespace plain {
 
   // Forward declaration.
@@ -42,6 +44,13 @@ namespace plain {
       }
     }
 
+    void respondWithFile(HttpRequest const &request, std::string_view path)
+    {
+      if (d_server) {
+	d_server->respondWithFile(request, path);
+      }
+    }
+
     void drop(HttpRequest const &request)
     {
       if (d_server) {
@@ -49,6 +58,22 @@ namespace plain {
       }
     }
 
+    void enableServerTiming(HttpRequest const &request)
+    {
+      if (d_server) {
+	d_server->enableServerTiming(request);
+      }
+    }
+
+    HttpResponseToken defer(HttpRequest const &request)
+    {
+      if (d_server) {
+	return d_server->defer(request);
+      }
+
+      return HttpResponseToken();
+    }
+
   };
 
 }
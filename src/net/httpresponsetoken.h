@@ -0,0 +1,89 @@
+#ifndef __INC_PLAIN_HTTPRESPONSETOKEN_H__
+#define __INC_PLAIN_HTTPRESPONSETOKEN_H__
+
+#include "httpserver.h"
+
+#include <string>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace plain {
+
+  /**
+   *  A deferred response to a request, as returned by HttpServer::defer().
+   *
+   *  The token is a small value that can be copied to other threads and
+   *  completed from there. It identifies the request by its descriptor and a
+   *  generation counter that changes with every request, so only the first
+   *  completion of a request is used and any later one is ignored.
+   *
+   *  Note: a deferred request should be completed within the connection
+   *        timeout, drop() it when there is no response. The server should
+   *        outlive its tokens.
+   */
+  class HttpResponseToken {
+
+    HttpServer *d_server;
+    int d_fd;
+    uint32_t d_generation;
+
+  public:
+
+    HttpResponseToken()
+      : d_server(NULL), d_fd(-1), d_generation(0) {}
+
+    HttpResponseToken(HttpServer *server, int fd, uint32_t generation)
+      : d_server(server), d_fd(fd), d_generation(generation) {}
+
+    /**
+     *  @return false for a default constructed token.
+     */
+    bool valid() const { return d_server != NULL; }
+
+    /**
+     *  @return the descriptor of the connection of the request.
+     */
+    int fd() const { return d_fd; }
+
+    /**
+     *  @return the generation of the request.
+     */
+    uint32_t generation() const { return d_generation; }
+
+    /**
+     *  Sends a static string as the response, the string should stay valid
+     *  until the response is sent.
+     */
+    void respondWithStaticString(char const *str, size_t length) const
+    {
+      if (d_server) {
+	d_server->respondWithStaticString(*this, str, length);
+      }
+    }
+
+    /**
+     *  Sends the content of a file as the response.
+     */
+    void respondWithFile(std::string const &path) const
+    {
+      if (d_server) {
+	d_server->respondWithFile(*this, path);
+      }
+    }
+
+    /**
+     *  Closes the connection without a response.
+     */
+    void drop() const
+    {
+      if (d_server) {
+	d_server->drop(*this);
+      }
+    }
+
+  };
+
+}
+
+#endif // __INC_PLAIN_HTTPRESPONSETOKEN_H__
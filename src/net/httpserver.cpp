@@ -2,9 +2,16 @@
 #include "io/poll.h"
 #include "io/iohelper.h"
 #include "core/main.h"
+#include "core/log.h"
+#include "core/metrics.h"
+#include "core/workerpool.h"
+#include "core/probes.h"
 #include "http.h"
 #include "httprequest.h"
 #include "httprequesthandler.h"
+#include "httpresponsetoken.h"
+#include "accesslog.h"
+#include "requestcapture.h"
 
 #include "exceptions/errnoexception.h"
 
@@ -14,6 +21,11 @@
 #include <netinet/tcp.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <sys/mman.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/openat2.h>
 #include <fcntl.h>
 #include <poll.h>
 #include <unistd.h>
@@ -21,11 +33,17 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 
+#include <stdio.h>
 #include <string.h>
 
 #include <iostream>
 #include <iomanip>
 #include <unordered_map>
+#include <algorithm>
+#include <map>
+#include <tuple>
+#include <vector>
+#include <chrono>
 
 /** TODO: rename to HttpServer. */
 
@@ -41,34 +59,133 @@ enum {
   // Try to accept up to this number of connections per io event.
   DEFAULT_ACCEPTS_PER_EVENT = 16,
 
-  // The end of header marker.
-  END_OF_HEADER_MARKER = ('\r' | '\n' << 8 | '\r' << 16 | '\n' << 24),
-
   DEFAULT_PIPE_BUFFER_SIZE = 1 * 1024 * 1024,
   
   DEFAULT_CHUNK_SIZE = DEFAULT_PIPE_BUFFER_SIZE, //65536, //1 * 1024 * 1024,
   
   DEFAULT_SPLICE_COUNT = 8,
+
+  // The number of threads that open the files of responses and read their cold ranges.
+  DEFAULT_FILE_THREADS = 2,
+
+  // Files of at least this size are checked for ranges that are not in the page cache.
+  DEFAULT_PREFETCH_THRESHOLD = 256 * 1024,
+
+  // Files of at least this size are dropped from the page cache behind the transfer.
+  DEFAULT_DROP_BEHIND_THRESHOLD = 64 * 1024 * 1024,
+
+  // Files of at least this size that are requested at the same time are read once.
+  DEFAULT_FAN_OUT_THRESHOLD = 8 * 1024 * 1024,
+
+  // The maximum number of pages checked per mincore call.
+  MAX_CHECKED_PAGES = 256,
+
+  // The read ahead window holds this much of the transfer at its drain rate.
+  READ_AHEAD_MILLISECONDS = 500,
+
+  // The drain rate of a transfer is sampled at most this often, and a sample
+  // weighs 1 / RATE_SMOOTHING in the average.
+  RATE_SAMPLE_MILLISECONDS = 100,
+  RATE_SMOOTHING = 4,
+
+  MAX_READ_AHEAD_WINDOW = 32 * 1024 * 1024,
+
+  // The size of a new pipe, the smallest size the pipes of transfers are sized to.
+  MIN_PIPE_SIZE = 64 * 1024,
+
+  // The pipe of a transfer is sized to hold this much at the rate the client drains it.
+  PIPE_MILLISECONDS = 100,
+
+  // The pipe of a transfer is sized again every time this many bytes were transfered.
+  PIPE_TUNE_INTERVAL = 8 * 1024 * 1024,
+
+  // The pages still referenced by the pipe and socket buffers can not be
+  // dropped, so dropping stays this far behind the transfer.
+  DROP_BEHIND_LAG = 8 * 1024 * 1024,
+
+  // The size of the request scoped arena in bytes.
+  DEFAULT_ARENA_SIZE = 4096,
+
+  // The maximum length of a file path, including the terminating zero.
+  MAX_PATH_LENGTH = 4096,
 };
 
 enum State {
-  HTTP_STATE_CONNECTION_ACCEPTED = 0,
-  HTTP_STATE_HEADER_RECEIVED = 1,
-  HTTP_STATE_SENDING_RESPONSE = 2,
+  // Not connected, this is the state of a zeroed context.
+  HTTP_STATE_CLOSED = 0,
+  HTTP_STATE_CONNECTION_ACCEPTED = 1,
+  HTTP_STATE_HEADER_RECEIVED = 2,
+  // The response is deferred, the connection only waits for the timeout until it is completed.
+  HTTP_STATE_DEFERRED = 3,
+  // The file of the response is being opened on the file pool.
+  HTTP_STATE_OPENING_FILE = 4,
+  HTTP_STATE_SENDING_RESPONSE = 5,
+  HTTP_STATE_COUNT,
 };
 
+// The responses for a file that can not be opened.
+static char const s_notFound[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n";
+static char const s_forbidden[] = "HTTP/1.1 403 Forbidden\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n";
+static char const s_internalError[] = "HTTP/1.1 500 Internal Server Error\r\nContent-Length: 0\r\nConnection: keep-alive\r\n\r\n";
+
 
 /*
- *  This contains the client connection context.
+ *  The file of a response, opened on the loop or on the file pool.
+ */
+struct OpenedFile {
+  // The file, -1 when opening failed with error.
+  int fd = -1;
+  int error = 0;
+
+  size_t size = 0;
+  dev_t device = 0;
+  ino_t inode = 0;
+
+  std::chrono::steady_clock::time_point openStart;
+  std::chrono::steady_clock::time_point openEnd;
+};
+
+/*
+ *  A file that is read once for several concurrent transfers, the blocks that
+ *  are read into the pipe are duplicated into the pipes of the transfers with
+ *  tee. See HttpServer::Internal::pumpFanOut().
+ */
+struct FanOut {
+  // Identifies the file, together with its size.
+  dev_t device;
+  ino_t inode;
+  size_t size;
+
+  // A duplicate of the descriptor of the first transfer, its client context
+  // has the read position.
+  int fileFd;
+
+  // The pipe the file is read into, a block at a time.
+  int pipeFds[2];
+  size_t blockSize;
+
+  // The number of bytes of the current block in the pipe.
+  size_t buffered;
+
+  // Transfers can only join before the first block is read.
+  bool started;
+
+  // Set while a cold block is read on the file pool.
+  bool prefetching;
+
+  // The pipe write descriptors of the transfers.
+  std::vector<int> subscribers;
+};
+
+/*
+ *  The part of the client connection context that is zeroed when the
+ *  connection is reset, see ClientContext.
  */
-struct ClientContext {
+struct ClientState {
 
   // The current state of the connection.
   State state;
 
-  // The client connection buffer.
-  char buffer[DEFAULT_BUFFER_SIZE + 4] __attribute__((aligned(16)));
-
   // The current fill of the buffer in bytes.
   size_t bufferFill;
 
@@ -84,8 +201,91 @@ struct ClientContext {
   int sourceFd;
   int destinationFd;
 
+  // Set when the file of the current response is sent with sendfile, in which
+  // case sourceFd is the file instead of a pipe.
+  bool sendFile;
+
+  // The mapping of a large file that is transfered from sourceFd, only used to
+  // find its pages that are not in the page cache. NULL when it is not checked.
+  void *fileMap;
+  size_t fileMapSize;
+
+  // Set while the range at the transfer position is read on the file pool, and
+  // until the next attempt, which transfers it without checking. A range past
+  // the end of a truncated file never gets cached, the transfer finds the end
+  // instead.
+  bool prefetched;
+
+  // The file that is transfered from sourceFd is read ahead up to readAheadEnd,
+  // and dropped from the page cache up to dropBehindEnd, when these are set.
+  // Reading ahead stops at fileSize, the size of the file at the start.
+  bool readAhead;
+  bool dropBehind;
+  size_t readAheadEnd;
+  size_t dropBehindEnd;
+  size_t fileSize;
+
+  // The rate the client drains the transfer at in bytes per second, a moving
+  // average of samples taken from rateSampleStart and rateSampleOffset. This is
+  // 0 until the first sample.
+  std::chrono::steady_clock::time_point rateSampleStart;
+  size_t rateSampleOffset;
+  double drainRate;
+
+  // The capacity of the pipe that is written to, for transfers from a file,
+  // and the position at which it is sized again.
+  size_t pipeSize;
+  size_t pipeTuneAt;
+
+  // The shared read the pipe of the transfer is filled by, NULL when the
+  // transfer reads the file itself.
+  FanOut *fanOut;
+
   // The length in bytes of the current content being transfered.
   size_t contentLength;
+
+  // The IPv4 address of the client in network byte order, kept over keep-alive requests.
+  uint32_t address;
+
+  // The sequence number of the connection, kept over keep-alive requests.
+  uint32_t connection;
+
+  // Incremented for every request on the descriptor, this tells deferred
+  // responses of earlier requests apart.
+  uint32_t generation;
+
+  // Access log accounting, the uri is only kept when an access log is set.
+  uint16_t status;
+  size_t bytesSent;
+  char const *logUri;
+  size_t logUriLength;
+
+  // Request phase timestamps. The accept time is only set for the first request on a connection.
+  std::chrono::steady_clock::time_point accepted;
+  std::chrono::steady_clock::time_point requestStart;
+  std::chrono::steady_clock::time_point headerReceived;
+  std::chrono::steady_clock::time_point handlerReturned;
+  std::chrono::steady_clock::time_point firstByteWritten;
+
+  // Server-Timing accounting. The queue wait is the time the header read waited
+  // in the run queue, in nanoseconds.
+  bool serverTiming;
+  uint64_t queueWait;
+};
+
+/*
+ *  This contains the client connection context.
+ */
+struct ClientContext : ClientState {
+
+  // The request scoped arena, allocating from arenaBuffer.
+  Arena arena;
+
+  // The client connection buffer.
+  char buffer[DEFAULT_BUFFER_SIZE + 4] __attribute__((aligned(16)));
+
+  // The backing memory of the request scoped arena.
+  char arenaBuffer[DEFAULT_ARENA_SIZE] __attribute__((aligned(16)));
 };
 
 struct HttpServer::Internal {
@@ -110,21 +310,147 @@ struct HttpServer::Internal {
   // connection does not cause memory leaks.
   ClientContext *d_clientTable;
 
+  // The access log, can be NULL.
+  std::shared_ptr<AccessLog> d_accessLog;
+
+  // The request capture, can be NULL.
+  std::shared_ptr<RequestCapture> d_capture;
+
+  // The number of accepted connections, for the connection sequence numbers.
+  uint32_t d_connectionCount;
+
+  // The uri at which the metrics are served, empty when disabled.
+  std::string d_statusUri;
+
+  // The file transfer parameters.
+  TransferOptions d_transfer;
+
+  // Opens the files of responses and reads their cold ranges off the loop, NULL
+  // when this is done on the loop.
+  std::unique_ptr<WorkerPool> d_filePool;
+
+  // Replaced file pools that still had queued jobs, these are destroyed once
+  // the jobs ran so their connections do not wait for the timeout.
+  std::vector<std::unique_ptr<WorkerPool>> d_retiredFilePools;
+
+  // Cleared when the kernel does not support opens restricted to cached lookups.
+  bool d_cachedOpens;
+
+  // The pipe memory of the transfers in bytes, and the part of the pipe memory
+  // limit of the user that it stays within when pipes are grown.
+  size_t d_pipeBytes;
+  size_t d_pipeBudget;
+
+  // The largest pipe size an unprivileged process can set.
+  size_t d_pipeMaxSize;
+
+  // The shared reads that transfers can still join, by device, inode and size.
+  std::map<std::tuple<dev_t, ino_t, size_t>, FanOut*> d_fanOuts;
+
+  // The rendered metrics per connection that requested them, these need to stay
+  // alive while the response is being sent.
+  std::unordered_map<int, std::string> d_statusBodies;
+
+  // Metrics.
+  Metrics::Counter &d_acceptsMetric;
+  Metrics::Counter &d_acceptErrorsMetric;
+  Metrics::Counter &d_requestsMetric;
+  Metrics::Counter &d_timeoutsMetric;
+  Metrics::Counter &d_bytesWrittenMetric;
+  Metrics::Counter &d_bytesSplicedMetric;
+  Metrics::Counter &d_readAgainMetric;
+  Metrics::Counter &d_writeAgainMetric;
+  Metrics::Counter &d_spliceAgainMetric;
+  Metrics::Counter &d_bytesSentFileMetric;
+  Metrics::Counter &d_writeCallsMetric;
+  Metrics::Counter &d_spliceCallsMetric;
+  Metrics::Counter &d_sendFileCallsMetric;
+  Metrics::Counter &d_deferredMetric;
+  Metrics::Counter &d_deferredStaleMetric;
+  Metrics::Counter &d_openLoopMetric;
+  Metrics::Counter &d_openPoolMetric;
+  Metrics::Counter &d_prefetchesMetric;
+  Metrics::Counter &d_prefetchedBytesMetric;
+  Metrics::Counter &d_readAheadBytesMetric;
+  Metrics::Counter &d_droppedBytesMetric;
+  Metrics::Counter &d_fanOutsMetric;
+  Metrics::Counter &d_fanOutDropsMetric;
+  Metrics::Counter &d_bytesTeedMetric;
+  Metrics::Gauge &d_pipeBytesMetric;
+  Metrics::Counter &d_pipeResizeFailuresMetric;
+  Metrics::Gauge *d_connectionsMetric[HTTP_STATE_COUNT];
+
+  // Request phase latency histograms.
+  Metrics::Histogram &d_acceptPhaseMetric;
+  Metrics::Histogram &d_headerPhaseMetric;
+  Metrics::Histogram &d_handlerPhaseMetric;
+  Metrics::Histogram &d_firstBytePhaseMetric;
+  Metrics::Histogram &d_transferPhaseMetric;
+  Metrics::Histogram &d_totalPhaseMetric;
+
   Internal(int port, std::shared_ptr<HttpRequestHandler> const &requestHandler)
     : d_port(port),
       d_requestHandler(requestHandler),
       d_fd(-1),
       d_clientTableSize(0),
-      d_clientTable(NULL)
+      d_clientTable(NULL),
+      d_connectionCount(0),
+      d_cachedOpens(true),
+      d_pipeBytes(0),
+      d_acceptsMetric(Metrics::instance().counter("plain_http_accepts_total", "Number of accepted connections.")),
+      d_acceptErrorsMetric(Metrics::instance().counter("plain_http_accept_errors_total", "Number of failed accepts because of resource limits.")),
+      d_requestsMetric(Metrics::instance().counter("plain_http_requests_total", "Number of parsed requests.")),
+      d_timeoutsMetric(Metrics::instance().counter("plain_http_timeouts_total", "Number of connections closed because of a timeout.")),
+      d_bytesWrittenMetric(Metrics::instance().counter("plain_http_bytes_sent_total", "Number of bytes sent to clients.", "method=\"write\"")),
+      d_bytesSplicedMetric(Metrics::instance().counter("plain_http_bytes_sent_total", "Number of bytes sent to clients.", "method=\"splice\"")),
+      d_readAgainMetric(Metrics::instance().counter("plain_http_eagain_total", "Number of operations that returned EAGAIN.", "op=\"read\"")),
+      d_writeAgainMetric(Metrics::instance().counter("plain_http_eagain_total", "Number of operations that returned EAGAIN.", "op=\"write\"")),
+      d_spliceAgainMetric(Metrics::instance().counter("plain_http_eagain_total", "Number of operations that returned EAGAIN.", "op=\"splice\"")),
+      d_bytesSentFileMetric(Metrics::instance().counter("plain_http_bytes_sent_total", "Number of bytes sent to clients.", "method=\"sendfile\"")),
+      d_writeCallsMetric(Metrics::instance().counter("plain_http_transfer_calls_total", "Number of system calls transfering response data.", "op=\"write\"")),
+      d_spliceCallsMetric(Metrics::instance().counter("plain_http_transfer_calls_total", "Number of system calls transfering response data.", "op=\"splice\"")),
+      d_sendFileCallsMetric(Metrics::instance().counter("plain_http_transfer_calls_total", "Number of system calls transfering response data.", "op=\"sendfile\"")),
+      d_deferredMetric(Metrics::instance().counter("plain_http_deferred_total", "Number of deferred responses.")),
+      d_deferredStaleMetric(Metrics::instance().counter("plain_http_deferred_stale_total", "Number of ignored completions of deferred responses.")),
+      d_openLoopMetric(Metrics::instance().counter("plain_http_file_opens_total", "Number of response files opened.", "on=\"loop\"")),
+      d_openPoolMetric(Metrics::instance().counter("plain_http_file_opens_total", "Number of response files opened.", "on=\"pool\"")),
+      d_prefetchesMetric(Metrics::instance().counter("plain_http_prefetches_total", "Number of file ranges read on the file pool because they were not in the page cache.")),
+      d_prefetchedBytesMetric(Metrics::instance().counter("plain_http_prefetched_bytes_total", "Number of bytes read on the file pool because they were not in the page cache.")),
+      d_readAheadBytesMetric(Metrics::instance().counter("plain_http_read_ahead_bytes_total", "Number of bytes of large files read ahead of the transfer.")),
+      d_droppedBytesMetric(Metrics::instance().counter("plain_http_dropped_bytes_total", "Number of bytes of large files dropped from the page cache behind the transfer.")),
+      d_fanOutsMetric(Metrics::instance().counter("plain_http_fan_outs_total", "Number of files read once for several concurrent transfers.")),
+      d_fanOutDropsMetric(Metrics::instance().counter("plain_http_fan_out_drops_total", "Number of transfers that fell behind a shared read and continued on their own.")),
+      d_bytesTeedMetric(Metrics::instance().counter("plain_http_bytes_teed_total", "Number of bytes duplicated into the pipes of transfers with tee.")),
+      d_pipeBytesMetric(Metrics::instance().gauge("plain_http_pipe_bytes", "Number of bytes of the pipe buffers of file transfers.")),
+      d_pipeResizeFailuresMetric(Metrics::instance().counter("plain_http_pipe_resize_failures_total", "Number of pipe resizes that the kernel refused.")),
+      d_acceptPhaseMetric(Metrics::instance().histogram("plain_http_phase_seconds", "Duration of the request phases.", "phase=\"accept_to_header\"")),
+      d_headerPhaseMetric(Metrics::instance().histogram("plain_http_phase_seconds", "Duration of the request phases.", "phase=\"header\"")),
+      d_handlerPhaseMetric(Metrics::instance().histogram("plain_http_phase_seconds", "Duration of the request phases.", "phase=\"handler\"")),
+      d_firstBytePhaseMetric(Metrics::instance().histogram("plain_http_phase_seconds", "Duration of the request phases.", "phase=\"first_byte\"")),
+      d_transferPhaseMetric(Metrics::instance().histogram("plain_http_phase_seconds", "Duration of the request phases.", "phase=\"transfer\"")),
+      d_totalPhaseMetric(Metrics::instance().histogram("plain_http_phase_seconds", "Duration of the request phases.", "phase=\"total\""))
   {
+    static char const *stateNames[HTTP_STATE_COUNT] = { NULL, "reading", "handling", "deferred", "opening", "sending" };
+
+    // Closed connections are not counted.
+    d_connectionsMetric[HTTP_STATE_CLOSED] = NULL;
+
+    for (size_t i = HTTP_STATE_CONNECTION_ACCEPTED; i < HTTP_STATE_COUNT; ++i) {
+      d_connectionsMetric[i] = &Metrics::instance().gauge("plain_http_connections",
+							  "Number of client connections per state.",
+							  std::string("state=\"") + stateNames[i] + "\"");
+    }
+
     initializeClientTable();
     initializeServerSocket();
+    initializePipeLimits();
+    setTransferOptions(d_transfer);
   }
 
   ~Internal()
   {
     if (d_fd != -1) {
-      std::cout << "Closing " << d_fd << ".\n";
+      LOG_DEBUG("Closing %d.", d_fd);
       close(d_fd);
     }
 
@@ -153,11 +479,10 @@ struct HttpServer::Internal {
     d_clientTableSize = l.rlim_cur;
 
     // Allocate a table large enough to hold all file descriptors
-    // that can possible be open at one time.
-    d_clientTable = new ClientContext [ l.rlim_cur ];
+    // that can possible be open at one time, initialized to zero.
+    d_clientTable = new ClientContext [ l.rlim_cur ]();
 
-    // Initialize the table to zero.
-    memset(d_clientTable, 0, l.rlim_cur * sizeof(ClientContext));
+    Metrics::instance().gauge("plain_http_client_table_bytes", "Size of the client table, it is allocated for the descriptor limit.").add(l.rlim_cur * sizeof(ClientContext));
   }
 
   /*
@@ -232,12 +557,12 @@ struct HttpServer::Internal {
     // accepting multiple connections.
     for (size_t i = 0; i < DEFAULT_ACCEPTS_PER_EVENT; ++i) {
       
-      sockaddr address;
-      socklen_t addressLength = 0;
+      sockaddr_storage address;
+      socklen_t addressLength = sizeof(address);
 
       // Accept the connection.
       int clientFd = accept4(d_fd,
-			     &address, &addressLength,
+			     reinterpret_cast<sockaddr*>(&address), &addressLength,
 			     SOCK_NONBLOCK | SOCK_CLOEXEC);
 
       //      std::cout << "Opening " << clientFd << " (accept).\n";
@@ -249,10 +574,12 @@ struct HttpServer::Internal {
 	} else if (errno == EMFILE || errno == ENFILE) {
 	  // Reached file descriptor limit, run through all other scheduled IO events
 	  // and try again after that.
+	  d_acceptErrorsMetric.add();
 	  asyncResult.completed(Poll::NONE_COMPLETED);
 	} else if (errno == ENOBUFS || errno == ENOMEM) {
 	  // Probably reached the maximum socket buffer memory limit. Run through all other
 	  // scheduled IO events and try again.
+	  d_acceptErrorsMetric.add();
 	  asyncResult.completed(Poll::NONE_COMPLETED);
 	} else {
 	  throw ErrnoException(errno);
@@ -261,7 +588,11 @@ struct HttpServer::Internal {
 	return;
       }
 
-      initializeNewConnection(clientFd, address, addressLength);
+      d_acceptsMetric.add();
+
+      PLAIN_PROBE2(accept, clientFd, address.ss_family == AF_INET ? reinterpret_cast<sockaddr_in const &>(address).sin_addr.s_addr : 0);
+
+      initializeNewConnection(clientFd, reinterpret_cast<sockaddr const &>(address), addressLength);
     }
 
     // More accepts waiting but yielding back to the IO event scheduler to
@@ -286,6 +617,16 @@ struct HttpServer::Internal {
 
     resetConnection(context);
 
+    context->accepted = std::chrono::steady_clock::now();
+
+    if (address.sa_family == AF_INET) {
+      context->address = reinterpret_cast<sockaddr_in const &>(address).sin_addr.s_addr;
+    } else {
+      context->address = 0;
+    }
+
+    context->connection = ++d_connectionCount;
+
     // Add an event to read the incomming header data.
     Main::instance().poll().add(fd, Poll::IN | Poll::TIMEOUT, _doClientReadHeader, this);
   }
@@ -295,50 +636,78 @@ struct HttpServer::Internal {
    */
   void resetConnection(ClientContext *context)
   {
-    // Zero the structure.
-    memset(context, 0, sizeof(ClientContext));
+    releaseStatusBody(context);
+
+    uint32_t address = context->address;
+    uint32_t connection = context->connection;
+    uint32_t generation = context->generation;
+    State state = context->state;
+
+    // Zero the state, the arena is reset below and the buffers are overwritten anyway.
+    static_cast<ClientState &>(*context) = ClientState();
+
+    context->address = address;
+    context->connection = connection;
+    context->generation = generation + 1;
 
     // Set the initial state.
-    context->state = HTTP_STATE_CONNECTION_ACCEPTED;
+    context->state = state;
+    setState(context, HTTP_STATE_CONNECTION_ACCEPTED);
 
     // Set the file descriptor on the request object, so
     // we can resolve it back to the ClientContext entry.
     context->request.setFd(context-d_clientTable);
+
+    // Start with an empty arena for the new request.
+    context->arena = Arena(context->arenaBuffer, DEFAULT_ARENA_SIZE);
+    context->request.setArena(&context->arena);
   }
 
 
-  // For debug purposes.
-  void printHex(char const *buffer, size_t count)
+  /*
+   *  Updates the state of the connection and the per state connection counts.
+   */
+  void setState(ClientContext *context, State state)
   {
-    char const *end = buffer + count;
-    for (char const *i = buffer; i != end; ++i) {
-      std::cout << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(*i) << " " << std::dec;
+    if (context->state == state) {
+      return;
     }
-    std::cout << ".\n";
+
+    if (context->state != HTTP_STATE_CLOSED) {
+      d_connectionsMetric[context->state]->sub();
+    }
+
+    if (state != HTTP_STATE_CLOSED) {
+      d_connectionsMetric[state]->add();
+    }
+
+    context->state = state;
   }
 
   /*
-   *  Checks if the end of header sequence can be found in the buffer in the specified range.
+   *  Accounts for a client connection that is about to be closed.
    */
-  int findEndOfHeader(char const *buffer, size_t offset, size_t count)
+  void connectionClosed(ClientContext *context)
   {
-    size_t marg = std::min<size_t>(offset, 4);
-    offset -= marg;
-    count += marg;
-
-    if (count < 4) {
-      return -1;
+    if (context->state == HTTP_STATE_CLOSED) {
+      return;
     }
 
-    // Run through all data in the buffer, searching for the end of header sequence.
-    char const *end = buffer + offset + count - 3;
-    for (char const *i = buffer + offset; i != end; ++i) {
-      if (*reinterpret_cast<uint32_t const *>(i) == END_OF_HEADER_MARKER) {
-	return i - buffer;
-      }
-    }
+    LOG_DEBUG("closing %d.", static_cast<int>(context - d_clientTable));
+    unmapFile(context);
+    releaseStatusBody(context);
+    logRequest(context);
+    setState(context, HTTP_STATE_CLOSED);
+  }
 
-    return -1;
+  // For debug purposes.
+  void printHex(char const *buffer, size_t count)
+  {
+    char const *end = buffer + count;
+    for (char const *i = buffer; i != end; ++i) {
+      std::cout << std::hex << std::setw(2) << std::setfill('0') << static_cast<int>(*i) << " " << std::dec;
+    }
+    std::cout << ".\n";
   }
 
   /*
@@ -353,7 +722,8 @@ struct HttpServer::Internal {
     if (events & Poll::TIMEOUT) {
       //      std::cout << "TIMEOUT on " << fd << ".\n";
       //      close(fd);
-      std::cout << "closing " << fd << ".\n";
+      d_timeoutsMetric.add();
+      connectionClosed(context);
       asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
       return;
     }
@@ -366,6 +736,18 @@ struct HttpServer::Internal {
 							  context->bufferFill,
 							  DEFAULT_BUFFER_SIZE - context->bufferFill);
 
+    if (result == Poll::READ_COMPLETED) {
+      d_readAgainMetric.add();
+    }
+
+    // Terminate the data, the buffer is not zeroed between requests.
+    context->buffer[context->bufferFill] = 0;
+
+    // Remember when the first data of the request arrived.
+    if (bufferFill == 0 && context->bufferFill != 0) {
+      context->requestStart = std::chrono::steady_clock::now();
+    }
+
     //    std::cout << fd << ": current buffer fill: " << context->bufferFill << ".\n";
 
     /*
@@ -375,28 +757,49 @@ struct HttpServer::Internal {
     */
 
     // Check if the buffer contains the "\r\n\r\n" sequence that indicates the end of the header.
-    int endOfHeaderOffset = findEndOfHeader(context->buffer, bufferFill, context->bufferFill - bufferFill);
+    int endOfHeaderOffset = Http::findEndOfHeader(context->buffer, bufferFill, context->bufferFill - bufferFill);
 
     // The header is received.
     if (endOfHeaderOffset != -1) {
       //      std::cout << "Header received.\n";
-      context->state = HTTP_STATE_HEADER_RECEIVED;
+      setState(context, HTTP_STATE_HEADER_RECEIVED);
+
+      // The parser works in place, so capture the header before parsing it.
+      if (d_capture) {
+	captureHeader(context, endOfHeaderOffset + 4);
+      }
 
       // Parse the request headers.
       parseHttpHeader(context);
 
+      // The log copy of the uri is only made with an access log.
+      PLAIN_PROBE4(header_parsed, fd, context->request.method(), context->request.uri(), strlen(context->request.uri()));
+
+      d_requestsMetric.add();
+
       //      context->state = HTTP_STATE_HEADER_PARSED;
 
-      if (d_requestHandler) {
+      if (!d_statusUri.empty() && d_statusUri == context->request.uri()) {
+	// Serve the metrics.
+	respondWithStatus(context);
+
+	context->handlerReturned = std::chrono::steady_clock::now();
+
+	result = Poll::READ_COMPLETED;
+      } else if (d_requestHandler) {
 	// Pass the request on to tbhe request handler.
 	d_requestHandler->request(context->request);
 
+	if (context->state != HTTP_STATE_DEFERRED) {
+	  context->handlerReturned = std::chrono::steady_clock::now();
+	}
+
 	// Indicate back to the poll system that we don't expect more data for now.
 	result = Poll::READ_COMPLETED;
       } else {
 	// Just close the file descriptor and report this back to the poll system.
 	//	close(fd);
-	std::cout << "closing " << fd << ".\n";
+	connectionClosed(context);
 	result = Poll::CLOSE_DESCRIPTOR;
       }
     }
@@ -406,20 +809,43 @@ struct HttpServer::Internal {
     if (result != Poll::READ_COMPLETED && context->bufferFill == bufferFill) {
       // This means the connection is closed from the other side.
       //      close(fd);
-      std::cout << "closing " << fd << ".\n";
+      connectionClosed(context);
       result = Poll::CLOSE_DESCRIPTOR;
     }
 
     // Buffer is full without end of header.
     if (context->bufferFill == DEFAULT_BUFFER_SIZE) {
       //      close(fd);
-      std::cout << "closing " << fd << ".\n";
+      connectionClosed(context);
       result = Poll::CLOSE_DESCRIPTOR;
     }
     
     asyncResult.completed(result);
   }
 
+  /*
+   *  Copies the raw request header to the request capture.
+   */
+  void captureHeader(ClientContext *context, size_t headerLength)
+  {
+    RequestCapture::Record *record = d_capture->reserve();
+
+    if (record == NULL || headerLength > RequestCapture::MAX_HEADER_SIZE) {
+      return;
+    }
+
+    // Convert the arrival of the first byte to wall clock time.
+    std::chrono::system_clock::time_point arrived = std::chrono::system_clock::now() -
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::steady_clock::now() - context->requestStart);
+
+    record->time = std::chrono::duration_cast<std::chrono::microseconds>(arrived.time_since_epoch()).count();
+    record->connection = context->connection;
+    record->headerLength = headerLength;
+    memcpy(record->header, context->buffer, headerLength);
+
+    d_capture->commit();
+  }
+
   /*
    *  Parses the headers and fills in the appropriate fields in the context->request
    *  structure.
@@ -429,6 +855,114 @@ struct HttpServer::Internal {
     Http::parseHttpRequestHeaders(context->request,
 				  context->buffer,
 				  context->bufferFill);
+
+    context->headerReceived = std::chrono::steady_clock::now();
+    context->queueWait = Main::instance().poll().stats().queueWait;
+
+    if (d_accessLog) {
+      // The header buffer is reused for the response, so keep a copy of the uri.
+      context->logUriLength = strlen(context->request.uri());
+      context->logUri = context->arena.copy(context->request.uri(),
+					    std::min<size_t>(context->logUriLength, AccessLog::URI_LENGTH));
+    }
+  }
+
+  /*
+   *  Parses the status code from a static response string, returns zero when it can not be found.
+   */
+  static uint16_t parseStatus(char const *str, size_t length)
+  {
+    char const *end = str + length;
+    char const *head = static_cast<char const *>(memchr(str, ' ', length));
+
+    if (head == NULL || end - head < 4) {
+      return 0;
+    }
+
+    uint16_t status = 0;
+    for (char const *i = head + 1; i != head + 4; ++i) {
+      if (*i < '0' || *i > '9') {
+	return 0;
+      }
+      status = status * 10 + (*i - '0');
+    }
+
+    return status;
+  }
+
+  /*
+   *  Accounts for response bytes written to the client.
+   */
+  void bytesWritten(ClientContext *context, size_t count)
+  {
+    if (context->bytesSent == 0) {
+      context->firstByteWritten = std::chrono::steady_clock::now();
+    }
+
+    context->bytesSent += count;
+  }
+
+  static uint64_t nanoseconds(std::chrono::steady_clock::duration duration)
+  {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+  }
+
+  /*
+   *  Records the phase durations of a request of which the response was sent completely.
+   */
+  void recordPhases(ClientContext *context)
+  {
+    std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+
+    if (context->accepted != std::chrono::steady_clock::time_point()) {
+      d_acceptPhaseMetric.record(nanoseconds(context->headerReceived - context->accepted));
+    }
+
+    d_headerPhaseMetric.record(nanoseconds(context->headerReceived - context->requestStart));
+    d_handlerPhaseMetric.record(nanoseconds(context->handlerReturned - context->headerReceived));
+    d_firstBytePhaseMetric.record(nanoseconds(context->firstByteWritten - context->headerReceived));
+    d_transferPhaseMetric.record(nanoseconds(t - context->firstByteWritten));
+    d_totalPhaseMetric.record(nanoseconds(t - context->requestStart));
+  }
+
+  /*
+   *  Writes the access log record of the request of the connection.
+   */
+  void logRequest(ClientContext *context)
+  {
+    if (context->state != HTTP_STATE_SENDING_RESPONSE) {
+      return;
+    }
+
+    PLAIN_PROBE3(response_end, static_cast<int>(context - d_clientTable), context->status, context->bytesSent);
+
+    if (!d_accessLog) {
+      return;
+    }
+
+    AccessLog::Record *record = d_accessLog->reserve();
+
+    if (record == NULL) {
+      return;
+    }
+
+    timespec now;
+    clock_gettime(CLOCK_REALTIME_COARSE, &now);
+    std::chrono::steady_clock::time_point t = std::chrono::steady_clock::now();
+
+    record->time = static_cast<uint64_t>(now.tv_sec) * 1000000 + now.tv_nsec / 1000;
+    record->bytesSent = context->bytesSent;
+    record->address = context->address;
+    record->fd = context - d_clientTable;
+    record->method = context->request.method();
+    record->version = context->request.version();
+    record->status = context->status;
+    record->uriLength = std::min<size_t>(context->logUriLength, UINT16_MAX);
+    record->headerTime = std::chrono::duration_cast<std::chrono::microseconds>(context->headerReceived - context->requestStart).count();
+    record->responseTime = std::chrono::duration_cast<std::chrono::microseconds>(t - context->headerReceived).count();
+    memcpy(record->uri, context->logUri, std::min<size_t>(context->logUriLength, AccessLog::URI_LENGTH));
+
+    d_accessLog->commit();
   }
 
   /*
@@ -437,7 +971,7 @@ struct HttpServer::Internal {
   void respondWithStaticString(HttpRequest const &request, const char *str, size_t length)
   {
     // Check if the file descriptor is in bounds.
-    if (request.fd() < 0 || request.fd() > d_clientTableSize) {
+    if (request.fd() < 0 || request.fd() >= d_clientTableSize) {
       throw std::runtime_error("file descriptor out of bounds");
     }
 
@@ -450,7 +984,10 @@ struct HttpServer::Internal {
     context->sendBufferPosition = 0;
 
     // Update the current state.
-    context->state = HTTP_STATE_SENDING_RESPONSE;
+    setState(context, HTTP_STATE_SENDING_RESPONSE);
+    context->status = parseStatus(str, length);
+
+    PLAIN_PROBE3(response_start, request.fd(), context->status, length);
 
     // Add an event to read the incomming header data.
     Main::instance().poll().modify(request.fd(), Poll::OUT | Poll::TIMEOUT, _doClientWriteStaticString, this);
@@ -465,44 +1002,51 @@ struct HttpServer::Internal {
 
     if (events & Poll::TIMEOUT) {
       //      close(fd);
-      std::cout << "closing " << fd << ".\n";
+      d_timeoutsMetric.add();
+      connectionClosed(context);
       asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
       return;
     }
 
     // Write part of the buffer.
-    int ret = write(fd, context->sendBuffer, context->sendBufferSize - context->sendBufferPosition);
+    int ret = write(fd, context->sendBuffer + context->sendBufferPosition, context->sendBufferSize - context->sendBufferPosition);
+    d_writeCallsMetric.add();
 
     if (ret == -1) {
       if (errno == EAGAIN) {
 	// Non blocking behavior, so we need to wait for the socket to become writable again.
+	d_writeAgainMetric.add();
 	asyncResult.completed(Poll::WRITE_COMPLETED);
       } else if (errno == EPIPE) {
 	// Connection was dropped.
-	std::cout << "closing " << fd << ".\n";
+	connectionClosed(context);
 	asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
       } else {
 	// TODO: log error.
 	// Another error occured, close the file descriptor.
-	std::cout << "closing " << fd << ".\n";
+	connectionClosed(context);
 	asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
       }
       return;
     } else if (ret == 0) {
       // Zero write, socket probably has closed
-      std::cout << "closing " << fd << ".\n";
+      connectionClosed(context);
       asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
       return;
     }
 
     // Update the send buffer position.
     context->sendBufferPosition += ret;
+    bytesWritten(context, ret);
+    d_bytesWrittenMetric.add(ret);
 
     // Check if we are done sending data.
     if (context->sendBufferPosition == context->sendBufferSize) {
       if (context->request.connection() == Http::CONNECTION_KEEP_ALIVE) {
 	// We have a keep alive connection, so reset the connection state to expect
 	// a new request.
+	recordPhases(context);
+	logRequest(context);
 	resetConnection(context);
 
 	// Modify the poll event handler to wait for input data.
@@ -514,7 +1058,8 @@ struct HttpServer::Internal {
       }
 
       // Connection is not keep-alive, so close the socket and indicate this back to the poll system.
-      std::cout << "closing " << fd << ".\n";
+      recordPhases(context);
+      connectionClosed(context);
       asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
       return;
     }
@@ -523,10 +1068,58 @@ struct HttpServer::Internal {
     asyncResult.completed(Poll::NONE_COMPLETED);
   }
 
-  void respondWithFile(HttpRequest const &request, std::string const &path)
+  /*
+   *  Responds with the rendered metrics.
+   */
+  void respondWithStatus(ClientContext *context)
+  {
+    int fd = context - d_clientTable;
+
+    std::string body;
+    Metrics::instance().render(body);
+
+    char header[256];
+    Http::Response response(header, sizeof(header), 200, "OK");
+    response.addHeaderField("Content-Type", "text/plain; version=0.0.4");
+    response.addHeaderField("Content-Length", body.size());
+    response.addHeaderField("Connection", context->request.connection() == Http::CONNECTION_KEEP_ALIVE ? "keep-alive" : "close");
+
+    std::string &status = d_statusBodies[fd];
+    status.assign(header, response.size());
+    status += body;
+
+    respondWithStaticString(context->request, status.data(), status.size());
+  }
+
+  /*
+   *  Frees the rendered metrics of a status response, once it was sent or the
+   *  connection closed.
+   */
+  void releaseStatusBody(ClientContext *context)
+  {
+    if (!d_statusBodies.empty()) {
+      d_statusBodies.erase(context - d_clientTable);
+    }
+  }
+
+  void respondWithFile(HttpRequest const &request, std::string_view path)
+  {
+    // The path is not necessarily zero terminated, so copy it to the stack.
+    if (path.size() >= MAX_PATH_LENGTH) {
+      throw std::runtime_error("path too long");
+    }
+
+    char buffer[MAX_PATH_LENGTH];
+    memcpy(buffer, path.data(), path.size());
+    buffer[path.size()] = 0;
+
+    respondWithFile(request, buffer);
+  }
+
+  void respondWithFile(HttpRequest const &request, char const *path)
   {
     // Check if the file descriptor is in bounds.
-    if (request.fd() < 0 || request.fd() > d_clientTableSize) {
+    if (request.fd() < 0 || request.fd() >= d_clientTableSize) {
       throw std::runtime_error("file descriptor out of bounds");
     }
 
@@ -534,103 +1127,1248 @@ struct HttpServer::Internal {
     ClientContext *context = d_clientTable + request.fd();
 
     //    std::cout << "Request fd=" << request.fd() << ".\n";
-    
-    // Open the file.
-    int fileFd = open(path.c_str(), O_RDONLY);
 
-    if (fileFd == -1) {
-      throw ErrnoException(errno);
+    // A file with a cached path can be opened on the loop without blocking.
+    if (d_filePool && d_cachedOpens) {
+      OpenedFile file;
+
+      if (openCachedFile(path, file)) {
+	d_openLoopMetric.add();
+
+	if (file.fd == -1) {
+	  respondWithOpenError(context, file.error);
+	  return;
+	}
+
+	sendOpenedFile(context, file);
+	return;
+      }
     }
 
-    std::cout << "Opening " << fileFd << " (respondWithFile).\n";
-    
-    struct stat st;
-    int ret = fstat(fileFd, &st);
+    if (d_filePool) {
+      // Open the file on the pool, the response continues on the loop when it is open.
+      std::shared_ptr<OpenedFile> file = std::make_shared<OpenedFile>();
+      std::string filePath(path);
+      int fd = request.fd();
+      uint32_t generation = context->generation;
 
-    if (ret == -1) {
-      throw ErrnoException(errno);
+      if (d_filePool->submit([file, filePath]() { openFile(filePath.c_str(), *file); },
+			     [this, fd, generation, file]() { releaseFilePools(); fileOpened(fd, generation, *file); })) {
+	d_openPoolMetric.add();
+	setState(context, HTTP_STATE_OPENING_FILE);
+
+	// Only keep the timeout while the file is being opened.
+	Main::instance().poll().modify(fd, Poll::TIMEOUT, _doClientDeferred, this);
+	return;
+      }
     }
 
-    // Get the length of the file in bytes.
-    context->contentLength = st.st_size;
-    
-    //    std::cout << "Source file fd=" << fileFd << ".\n";
-    
-    int pipeFds[2];
-    
-    // Create an intermediate pipe.
-    ret = pipe2(pipeFds, O_NONBLOCK | O_CLOEXEC);
+    // Open the file on the loop, when there is no pool or it is full.
+    d_openLoopMetric.add();
 
-    if (ret == -1) {
-      close(fileFd);
-      throw ErrnoException(errno);
+    OpenedFile file;
+    openFile(path, file);
+
+    if (file.fd == -1) {
+      respondWithOpenError(context, file.error);
+      return;
     }
 
-    // TODO: make pipe buffer size dependent on file size?
-    fcntl(pipeFds[0], F_SETPIPE_SZ, DEFAULT_PIPE_BUFFER_SIZE);
-    fcntl(pipeFds[1], F_SETPIPE_SZ, DEFAULT_PIPE_BUFFER_SIZE);
-    
-    std::cout << "Opening " << pipeFds[0] << " (pipe[0]).\n";
-    std::cout << "Opening " << pipeFds[1] << " (pipe[1]).\n";
-    
-    //    std::cout << "Pipe fd0=" << pipeFds[0] << ", fd1=" << pipeFds[1] << ".\n";
-    
-    ClientContext *pipeInContext = d_clientTable + pipeFds[1];
-    ClientContext *pipeOutContext = d_clientTable + pipeFds[0];
+    sendOpenedFile(context, file);
+  }
 
-    pipeInContext->sourceFd = fileFd;
-    pipeOutContext->destinationFd = request.fd();
-    context->sourceFd = pipeFds[0];
+  /*
+   *  Opens a file if its path resolves from the dentry cache, which does not
+   *  block, and gets its size.
+   *
+   *  @return false when the lookup would need the disk, or the kernel does not
+   *          support this.
+   */
+  bool openCachedFile(char const *path, OpenedFile &file)
+  {
+    open_how how;
+    memset(&how, 0, sizeof(how));
+    how.flags = O_RDONLY | O_CLOEXEC;
+    how.resolve = RESOLVE_CACHED;
 
-    try {
-      // Create the response headers.
-      Http::Response response(context->buffer, DEFAULT_BUFFER_SIZE, 200, "Okay");
-      response.addHeaderField("Content-Length", context->contentLength);
-      response.addHeaderField("Connection", "keep-alive");
-      
-      // Set the buffer fill to the header size.
-      context->bufferFill = response.size();
+    file.openStart = std::chrono::steady_clock::now();
 
-      // Set the send buffer.
-      context->sendBuffer = context->buffer;
-      context->sendBufferSize = context->bufferFill;
-      context->sendBufferPosition = 0;
+    file.fd = syscall(SYS_openat2, AT_FDCWD, path, &how, sizeof(how));
 
-      //      std::cout << "- Sending header...\n";
-      
-      // Asynchronously write the header to the socket.
-      Main::instance().poll().modify(request.fd(), Poll::OUT, _doWriteHeader, this);
-      Main::instance().poll().add(pipeFds[1], Poll::OUT, _doCopyFromSource, this);
-    } catch (...) {
-      std::cout << "Closing " << fileFd << ".\n";
-      std::cout << "Closing " << pipeFds[0] << ".\n";
-      std::cout << "Closing " << pipeFds[1] << ".\n";
-      close(fileFd);
-      close(pipeFds[0]);
-      close(pipeFds[1]);
-      throw;
+    if (file.fd == -1) {
+      if (errno == EAGAIN) {
+	return false;
+      }
+
+      // Kernels before 5.12 do not have openat2 or RESOLVE_CACHED.
+      if (errno == ENOSYS || errno == EINVAL) {
+	d_cachedOpens = false;
+	return false;
+      }
+
+      file.error = errno;
+      return true;
     }
-  }
 
-  void drop(HttpRequest const &request)
-  {
-    // Check if the file descriptor is in bounds.
-    if (request.fd() < 0 || request.fd() > d_clientTableSize) {
-      throw std::runtime_error("file descriptor out of bounds");
+    LOG_DEBUG("Opening %d (respondWithFile).", file.fd);
+
+    struct stat st;
+    int ret = fstat(file.fd, &st);
+
+    if (ret == -1) {
+      file.error = errno;
+      close(file.fd);
+      file.fd = -1;
+      return true;
     }
 
-    Main::instance().poll().close(request.fd());
+    file.size = st.st_size;
+    file.device = st.st_dev;
+    file.inode = st.st_ino;
+    file.openEnd = std::chrono::steady_clock::now();
+    return true;
   }
-  
-  IO_EVENT_HANDLER(doWriteHeader)
+
+  /*
+   *  Opens a file and gets its size, this can run on any thread.
+   */
+  static void openFile(char const *path, OpenedFile &file)
+  {
+    file.openStart = std::chrono::steady_clock::now();
+
+    file.fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (file.fd == -1) {
+      file.error = errno;
+      return;
+    }
+
+    LOG_DEBUG("Opening %d (respondWithFile).", file.fd);
+
+    struct stat st;
+    int ret = fstat(file.fd, &st);
+
+    if (ret == -1) {
+      file.error = errno;
+      close(file.fd);
+      file.fd = -1;
+      return;
+    }
+
+    file.size = st.st_size;
+    file.device = st.st_dev;
+    file.inode = st.st_ino;
+    file.openEnd = std::chrono::steady_clock::now();
+  }
+
+  /*
+   *  Continues a file response on the loop after the pool opened the file.
+   */
+  void fileOpened(int fd, uint32_t generation, OpenedFile const &file)
+  {
+    ClientContext *context = d_clientTable + fd;
+
+    // The connection timed out in the mean time, the descriptor might be reused.
+    if (context->state != HTTP_STATE_OPENING_FILE || context->generation != generation) {
+      if (file.fd != -1) {
+	LOG_DEBUG("Closing %d.", file.fd);
+	close(file.fd);
+      }
+
+      return;
+    }
+
+    if (file.fd == -1) {
+      respondWithOpenError(context, file.error);
+      return;
+    }
+
+    sendOpenedFile(context, file);
+  }
+
+  /*
+   *  Responds to a request of which the file can not be opened, the same on the
+   *  loop and on the file pool.
+   */
+  void respondWithOpenError(ClientContext *context, int error)
+  {
+    switch (error) {
+    case ENOENT:
+    case ENOTDIR:
+      respondWithStaticString(context->request, s_notFound, sizeof(s_notFound) - 1);
+      break;
+
+    case EACCES:
+    case EPERM:
+      respondWithStaticString(context->request, s_forbidden, sizeof(s_forbidden) - 1);
+      break;
+
+    default:
+      LOG_ERROR("Opening the file of a response failed: %s.", strerror(error));
+      respondWithStaticString(context->request, s_internalError, sizeof(s_internalError) - 1);
+      break;
+    }
+  }
+
+  /*
+   *  Destroys the replaced file pools of which the queued jobs ran, this runs
+   *  with the results of the file pool.
+   */
+  void releaseFilePools()
+  {
+    if (d_retiredFilePools.empty()) {
+      return;
+    }
+
+    for (size_t i = d_retiredFilePools.size(); i-- != 0; ) {
+      if (d_retiredFilePools[i]->pending() == 0) {
+	d_retiredFilePools[i] = std::move(d_retiredFilePools.back());
+	d_retiredFilePools.pop_back();
+      }
+    }
+  }
+
+  /*
+   *  Starts sending an opened file as the response.
+   */
+  void sendOpenedFile(ClientContext *context, OpenedFile const &file)
+  {
+    int fd = context - d_clientTable;
+    int fileFd = file.fd;
+    std::chrono::steady_clock::time_point openStart = file.openStart;
+    std::chrono::steady_clock::time_point openEnd = file.openEnd;
+
+    // Get the length of the file in bytes.
+    context->contentLength = file.size;
+
+    // Update the current state.
+    setState(context, HTTP_STATE_SENDING_RESPONSE);
+    context->status = 200;
+
+    PLAIN_PROBE3(response_start, fd, context->status, context->contentLength);
+
+    if (d_transfer.strategy == HttpServer::TRANSFER_SENDFILE) {
+      // Send the file directly, without an intermediate pipe.
+      context->sourceFd = fileFd;
+      context->sendFile = true;
+      startFileTransfer(context, file.size);
+
+      try {
+	prepareFileHeader(context, openStart, openEnd);
+
+	// Asynchronously write the header to the socket.
+	Main::instance().poll().modify(fd, Poll::OUT, _doWriteHeader, this);
+      } catch (...) {
+	closeSource(context);
+	throw;
+      }
+
+      return;
+    }
+    
+    //    std::cout << "Source file fd=" << fileFd << ".\n";
+    
+    int pipeFds[2];
+    
+    // Create an intermediate pipe.
+    int ret = pipe2(pipeFds, O_NONBLOCK | O_CLOEXEC);
+
+    if (ret == -1) {
+      close(fileFd);
+      throw ErrnoException(errno);
+    }
+
+    ClientContext *pipeInContext = d_clientTable + pipeFds[1];
+    ClientContext *pipeOutContext = d_clientTable + pipeFds[0];
+
+    // Size the pipe to the file, the transfer sizes it to the rate of the client later.
+    openedPipe(pipeFds[1], pipeInContext, file.size);
+    pipeInContext->pipeTuneAt = PIPE_TUNE_INTERVAL;
+
+    LOG_DEBUG("Opening %d (pipe[0]).", pipeFds[0]);
+    LOG_DEBUG("Opening %d (pipe[1]).", pipeFds[1]);
+    
+    //    std::cout << "Pipe fd0=" << pipeFds[0] << ", fd1=" << pipeFds[1] << ".\n";
+    
+    pipeInContext->sourceFd = fileFd;
+    pipeInContext->sendBufferPosition = 0;
+    pipeInContext->fanOut = NULL;
+
+    // A large file can be shared with the transfers that start at the same time.
+    bool fanOut = d_transfer.fanOutThreshold != 0 && file.size >= d_transfer.fanOutThreshold;
+
+    if (fanOut) {
+      resetFileTransfer(pipeInContext);
+    } else {
+      startFileTransfer(pipeInContext, file.size);
+    }
+    pipeOutContext->destinationFd = fd;
+    context->sourceFd = pipeFds[0];
+
+    try {
+      prepareFileHeader(context, openStart, openEnd);
+
+      //      std::cout << "- Sending header...\n";
+      
+      // Asynchronously write the header to the socket.
+      Main::instance().poll().modify(fd, Poll::OUT, _doWriteHeader, this);
+      if (fanOut) {
+	joinFanOut(pipeFds[1], file);
+      } else {
+	// A full pipe of which the reader closed only reports an error.
+	Main::instance().poll().add(pipeFds[1], Poll::OUT | Poll::ERR, _doCopyFromSource, this);
+      }
+    } catch (...) {
+      LOG_DEBUG("Closing %d.", pipeFds[0]);
+      LOG_DEBUG("Closing %d.", pipeFds[1]);
+      closedPipe(pipeInContext);
+      closeSource(pipeInContext);
+      close(pipeFds[0]);
+      close(pipeFds[1]);
+      throw;
+    }
+  }
+
+  /*
+   *  Sets up the page cache handling of the file that is transfered from the
+   *  source descriptor of the context, depending on its size.
+   */
+  void startFileTransfer(ClientContext *context, size_t size)
+  {
+    resetFileTransfer(context);
+    context->fileSize = size;
+    context->readAhead = d_transfer.prefetchThreshold != 0 && size >= d_transfer.prefetchThreshold;
+    context->dropBehind = d_transfer.dropBehindThreshold != 0 && size >= d_transfer.dropBehindThreshold;
+
+    if (context->readAhead) {
+      // This doubles the read ahead of the kernel for the file.
+      posix_fadvise(context->sourceFd, 0, 0, POSIX_FADV_SEQUENTIAL);
+      mapFile(context, size);
+    }
+  }
+
+  /*
+   *  Clears the page cache handling of the file transfered from the source
+   *  descriptor of the context.
+   */
+  void resetFileTransfer(ClientContext *context)
+  {
+    context->fileMap = NULL;
+    context->fileMapSize = 0;
+    context->readAhead = false;
+    context->dropBehind = false;
+    context->readAheadEnd = 0;
+    context->dropBehindEnd = 0;
+    context->fileSize = 0;
+    context->prefetched = false;
+    context->rateSampleStart = std::chrono::steady_clock::now();
+    context->rateSampleOffset = context->sendBufferPosition;
+    context->drainRate = 0;
+  }
+
+  /*
+   *  Maps the file that is transfered from the source descriptor of the context.
+   *
+   *  The mapping is never touched, so it costs no memory, it only lets mincore
+   *  tell which pages of the file are in the page cache.
+   */
+  void mapFile(ClientContext *context, size_t size)
+  {
+    void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, context->sourceFd, 0);
+
+    // Without a mapping the file is transfered without checking it.
+    if (map == MAP_FAILED) {
+      LOG_DEBUG("Mapping %d failed: %s.", context->sourceFd, strerror(errno));
+      return;
+    }
+
+    context->fileMap = map;
+    context->fileMapSize = size;
+  }
+
+  void unmapFile(ClientContext *context)
+  {
+    if (context->fileMap != NULL) {
+      munmap(context->fileMap, context->fileMapSize);
+      context->fileMap = NULL;
+    }
+  }
+
+  /*
+   *  Closes the file that is transfered from the source descriptor of the context.
+   */
+  void closeSource(ClientContext *context)
+  {
+    unmapFile(context);
+
+    LOG_DEBUG("Closing %d.", context->sourceFd);
+    close(context->sourceFd);
+  }
+
+  /*
+   *  Reads ahead of and drops behind the transfer position of a large file, call
+   *  this when the position advanced.
+   */
+  void fileTransfered(ClientContext *context)
+  {
+    size_t position = context->sendBufferPosition;
+
+    if (context->readAhead) {
+      // Size the window from the rate the client drains the file at.
+      size_t window = transferRate(context) * READ_AHEAD_MILLISECONDS / 1000;
+      window = std::min<size_t>(std::max(window, d_transfer.chunkSize), MAX_READ_AHEAD_WINDOW);
+
+      // Extend the window once half of it is used, so the reads are not small.
+      if (context->readAheadEnd < position + window / 2) {
+	size_t start = std::max(context->readAheadEnd, position);
+	size_t end = std::min(position + window, context->fileSize);
+
+	if (start < end) {
+	  readAhead(context->sourceFd, start, end - start);
+	  context->readAheadEnd = end;
+	}
+      }
+    }
+
+    if (context->dropBehind && position > DROP_BEHIND_LAG) {
+      size_t end = position - DROP_BEHIND_LAG;
+
+      if (end >= context->dropBehindEnd + d_transfer.chunkSize) {
+	posix_fadvise(context->sourceFd, context->dropBehindEnd, end - context->dropBehindEnd, POSIX_FADV_DONTNEED);
+	d_droppedBytesMetric.add(end - context->dropBehindEnd);
+	context->dropBehindEnd = end;
+      }
+    }
+  }
+
+  /*
+   *  Starts reading a range of a file into the page cache. Submitting the reads
+   *  can block on the disk, so this is done on the file pool, or skipped when
+   *  it is full. The transfer checks for the pages that did not arrive yet.
+   */
+  void readAhead(int fileFd, size_t offset, size_t length)
+  {
+    if (d_filePool) {
+      // A hint for a descriptor that got closed and reused in the mean time does no harm.
+      if (!d_filePool->submit([fileFd, offset, length]() { posix_fadvise(fileFd, offset, length, POSIX_FADV_WILLNEED); },
+			      std::function<void()>())) {
+	return;
+      }
+    } else {
+      posix_fadvise(fileFd, offset, length, POSIX_FADV_WILLNEED);
+    }
+
+    d_readAheadBytesMetric.add(length);
+  }
+
+  /*
+   *  @return the rate in bytes per second at which the client drains the
+   *          transfer of the context, recently. Before the first sample this
+   *          is the average since the transfer started, 0 when no time passed.
+   */
+  size_t transferRate(ClientContext *context)
+  {
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    double elapsed = nanoseconds(now - context->rateSampleStart) * 1e-9;
+    size_t bytes = context->sendBufferPosition - context->rateSampleOffset;
+
+    if (elapsed * 1000 >= static_cast<double>(RATE_SAMPLE_MILLISECONDS)) {
+      double sample = bytes / elapsed;
+
+      if (context->drainRate == 0) {
+	context->drainRate = sample;
+      } else {
+	context->drainRate += (sample - context->drainRate) / static_cast<double>(RATE_SMOOTHING);
+      }
+
+      context->rateSampleStart = now;
+      context->rateSampleOffset = context->sendBufferPosition;
+    }
+
+    if (context->drainRate != 0) {
+      return context->drainRate;
+    }
+
+    if (elapsed <= 0) {
+      return 0;
+    }
+
+    return bytes / elapsed;
+  }
+
+  /*
+   *  Reads the pipe memory limits of the user. Above the soft limit the kernel
+   *  gives new pipes a single page and refuses to grow pipes.
+   */
+  void initializePipeLimits()
+  {
+    size_t softPages = readProcValue("/proc/sys/fs/pipe-user-pages-soft", 0);
+
+    // Leave a part of the limit to the other processes of the user.
+    d_pipeBudget = softPages != 0 ? softPages * sysconf(_SC_PAGESIZE) / 4 * 3 : SIZE_MAX;
+    d_pipeMaxSize = readProcValue("/proc/sys/fs/pipe-max-size", d_transfer.pipeBufferSize);
+  }
+
+  /*
+   *  @return the number in the file, or the default value when it can not be read.
+   */
+  static size_t readProcValue(char const *path, size_t defaultValue)
+  {
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL) {
+      return defaultValue;
+    }
+
+    unsigned long value;
+    if (fscanf(file, "%lu", &value) != 1) {
+      value = defaultValue;
+    }
+
+    fclose(file);
+    return value;
+  }
+
+  /*
+   *  @param bytes the number of bytes the pipe should hold.
+   *  @param current the current size of the pipe, which is part of the pipe memory.
+   *  @return the pipe size for the number of bytes, pipes only grow within the budget.
+   */
+  size_t pipeSizeFor(size_t bytes, size_t current)
+  {
+    size_t limit = std::min(d_transfer.pipeBufferSize, d_pipeMaxSize);
+    size_t size = MIN_PIPE_SIZE;
+
+    while (size < bytes && size < limit) {
+      size *= 2;
+    }
+
+    size = std::min(size, limit);
+
+    while (size > current && size > MIN_PIPE_SIZE && d_pipeBytes - current + size > d_pipeBudget) {
+      size /= 2;
+    }
+
+    return size;
+  }
+
+  /*
+   *  Accounts for the new pipe of a transfer and sizes it to hold the number of bytes.
+   */
+  void openedPipe(int pipeFd, ClientContext *context, size_t bytes)
+  {
+    int size = fcntl(pipeFd, F_GETPIPE_SZ);
+
+    // Pipes do not pass resetConnection, a read still pending for an earlier
+    // pipe on this descriptor must not resume this one.
+    context->generation++;
+
+    context->pipeSize = size > 0 ? size : MIN_PIPE_SIZE;
+    d_pipeBytes += context->pipeSize;
+    d_pipeBytesMetric.add(context->pipeSize);
+
+    resizePipe(pipeFd, context, pipeSizeFor(bytes, context->pipeSize));
+  }
+
+  void closedPipe(ClientContext *context)
+  {
+    d_pipeBytes -= context->pipeSize;
+    d_pipeBytesMetric.sub(context->pipeSize);
+    context->pipeSize = 0;
+  }
+
+  /*
+   *  Resizes the pipe of a transfer. When the kernel refuses to grow it, over
+   *  the limits of the user, smaller sizes are tried down to the current size.
+   */
+  void resizePipe(int pipeFd, ClientContext *context, size_t size)
+  {
+    while (size != context->pipeSize) {
+      int ret = fcntl(pipeFd, F_SETPIPE_SZ, size);
+
+      if (ret != -1) {
+	d_pipeBytes += ret - context->pipeSize;
+	d_pipeBytesMetric.add(static_cast<int64_t>(ret) - static_cast<int64_t>(context->pipeSize));
+	context->pipeSize = ret;
+	return;
+      }
+
+      d_pipeResizeFailuresMetric.add();
+
+      // A pipe that holds more than the new size can be shrunk later.
+      if (errno == EBUSY || size / 2 <= context->pipeSize) {
+	return;
+      }
+
+      size /= 2;
+    }
+  }
+
+  /*
+   *  Sizes the pipe of a transfer to hold PIPE_MILLISECONDS at the rate the
+   *  client drains it, so slow clients do not hold on to pipe memory.
+   */
+  void tunePipe(int pipeFd, ClientContext *context)
+  {
+    if (context->sendBufferPosition < context->pipeTuneAt) {
+      return;
+    }
+
+    context->pipeTuneAt = context->sendBufferPosition + PIPE_TUNE_INTERVAL;
+
+    size_t bytes = transferRate(context) * PIPE_MILLISECONDS / 1000;
+    resizePipe(pipeFd, context, pipeSizeFor(bytes, context->pipeSize));
+  }
+
+  /*
+   *  @return the number of bytes from the offset in the file of the context that
+   *          are in the page cache, at most length. This is length when the file
+   *          is not checked.
+   */
+  size_t cachedLength(ClientContext *context, size_t offset, size_t length)
+  {
+    static size_t const pageSize = sysconf(_SC_PAGESIZE);
+
+    if (context->fileMap == NULL || offset >= context->fileMapSize) {
+      return length;
+    }
+
+    if (context->prefetched) {
+      context->prefetched = false;
+      return length;
+    }
+
+    size_t firstPage = offset / pageSize;
+    size_t endPage = std::min((std::min(offset + length, context->fileMapSize) + pageSize - 1) / pageSize,
+			      firstPage + MAX_CHECKED_PAGES);
+    unsigned char pages[MAX_CHECKED_PAGES];
+
+    if (mincore(static_cast<char*>(context->fileMap) + firstPage * pageSize, (endPage - firstPage) * pageSize, pages) == -1) {
+      return length;
+    }
+
+    size_t cachedPages = 0;
+    while (firstPage + cachedPages < endPage && (pages[cachedPages] & 1)) {
+      ++cachedPages;
+    }
+
+    if (cachedPages == 0) {
+      return 0;
+    }
+
+    // The first page can start before the offset.
+    return std::min((firstPage + cachedPages) * pageSize - offset, length);
+  }
+
+  /*
+   *  Reads the cold range at the transfer position of the context on the file
+   *  pool, the transfer continues with the callback on the loop when the range
+   *  is in the page cache.
+   *
+   *  @return false when the pool can not take the read, the transfer then
+   *          continues on the loop.
+   */
+  bool prefetch(int fd, ClientContext *context)
+  {
+    // The transfer continues with the callback it stopped in, unless it timed
+    // out or the descriptor was reused by another transfer since.
+    uint32_t generation = context->generation;
+    if (!submitPrefetch(context, d_transfer.chunkSize, [this, fd, generation]() {
+	  if (d_clientTable[fd].prefetched && d_clientTable[fd].generation == generation) {
+	    Main::instance().poll().modify(fd, Poll::OUT | Poll::ERR);
+	  }
+	})) {
+      return false;
+    }
+
+    // Stop transfering until the range is read, the readiness stays recorded.
+    // A read that never comes back times the transfer out.
+    Main::instance().poll().modify(fd, Poll::TIMEOUT);
+    return true;
+  }
+
+  /*
+   *  Reads at most length bytes from the transfer position of the context on
+   *  the file pool, done runs on the loop afterwards.
+   *
+   *  @return false when the pool can not take the read.
+   */
+  bool submitPrefetch(ClientContext *context, size_t length, std::function<void()> done)
+  {
+    if (!d_filePool) {
+      return false;
+    }
+
+    int fileFd = context->sourceFd;
+    size_t offset = context->sendBufferPosition;
+    length = std::min(length, context->fileMapSize - offset);
+
+    // The file stays open while the read is pending, since only the transfer closes it.
+    if (!d_filePool->submit([fileFd, offset, length]() { readRange(fileFd, offset, length); },
+			    [this, done = std::move(done)]() { releaseFilePools(); done(); })) {
+      return false;
+    }
+
+    context->prefetched = true;
+    d_prefetchesMetric.add();
+    d_prefetchedBytesMetric.add(length);
+    return true;
+  }
+
+  /*
+   *  Lets the transfer that writes to the pipe share the read of its file with
+   *  the other transfers of the file that start in the same loop iteration.
+   *  The first pump, when the pipe is writable, closes the read to new
+   *  transfers.
+   */
+  void joinFanOut(int pipeFd, OpenedFile const &file)
+  {
+    std::tuple<dev_t, ino_t, size_t> key(file.device, file.inode, file.size);
+    std::map<std::tuple<dev_t, ino_t, size_t>, FanOut*>::iterator i = d_fanOuts.find(key);
+    FanOut *fanOut;
+
+    if (i != d_fanOuts.end()) {
+      fanOut = i->second;
+    } else {
+      fanOut = createFanOut(file);
+      d_fanOuts[key] = fanOut;
+    }
+
+    fanOut->subscribers.push_back(pipeFd);
+    d_clientTable[pipeFd].fanOut = fanOut;
+
+    try {
+      Main::instance().poll().add(pipeFd, Poll::OUT | Poll::ERR, _doFanOutReady, this);
+    } catch (...) {
+      fanOut->subscribers.pop_back();
+      d_clientTable[pipeFd].fanOut = NULL;
+
+      if (fanOut->subscribers.empty()) {
+	d_fanOuts.erase(key);
+	closeFanOut(fanOut);
+      }
+
+      throw;
+    }
+  }
+
+  /*
+   *  @throw ErrnoException when the descriptor can not be duplicated or the pipe can not be created.
+   */
+  FanOut *createFanOut(OpenedFile const &file)
+  {
+    int fileFd = fcntl(file.fd, F_DUPFD_CLOEXEC, 0);
+
+    if (fileFd == -1) {
+      throw ErrnoException(errno);
+    }
+
+    FanOut *fanOut = new FanOut();
+    fanOut->device = file.device;
+    fanOut->inode = file.inode;
+    fanOut->size = file.size;
+    fanOut->fileFd = fileFd;
+    fanOut->buffered = 0;
+    fanOut->started = false;
+    fanOut->prefetching = false;
+
+    if (pipe2(fanOut->pipeFds, O_NONBLOCK | O_CLOEXEC) == -1) {
+      int error = errno;
+      close(fileFd);
+      delete fanOut;
+      throw ErrnoException(error);
+    }
+
+    LOG_DEBUG("Opening %d (fan out).", fileFd);
+    LOG_DEBUG("Opening %d (fan out pipe[0]).", fanOut->pipeFds[0]);
+    LOG_DEBUG("Opening %d (fan out pipe[1]).", fanOut->pipeFds[1]);
+
+    ClientContext *source = d_clientTable + fileFd;
+    source->sourceFd = fileFd;
+    source->sendBufferPosition = 0;
+    resetFileTransfer(source);
+
+    // The pipe is accounted to the context of the file, it only holds a block.
+    openedPipe(fanOut->pipeFds[1], source, std::min(d_transfer.chunkSize, d_transfer.pipeBufferSize / 4));
+    fanOut->blockSize = std::min(std::min(d_transfer.chunkSize, d_transfer.pipeBufferSize / 4), source->pipeSize);
+
+    return fanOut;
+  }
+
+  void closeFanOut(FanOut *fanOut)
+  {
+    closedPipe(d_clientTable + fanOut->fileFd);
+    closeSource(d_clientTable + fanOut->fileFd);
+
+    LOG_DEBUG("Closing %d.", fanOut->pipeFds[0]);
+    LOG_DEBUG("Closing %d.", fanOut->pipeFds[1]);
+    close(fanOut->pipeFds[0]);
+    close(fanOut->pipeFds[1]);
+
+    delete fanOut;
+  }
+
+  /*
+   *  Continues a transfer that was part of a shared read on its own, from the
+   *  offset in the file.
+   */
+  void dropOut(FanOut *fanOut, size_t index, size_t offset)
+  {
+    int pipeFd = fanOut->subscribers[index];
+    ClientContext *context = d_clientTable + pipeFd;
+
+    fanOut->subscribers[index] = fanOut->subscribers.back();
+    fanOut->subscribers.pop_back();
+
+    context->fanOut = NULL;
+    context->sendBufferPosition = offset;
+    context->pipeTuneAt = offset + PIPE_TUNE_INTERVAL;
+
+    if (offset < fanOut->size) {
+      startFileTransfer(context, fanOut->size);
+
+      // The transfers that still share the read need the pages behind this one.
+      if (!fanOut->subscribers.empty()) {
+	context->dropBehind = false;
+      }
+    } else {
+      resetFileTransfer(context);
+    }
+
+    // The pipe is either not empty or already writable, so the copy is run.
+    Main::instance().poll().modify(pipeFd, Poll::OUT | Poll::ERR, _doCopyFromSource, this);
+  }
+
+  /*
+   *  Reads the next block of a shared read and tees it into the pipes of the
+   *  transfers.
+   *
+   *  Every transfer gets every block. The reads go as fast as the fastest
+   *  transfer, a transfer of which the pipe has no room for the block is too far
+   *  behind and continues on its own. The transfers also continue on their own
+   *  at the end of the file, to finish through the usual path.
+   */
+  void pumpFanOut(FanOut *fanOut)
+  {
+    if (fanOut->prefetching) {
+      return;
+    }
+
+    ClientContext *source = d_clientTable + fanOut->fileFd;
+
+    if (!fanOut->started) {
+      fanOut->started = true;
+      d_fanOuts.erase(std::tuple<dev_t, ino_t, size_t>(fanOut->device, fanOut->inode, fanOut->size));
+
+      // Nothing to share with a single transfer.
+      if (fanOut->subscribers.size() == 1) {
+	dropOut(fanOut, 0, 0);
+      }
+
+      if (fanOut->subscribers.size() > 1) {
+	d_fanOutsMetric.add();
+	startFileTransfer(source, fanOut->size);
+
+	// Other transfers of the file fall behind and read it too, so it is not dropped.
+	source->dropBehind = false;
+
+	// Blocks are a part of the pipes of the transfers, so a transfer only
+	// drops out when it is most of its pipe behind the fastest one.
+	for (int pipeFd : fanOut->subscribers) {
+	  fanOut->blockSize = std::min(fanOut->blockSize, d_clientTable[pipeFd].pipeSize / 4);
+	}
+      }
+    }
+
+    // The transfers all dropped out or went away.
+    if (fanOut->subscribers.empty()) {
+      closeFanOut(fanOut);
+      return;
+    }
+
+    for (size_t i = 0; i < d_transfer.spliceCount; ++i) {
+      size_t position = source->sendBufferPosition;
+
+      if (fanOut->buffered == 0) {
+	if (position >= fanOut->size) {
+	  goto finished;
+	}
+
+	size_t length = cachedLength(source, position, std::min(fanOut->blockSize, fanOut->size - position));
+
+	// Wait for a cold block on the file pool, without running the transfers until then.
+	if (length == 0) {
+	  if (submitPrefetch(source, fanOut->blockSize, [this, fanOut]() { prefetchedFanOut(fanOut); })) {
+	    fanOut->prefetching = true;
+	    return;
+	  }
+
+	  length = std::min(fanOut->blockSize, fanOut->size - position);
+	}
+
+	loff_t offset = position;
+	ssize_t ret = splice(fanOut->fileFd, &offset, fanOut->pipeFds[1], NULL, length, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+	PLAIN_PROBE4(splice, fanOut->pipeFds[1], fanOut->fileFd, ret, ret == -1 ? errno : 0);
+	d_spliceCallsMetric.add();
+
+	// The transfers run into the error or the truncated file on their own.
+	if (ret <= 0) {
+	  goto finished;
+	}
+
+	fanOut->buffered = ret;
+      }
+
+      // Wait until a transfer has room for the block. The first one with room
+      // is the last to get it.
+      size_t receivers = 0;
+      size_t last = 0;
+
+      for (size_t j = 0; j < fanOut->subscribers.size(); ++j) {
+	if (pipeRoom(fanOut->subscribers[j]) >= fanOut->buffered) {
+	  if (receivers++ == 0) {
+	    last = j;
+	  }
+	}
+      }
+
+      if (receivers == 0) {
+	return;
+      }
+
+      // Walk back, so the transfers that drop out do not move the ones still to go.
+      for (size_t j = fanOut->subscribers.size(); j-- > 0; ) {
+	int pipeFd = fanOut->subscribers[j];
+
+	if (pipeRoom(pipeFd) < fanOut->buffered) {
+	  d_fanOutDropsMetric.add();
+	  dropOut(fanOut, j, position);
+	  continue;
+	}
+
+	// The last transfer gets the block itself, which empties the pipe of the read.
+	ssize_t ret;
+
+	if (j == last) {
+	  ret = splice(fanOut->pipeFds[0], NULL, pipeFd, NULL, fanOut->buffered, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	} else {
+	  ret = tee(fanOut->pipeFds[0], pipeFd, fanOut->buffered, SPLICE_F_NONBLOCK);
+	  d_bytesTeedMetric.add(std::max<ssize_t>(ret, 0));
+	}
+
+	// The reader of the pipe went away, or the pipe filled up after all.
+	if (ret != static_cast<ssize_t>(fanOut->buffered)) {
+	  d_fanOutDropsMetric.add();
+	  dropOut(fanOut, j, position + std::max<ssize_t>(ret, 0));
+
+	  if (j == last && ret > 0) {
+	    discardPipe(fanOut->pipeFds[0], fanOut->buffered - ret);
+	  }
+	}
+
+	if (j == last && ret <= 0) {
+	  discardPipe(fanOut->pipeFds[0], fanOut->buffered);
+	}
+      }
+
+      source->sendBufferPosition += fanOut->buffered;
+      fanOut->buffered = 0;
+      fileTransfered(source);
+
+      if (fanOut->subscribers.empty()) {
+	closeFanOut(fanOut);
+	return;
+      }
+    }
+
+    return;
+
+  finished:
+    while (!fanOut->subscribers.empty()) {
+      dropOut(fanOut, fanOut->subscribers.size() - 1, source->sendBufferPosition);
+    }
+
+    closeFanOut(fanOut);
+  }
+
+  /*
+   *  Continues a shared read after its cold block was read on the file pool.
+   */
+  void prefetchedFanOut(FanOut *fanOut)
+  {
+    fanOut->prefetching = false;
+
+    // Run the transfers again, the ones that became writable in the mean time right away.
+    for (int pipeFd : fanOut->subscribers) {
+      Main::instance().poll().modify(pipeFd, Poll::OUT | Poll::ERR);
+    }
+
+    pumpFanOut(fanOut);
+  }
+
+  /*
+   *  @return the number of bytes that can be written to a pipe of a transfer without blocking.
+   */
+  size_t pipeRoom(int pipeFd)
+  {
+    int used = 0;
+
+    if (ioctl(pipeFd, FIONREAD, &used) == -1) {
+      return 0;
+    }
+
+    size_t size = d_clientTable[pipeFd].pipeSize;
+    return static_cast<size_t>(used) < size ? size - used : 0;
+  }
+
+  /*
+   *  Reads and throws away bytes from a pipe.
+   */
+  static void discardPipe(int fd, size_t length)
+  {
+    char buffer[4096];
+
+    while (length > 0) {
+      ssize_t ret = read(fd, buffer, std::min(length, sizeof(buffer)));
+
+      if (ret <= 0) {
+	break;
+      }
+
+      length -= ret;
+    }
+  }
+
+  /*
+   *  Reads a range of a file into the page cache, this can run on any thread.
+   */
+  static void readRange(int fd, size_t offset, size_t length)
+  {
+    static thread_local char buffer[64 * 1024];
+
+    // Start reading the whole range, then wait for it by reading it.
+    readahead(fd, offset, length);
+
+    while (length > 0) {
+      ssize_t ret = pread(fd, buffer, std::min(length, sizeof(buffer)), offset);
+
+      if (ret == -1 && errno == EINTR) {
+	continue;
+      }
+
+      if (ret <= 0) {
+	break;
+      }
+
+      offset += ret;
+      length -= ret;
+    }
+  }
+
+  /*
+   *  Creates the response headers of a file response in the client buffer and sets them as the send buffer.
+   */
+  void prepareFileHeader(ClientContext *context,
+			 std::chrono::steady_clock::time_point openStart,
+			 std::chrono::steady_clock::time_point openEnd)
+  {
+    Http::Response response(context->buffer, DEFAULT_BUFFER_SIZE, 200, "Okay");
+    response.addHeaderField("Content-Length", context->contentLength);
+    response.addHeaderField("Connection", "keep-alive");
+
+    if (context->serverTiming) {
+      addServerTiming(context, response, openStart, openEnd);
+    }
+      
+    // Set the buffer fill to the header size.
+    context->bufferFill = response.size();
+
+    // Set the send buffer.
+    context->sendBuffer = context->buffer;
+    context->sendBufferSize = context->bufferFill;
+    context->sendBufferPosition = 0;
+  }
+
+  /*
+   *  Adds the Server-Timing header, with durations in milliseconds.
+   */
+  void addServerTiming(ClientContext *context, Http::Response &response,
+		       std::chrono::steady_clock::time_point openStart,
+		       std::chrono::steady_clock::time_point openEnd)
+  {
+    char value[128];
+
+    snprintf(value, sizeof(value), "read;dur=%.3f, queue;dur=%.3f, handler;dur=%.3f, open;dur=%.3f",
+	     nanoseconds(context->headerReceived - context->requestStart) * 1e-6,
+	     context->queueWait * 1e-6,
+	     nanoseconds(openStart - context->headerReceived) * 1e-6,
+	     nanoseconds(openEnd - openStart) * 1e-6);
+
+    response.addHeaderField("Server-Timing", value);
+  }
+
+  void setTransferOptions(TransferOptions const &options)
+  {
+    if (!d_filePool || d_filePool->size() != options.fileThreads) {
+      // Destroying a pool drops its queued jobs without their results.
+      if (d_filePool && d_filePool->pending() != 0) {
+	d_retiredFilePools.push_back(std::move(d_filePool));
+      }
+
+      d_filePool.reset(options.fileThreads != 0 ? new WorkerPool(options.fileThreads, WorkerPool::DEFAULT_QUEUE_CAPACITY, "file") : NULL);
+    }
+
+    d_transfer = options;
+  }
+
+  void enableServerTiming(HttpRequest const &request)
+  {
+    // Check if the file descriptor is in bounds.
+    if (request.fd() < 0 || request.fd() >= d_clientTableSize) {
+      throw std::runtime_error("file descriptor out of bounds");
+    }
+
+    d_clientTable[request.fd()].serverTiming = true;
+  }
+
+  void drop(HttpRequest const &request)
+  {
+    // Check if the file descriptor is in bounds.
+    if (request.fd() < 0 || request.fd() >= d_clientTableSize) {
+      throw std::runtime_error("file descriptor out of bounds");
+    }
+
+    connectionClosed(d_clientTable + request.fd());
+    Main::instance().poll().close(request.fd());
+  }
+
+  /*
+   *  Implements deferring the response to a request.
+   */
+  HttpResponseToken defer(HttpServer *server, HttpRequest const &request)
+  {
+    // Check if the file descriptor is in bounds.
+    if (request.fd() < 0 || request.fd() >= d_clientTableSize) {
+      throw std::runtime_error("file descriptor out of bounds");
+    }
+
+    ClientContext *context = d_clientTable + request.fd();
+
+    if (context->state != HTTP_STATE_HEADER_RECEIVED) {
+      throw std::runtime_error("only a request that is being handled can be deferred");
+    }
+
+    setState(context, HTTP_STATE_DEFERRED);
+    d_deferredMetric.add();
+
+    // Stop reading, but keep the timeout so a response that never completes
+    // does not hold on to the connection.
+    Main::instance().poll().modify(request.fd(), Poll::TIMEOUT, _doClientDeferred, this);
+
+    return HttpResponseToken(server, request.fd(), context->generation);
+  }
+
+  /*
+   *  Resumes a deferred request on the loop thread.
+   *
+   *  @return the context of the request, or NULL when the token is stale.
+   */
+  ClientContext *resume(HttpResponseToken const &token)
+  {
+    if (token.fd() < 0 || token.fd() >= d_clientTableSize) {
+      throw std::runtime_error("file descriptor out of bounds");
+    }
+
+    ClientContext *context = d_clientTable + token.fd();
+
+    if (context->state != HTTP_STATE_DEFERRED || context->generation != token.generation()) {
+      d_deferredStaleMetric.add();
+      return NULL;
+    }
+
+    context->handlerReturned = std::chrono::steady_clock::now();
+    setState(context, HTTP_STATE_HEADER_RECEIVED);
+
+    return context;
+  }
+
+  /*
+   *  Waits for a deferred response or the file of a response, the connection
+   *  is closed when it times out.
+   */
+  IO_EVENT_HANDLER(doClientDeferred)
+  {
+    ClientContext *context = d_clientTable + fd;
+
+    if (events & Poll::TIMEOUT) {
+      d_timeoutsMetric.add();
+      connectionClosed(context);
+      asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
+      return;
+    }
+
+    asyncResult.completed(Poll::NONE_COMPLETED);
+  }
+
+  /*
+   *  Completes a deferred request on the loop thread, nothing is done when the
+   *  token is stale. Nobody catches errors on the loop, so a response that
+   *  fails closes the connection.
+   */
+  template <class Respond>
+  void complete(HttpResponseToken const &token, Respond respond)
+  {
+    Main::instance().post([this, token, respond]() {
+	ClientContext *context = resume(token);
+
+	if (context == NULL) {
+	  return;
+	}
+
+	try {
+	  respond(context);
+	} catch (std::exception const &e) {
+	  LOG_ERROR("Completing a deferred response failed: %s.", e.what());
+	  connectionClosed(context);
+	  Main::instance().poll().close(token.fd());
+	}
+      });
+  }
+
+  void respondWithStaticString(HttpResponseToken const &token, const char *str, size_t length)
+  {
+    complete(token, [this, str, length](ClientContext *context) {
+	respondWithStaticString(context->request, str, length);
+      });
+  }
+
+  void respondWithFile(HttpResponseToken const &token, std::string const &path)
+  {
+    complete(token, [this, path](ClientContext *context) {
+	respondWithFile(context->request, path.c_str());
+      });
+  }
+
+  void drop(HttpResponseToken const &token)
+  {
+    complete(token, [this](ClientContext *context) {
+	drop(context->request);
+      });
+  }
+  
+  IO_EVENT_HANDLER(doWriteHeader)
   {
     //    std::cout << "doWriteHeader()\n";
     
     ClientContext *context = d_clientTable + fd;
 
+    // The source of the response is only closed by the transfer, which did not start.
     if (events & Poll::TIMEOUT) {
       //      close(fd);
-      std::cout << "closing " << fd << ".\n";
+      d_timeoutsMetric.add();
+      closeSource(context);
+      connectionClosed(context);
       asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
       return;
     }
@@ -639,21 +2377,25 @@ struct HttpServer::Internal {
     
     // Write part of the buffer.
     int ret = write(fd, context->sendBuffer + context->sendBufferPosition, context->sendBufferSize - context->sendBufferPosition);
+    d_writeCallsMetric.add();
 
     if (ret == -1) {
       if (errno == EAGAIN) {
 	// Non blocking behavior, so we need to wait for the socket to become writable again.
+	d_writeAgainMetric.add();
 	asyncResult.completed(Poll::WRITE_COMPLETED);
       } else if (errno == EPIPE) {
 	// Connection was dropped.
-	std::cout << "closing " << fd << ".\n";
+	closeSource(context);
+	connectionClosed(context);
 	asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
       } else {
 	//      std::cout << "- Error writing header.\n";
 	// TODO: log error.
 	// Another error occured, close the file descriptor.
 	//      close(fd);
-	std::cout << "closing " << fd << ".\n";
+	closeSource(context);
+	connectionClosed(context);
 	asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
       }
       return;
@@ -661,20 +2403,36 @@ struct HttpServer::Internal {
       // Zero write, socket probably has closed
       //      close(fd);
       //      std::cout << "- Connection closed while writing header.\n";
-      std::cout << "closing " << fd << ".\n";
+      closeSource(context);
+      connectionClosed(context);
       asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
       return;
     }
 
     // Update the send buffer position.
     context->sendBufferPosition += ret;
+    bytesWritten(context, ret);
+    d_bytesWrittenMetric.add(ret);
 
     // Check if we are done sending data.
     if (context->sendBufferPosition == context->sendBufferSize) {
       context->sendBufferPosition = 0;
       context->sendBufferSize = context->contentLength;
+
+      if (context->sendFile) {
+	if (context->contentLength == 0) {
+	  fileResponseSent(context, fd, asyncResult);
+	  return;
+	}
+
+	// The socket is still writable, so continue with the file right away.
+	Main::instance().poll().modify(fd, Poll::OUT, _doSendFile, this);
+	asyncResult.completed(Poll::NONE_COMPLETED);
+	return;
+      }
+
       //      std::cout << "- Done sending header (setting pipe ready event for " << context->sourceFd << ").\n";      
-      Main::instance().poll().add(context->sourceFd, Poll::IN, _doPipeReady, this);
+      Main::instance().poll().add(context->sourceFd, Poll::IN | Poll::HUP, _doPipeReady, this);
       Main::instance().poll().modify(fd, 0, _doCopyFromPipeToSocket, this);
       asyncResult.completed(Poll::REMOVE_DESCRIPTOR);
       return;
@@ -698,17 +2456,22 @@ struct HttpServer::Internal {
 
     //    std::cout << "splice(" << context->sourceFd << ", " << fd << ").\n";
 
-    for (size_t i = 0; i < DEFAULT_SPLICE_COUNT; ++i) {
+    for (size_t i = 0; i < d_transfer.spliceCount; ++i) {
     
       ssize_t ret = splice(context->sourceFd,
 			   NULL,
 			   fd,
 			   NULL,
-			   DEFAULT_CHUNK_SIZE,
+			   d_transfer.chunkSize,
 			   SPLICE_F_MOVE | SPLICE_F_MORE | SPLICE_F_NONBLOCK);
 
+      PLAIN_PROBE4(splice, fd, context->sourceFd, ret, ret == -1 ? errno : 0);
+      d_spliceCallsMetric.add();
+
       if (ret == -1) {
 	if (errno == EAGAIN) {
+	  d_spliceAgainMetric.add();
+
 	  // Check if the destination socket would block or if the source pipe would block.
 	  pollfd p = {fd, POLLOUT, 0};
 	  while (true) {
@@ -726,8 +2489,9 @@ struct HttpServer::Internal {
 	    // Socket write would block, wait for the socket buffer to free up.
 	    asyncResult.completed(Poll::WRITE_COMPLETED);
 	  } else {
-	    // Pipe read would block, we should wait for the pipe buffer to fill up.
-	    Main::instance().poll().add(context->sourceFd, Poll::IN, _doPipeReady, this);
+	    // Pipe read would block, we should wait for the pipe buffer to fill up,
+	    // or for the end of a truncated file.
+	    Main::instance().poll().add(context->sourceFd, Poll::IN | Poll::HUP, _doPipeReady, this);
 	    asyncResult.completed(Poll::REMOVE_DESCRIPTOR);
 	  }
 	  return;
@@ -742,62 +2506,200 @@ struct HttpServer::Internal {
       //    std::cout << "Send " << ret << " bytes of " << context->sendBufferSize << ".\n";
     
       context->sendBufferPosition += ret;
+      bytesWritten(context, ret);
+      d_bytesSplicedMetric.add(ret);
     
       // Check if we are done sending data.
       if (context->sendBufferPosition >= context->sendBufferSize) {
 	//	std::cout << "- Content done.\n";
+	fileResponseSent(context, fd, asyncResult);
+	return;
+      }
+
+    }
 
-	uncork(fd);
+    asyncResult.completed(Poll::NONE_COMPLETED);
+    return;
+
+  closed:
+    LOG_DEBUG("Closing %d.", context->sourceFd);
+    //Main::instance().poll().close(context->sourceFd);
+    close(context->sourceFd);
+    connectionClosed(context);
+    asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
+  }
+
+  /*
+   *  Finishes a file response of which all content was sent, closes the source descriptor.
+   */
+  void fileResponseSent(ClientContext *context, int fd, Poll::AsyncResult &asyncResult)
+  {
+    uncork(fd);
       
-	std::cout << "Closing " << context->sourceFd << ".\n";
-	close(context->sourceFd);
+    closeSource(context);
       
-	if (context->request.connection() == Http::CONNECTION_KEEP_ALIVE) {
-	  // We have a keep alive connection, so reset the connection state to expect
-	  // a new request.
-	  resetConnection(context);
+    if (context->request.connection() == Http::CONNECTION_KEEP_ALIVE) {
+      // We have a keep alive connection, so reset the connection state to expect
+      // a new request.
+      recordPhases(context);
+      logRequest(context);
+      resetConnection(context);
+
+      // Modify the poll event handler to wait for input data.
+      Main::instance().poll().modify(fd, Poll::IN | Poll::TIMEOUT, _doClientReadHeader, this);
+
+      // Indicate that the write was completed and we do not need another iteration.
+      asyncResult.completed(Poll::WRITE_COMPLETED);
+      return;
+    }
+
+    // Connection is not keep-alive, so clode the socket and indicate this back to the poll system.
+    recordPhases(context);
+    connectionClosed(context);
+    asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
+  }
+
+  /*
+   *  Sends the file directly from the file to the socket.
+   */
+  IO_EVENT_HANDLER(doSendFile)
+  {
+    ClientContext *context = d_clientTable + fd;
+
+    // A read on the file pool did not come back.
+    if (events & Poll::TIMEOUT) {
+      d_timeoutsMetric.add();
+      context->prefetched = false;
+      goto closed;
+    }
+
+    for (size_t i = 0; i < d_transfer.spliceCount; ++i) {
+
+      size_t length = cachedLength(context, context->sendBufferPosition,
+				   std::min<size_t>(d_transfer.chunkSize, context->sendBufferSize - context->sendBufferPosition));
+
+      // Sending a cold range would block the loop on the disk.
+      if (length == 0) {
+	if (prefetch(fd, context)) {
+	  asyncResult.completed(Poll::NONE_COMPLETED);
+	  return;
+	}
+
+	length = std::min<size_t>(d_transfer.chunkSize, context->sendBufferSize - context->sendBufferPosition);
+      }
+
+      off_t offset = context->sendBufferPosition;
+      ssize_t ret = sendfile(fd,
+			     context->sourceFd,
+			     &offset,
+			     length);
 
-	  // Modify the poll event handler to wait for input data.
-	  Main::instance().poll().modify(fd, Poll::IN | Poll::TIMEOUT, _doClientReadHeader, this);
+      PLAIN_PROBE4(sendfile, fd, context->sourceFd, ret, ret == -1 ? errno : 0);
+      d_sendFileCallsMetric.add();
 
-	  // Indicate that the write was completed and we do not need another iteration.
+      if (ret == -1) {
+	if (errno == EAGAIN) {
+	  // Socket write would block, wait for the socket buffer to free up.
+	  d_writeAgainMetric.add();
 	  asyncResult.completed(Poll::WRITE_COMPLETED);
 	  return;
+	} else if (errno == EPIPE || errno == ECONNRESET) {
+	  goto closed;
 	}
+	throw ErrnoException(errno);
+      } else if (ret == 0) {
+	// The file was truncated.
+	goto closed;
+      }
 
-	// Connection is not keep-alive, so clode the socket and indicate this back to the poll system.
-	//      close(fd);
-	//      std::cout << "closing " << fd << ".\n";
-	asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
+      context->sendBufferPosition += ret;
+      bytesWritten(context, ret);
+      d_bytesSentFileMetric.add(ret);
+      fileTransfered(context);
+
+      if (context->sendBufferPosition >= context->sendBufferSize) {
+	fileResponseSent(context, fd, asyncResult);
 	return;
       }
-
     }
 
     asyncResult.completed(Poll::NONE_COMPLETED);
     return;
 
   closed:
-    std::cout << "Closing " << context->sourceFd << ".\n";
-    //Main::instance().poll().close(context->sourceFd);
-    close(context->sourceFd);
+    closeSource(context);
+    connectionClosed(context);
     asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
   }
 
+  /*
+   *  Pumps the shared read of a transfer when its pipe is writable.
+   */
+  IO_EVENT_HANDLER(doFanOutReady)
+  {
+    ClientContext *context = d_clientTable + fd;
+    FanOut *fanOut = context->fanOut;
+
+    // The reader of the pipe went away, the copy of the transfer closes it.
+    if (events & Poll::ERR) {
+      size_t index = std::find(fanOut->subscribers.begin(), fanOut->subscribers.end(), fd) - fanOut->subscribers.begin();
+      dropOut(fanOut, index, d_clientTable[fanOut->fileFd].sendBufferPosition);
+    }
+
+    pumpFanOut(fanOut);
+
+    if (context->fanOut == NULL) {
+      // The transfer dropped out, its own copy runs next.
+      asyncResult.completed(Poll::NONE_COMPLETED);
+    } else if (fanOut->prefetching) {
+      // Keep the readiness for when the block is read, without running until then.
+      Main::instance().poll().modify(fd, 0);
+      asyncResult.completed(Poll::NONE_COMPLETED);
+    } else {
+      // The pipe is full or got blocks, its reader makes it writable again.
+      asyncResult.completed(Poll::WRITE_COMPLETED);
+    }
+  }
+
   IO_EVENT_HANDLER(doCopyFromSource)
   {
     //    std::cout << "- doCopyFromSource().\n";
     ClientContext *context = d_clientTable + fd;
 
-    for (size_t i = 0; i < DEFAULT_SPLICE_COUNT; ++i) {
-    
+    // A read on the file pool did not come back, closing the pipe ends the response.
+    if (events & Poll::TIMEOUT) {
+      d_timeoutsMetric.add();
+      context->prefetched = false;
+      goto closed;
+    }
+
+    for (size_t i = 0; i < d_transfer.spliceCount; ++i) {
+
+      // SPLICE_F_NONBLOCK only applies to the pipe, splicing a cold range
+      // would block the loop on the disk.
+      size_t chunkSize = std::min(d_transfer.chunkSize, context->pipeSize);
+      size_t length = cachedLength(context, context->sendBufferPosition, chunkSize);
+
+      if (length == 0) {
+	if (prefetch(fd, context)) {
+	  asyncResult.completed(Poll::NONE_COMPLETED);
+	  return;
+	}
+
+	length = chunkSize;
+      }
+
+      loff_t offset = context->sendBufferPosition;
       ssize_t ret = splice(context->sourceFd,
-			   NULL,
+			   &offset,
 			   fd,
 			   NULL,
-			   DEFAULT_CHUNK_SIZE,
+			   length,
 			   SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
 
+      PLAIN_PROBE4(splice, fd, context->sourceFd, ret, ret == -1 ? errno : 0);
+      d_spliceCallsMetric.add();
+
       if (ret == -1) {
 	if (errno == EAGAIN) {
 	  asyncResult.completed(Poll::WRITE_COMPLETED);
@@ -810,14 +2712,17 @@ struct HttpServer::Internal {
 	goto closed;
       }
 
+      context->sendBufferPosition += ret;
+      fileTransfered(context);
+      tunePipe(fd, context);
     }
     
     asyncResult.completed(Poll::NONE_COMPLETED);
     return;
     
   closed:
-    std::cout << "Closing " << context->sourceFd << ".\n";
-    close(context->sourceFd);
+    closedPipe(context);
+    closeSource(context);
     asyncResult.completed(Poll::CLOSE_DESCRIPTOR);
   }
 
@@ -839,6 +2744,11 @@ void HttpServer::respondWithStaticString(HttpRequest const &request, const char
 }
 
 void HttpServer::respondWithFile(HttpRequest const &request, std::string const &path)
+{
+  d->respondWithFile(request, path.c_str());
+}
+
+void HttpServer::respondWithFile(HttpRequest const &request, std::string_view path)
 {
   d->respondWithFile(request, path);
 }
@@ -847,3 +2757,65 @@ void HttpServer::drop(HttpRequest const &request)
 {
   d->drop(request);
 }
+
+HttpResponseToken HttpServer::defer(HttpRequest const &request)
+{
+  return d->defer(this, request);
+}
+
+void HttpServer::respondWithStaticString(HttpResponseToken const &token, const char *str, size_t length)
+{
+  d->respondWithStaticString(token, str, length);
+}
+
+void HttpServer::respondWithFile(HttpResponseToken const &token, std::string const &path)
+{
+  d->respondWithFile(token, path);
+}
+
+void HttpServer::drop(HttpResponseToken const &token)
+{
+  d->drop(token);
+}
+
+void HttpServer::enableServerTiming(HttpRequest const &request)
+{
+  d->enableServerTiming(request);
+}
+
+void HttpServer::setStatusUri(std::string const &uri)
+{
+  d->d_statusUri = uri;
+}
+
+void HttpServer::setTransferOptions(TransferOptions const &options)
+{
+  d->setTransferOptions(options);
+}
+
+HttpServer::TransferOptions const &HttpServer::transferOptions() const
+{
+  return d->d_transfer;
+}
+
+HttpServer::TransferOptions::TransferOptions()
+  : strategy(TRANSFER_SPLICE),
+    pipeBufferSize(DEFAULT_PIPE_BUFFER_SIZE),
+    chunkSize(DEFAULT_CHUNK_SIZE),
+    spliceCount(DEFAULT_SPLICE_COUNT),
+    fileThreads(DEFAULT_FILE_THREADS),
+    prefetchThreshold(DEFAULT_PREFETCH_THRESHOLD),
+    dropBehindThreshold(DEFAULT_DROP_BEHIND_THRESHOLD),
+    fanOutThreshold(DEFAULT_FAN_OUT_THRESHOLD)
+{
+}
+
+void HttpServer::setAccessLog(std::shared_ptr<AccessLog> const &accessLog)
+{
+  d->d_accessLog = accessLog;
+}
+
+void HttpServer::setRequestCapture(std::shared_ptr<RequestCapture> const &capture)
+{
+  d->d_capture = capture;
+}
@@ -2,12 +2,17 @@
 #define __INC_PLAIN_HTTPSERVER_H__
 
 #include <memory>
+#include <string>
+#include <string_view>
 
 namespace plain {
 
   // Forward declarations.
   class HttpRequest;
   class HttpRequestHandler;
+  class HttpResponseToken;
+  class AccessLog;
+  class RequestCapture;
 
   /**
    *  Http server
@@ -17,6 +22,61 @@ namespace plain {
   class HttpServer {
   public:
 
+    /**
+     *  How the content of a file is transfered to the socket.
+     */
+    enum TransferStrategy {
+      // splice() the file into a pipe and the pipe into the socket.
+      TRANSFER_SPLICE,
+
+      // sendfile() the file into the socket.
+      TRANSFER_SENDFILE,
+    };
+
+    /**
+     *  File transfer parameters.
+     */
+    struct TransferOptions {
+      TransferStrategy strategy;
+
+      // The largest size of the intermediate pipe buffers (splice only). The
+      // pipes are sized to the file and to the rate the client drains them,
+      // within the pipe memory limit of the user.
+      size_t pipeBufferSize;
+
+      // The maximum number of bytes per splice or sendfile call, the splices
+      // from a file are also limited to the size of their pipe.
+      size_t chunkSize;
+
+      // The maximum number of splice or sendfile calls per IO event.
+      size_t spliceCount;
+
+      // The number of threads that open the files of responses and read their
+      // ranges that are not in the page cache, so a slow disk does not stall
+      // the loop. 0 does both on the loop.
+      size_t fileThreads;
+
+      // Files of at least this size in bytes are read sequentially ahead of
+      // the transfer, and checked for ranges that are not in the page cache
+      // before they are transfered. 0 does this for no files.
+      size_t prefetchThreshold;
+
+      // Files of at least this size in bytes are dropped from the page cache
+      // behind the transfer, so they do not evict the small files that are
+      // served often. 0 drops no files.
+      size_t dropBehindThreshold;
+
+      // Files of at least this size in bytes that are requested at the same
+      // time are read once and duplicated into the pipes of the transfers with
+      // tee (splice only). 0 reads every transfer on its own.
+      size_t fanOutThreshold;
+
+      /**
+       *  Initializes the options to the defaults.
+       */
+      TransferOptions();
+    };
+
     /**
      *  Creates a new Http server,
      *
@@ -36,13 +96,91 @@ namespace plain {
 
     /**
      *  Sends the content of a file as a response to the specified request.
+     *
+     *  A file that can not be opened gets a 404, 403 or 500 response, whether
+     *  it is opened on the loop or on the file pool.
      */
     void respondWithFile(HttpRequest const &request, std::string const &path);
 
+    /**
+     *  Sends the content of a file as a response to the specified request.
+     *
+     *  @param path the path of the file, does not need to be zero terminated.
+     *
+     *  This does not allocate, so it can be used with paths built in the request arena.
+     */
+    void respondWithFile(HttpRequest const &request, std::string_view path);
+
     /**
      *  Drops the request.
      */
     void drop(HttpRequest const &request);
+
+    /**
+     *  Defers the response to the specified request.
+     *
+     *  This should be called by the request handler instead of responding. The
+     *  returned token can be completed later and from any thread, the request
+     *  stays valid until then. The connection is closed when the response is
+     *  not completed within the connection timeout.
+     */
+    HttpResponseToken defer(HttpRequest const &request);
+
+    /**
+     *  Sends a static string as the response of a deferred request, this can be called from any thread.
+     */
+    void respondWithStaticString(HttpResponseToken const &token, const char *str, size_t length);
+
+    /**
+     *  Sends the content of a file as the response of a deferred request, this can be called from any thread.
+     */
+    void respondWithFile(HttpResponseToken const &token, std::string const &path);
+
+    /**
+     *  Drops a deferred request, this can be called from any thread.
+     */
+    void drop(HttpResponseToken const &token);
+
+    /**
+     *  Adds a Server-Timing header to the response of the specified request.
+     *
+     *  The header reports the time spent reading the request header (read), waiting
+     *  in the run queue (queue), in the request handler (handler) and opening the
+     *  file (open). This should be called by the request handler before it responds,
+     *  it only applies to file responses, as static strings contain their own headers.
+     *  It is cheap, but it does add some response bytes, so it is meant for sampled
+     *  requests.
+     */
+    void enableServerTiming(HttpRequest const &request);
+
+    /**
+     *  Sets the access log to write a record to for every response, NULL disables access logging.
+     */
+    void setAccessLog(std::shared_ptr<AccessLog> const &accessLog);
+
+    /**
+     *  Sets the request capture to copy the raw request headers to, NULL disables capturing.
+     */
+    void setRequestCapture(std::shared_ptr<RequestCapture> const &capture);
+
+    /**
+     *  Sets the uri at which the server metrics are served in the Prometheus text format.
+     *
+     *  Requests for this uri are answered by the server itself and never reach the
+     *  request handler. An empty uri (the default) disables this.
+     */
+    void setStatusUri(std::string const &uri);
+
+    /**
+     *  Sets the file transfer parameters, these apply to responses started afterwards.
+     *  A replaced file pool finishes its queued opens and reads first.
+     */
+    void setTransferOptions(TransferOptions const &options);
+
+    /**
+     *  @return the file transfer parameters.
+     */
+    TransferOptions const &transferOptions() const;
     
   private:
 
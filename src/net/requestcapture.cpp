@@ -0,0 +1,250 @@
+#include "requestcapture.h"
+#include "core/ringbuffer.h"
+#include "core/log.h"
+
+#include "exceptions/errnoexception.h"
+
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+#include <stdio.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace plain;
+
+static char const s_magic[8] = { 'P', 'L', 'A', 'I', 'N', 'C', 'A', 'P' };
+
+struct RequestCapture::Internal {
+
+  enum {
+    // The number of records in the ring buffer, the records are large.
+    RING_SIZE = 512,
+
+    // The interval in milliseconds at which the background thread drains the ring buffer.
+    FLUSH_INTERVAL = 100,
+
+    // The size of the output buffer of the background thread.
+    OUTPUT_BUFFER_SIZE = 64 * 1024,
+  };
+
+  // The record ring buffer.
+  RingBuffer<Record, RING_SIZE> d_ring;
+
+  // Sampling, only used by the server thread.
+  size_t d_sampleInterval;
+  size_t d_sampleCount;
+
+  // Number of records dropped because the ring was full.
+  std::atomic<size_t> d_dropped;
+
+  // The capture file, only used by the background thread after construction.
+  std::string d_path;
+  int d_fd;
+
+  // Output buffer of the background thread.
+  char d_output[OUTPUT_BUFFER_SIZE];
+  size_t d_outputFill;
+
+  // The background thread.
+  std::mutex d_threadMutex;
+  std::condition_variable d_threadCondition;
+  bool d_running;
+  std::thread d_thread;
+
+  Internal(std::string const &path, size_t sampleInterval)
+    : d_sampleInterval(sampleInterval == 0 ? 1 : sampleInterval),
+      d_sampleCount(0),
+      d_dropped(0),
+      d_path(path),
+      d_fd(-1),
+      d_outputFill(0),
+      d_running(true)
+  {
+    open();
+
+    d_thread = std::thread(&Internal::run, this);
+  }
+
+  ~Internal()
+  {
+    {
+      std::lock_guard<std::mutex> lk(d_threadMutex);
+      d_running = false;
+    }
+
+    d_threadCondition.notify_one();
+    d_thread.join();
+
+    drain();
+
+    if (d_fd != -1) {
+      ::close(d_fd);
+    }
+  }
+
+  // Opens the capture file, a new file gets the file header.
+  void open()
+  {
+    d_fd = ::open(d_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+
+    if (d_fd == -1) {
+      throw ErrnoException(errno);
+    }
+
+    if (lseek(d_fd, 0, SEEK_END) == 0) {
+      FileHeader header;
+      memset(&header, 0, sizeof(header));
+      memcpy(header.magic, s_magic, sizeof(s_magic));
+      header.version = FILE_VERSION;
+
+      append(&header, sizeof(header));
+    }
+  }
+
+  void append(void const *data, size_t size)
+  {
+    if (OUTPUT_BUFFER_SIZE - d_outputFill < size) {
+      writeOutput();
+    }
+
+    memcpy(d_output + d_outputFill, data, size);
+    d_outputFill += size;
+  }
+
+  void writeOutput()
+  {
+    char const *head = d_output;
+    char const *end = d_output + d_outputFill;
+
+    while (head != end) {
+      ssize_t ret = ::write(d_fd, head, end - head);
+
+      if (ret == -1) {
+	if (errno == EINTR) {
+	  continue;
+	}
+
+	LOG_WARNING("Failed to write request capture: %s.", strerror(errno));
+	break;
+      }
+
+      head += ret;
+    }
+
+    d_outputFill = 0;
+  }
+
+  void drain()
+  {
+    for (Record *record = d_ring.front(); record != NULL; record = d_ring.front()) {
+      FileRecord fileRecord;
+      fileRecord.time = record->time;
+      fileRecord.connection = record->connection;
+      fileRecord.headerLength = record->headerLength;
+
+      append(&fileRecord, sizeof(fileRecord));
+      append(record->header, record->headerLength);
+
+      d_ring.pop();
+    }
+
+    writeOutput();
+  }
+
+  void run()
+  {
+    std::unique_lock<std::mutex> lk(d_threadMutex);
+
+    while (d_running) {
+      d_threadCondition.wait_for(lk, std::chrono::milliseconds(FLUSH_INTERVAL));
+
+      lk.unlock();
+
+      drain();
+
+      lk.lock();
+    }
+  }
+
+};
+
+RequestCapture::RequestCapture(std::string const &path, size_t sampleInterval)
+  : d(new Internal(path, sampleInterval))
+{
+}
+
+RequestCapture::~RequestCapture()
+{
+}
+
+RequestCapture::Record *RequestCapture::reserve()
+{
+  if (d->d_sampleCount++ % d->d_sampleInterval != 0) {
+    return NULL;
+  }
+
+  Record *record = d->d_ring.reserve();
+
+  if (record == NULL) {
+    d->d_dropped.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  return record;
+}
+
+void RequestCapture::commit()
+{
+  d->d_ring.commit();
+}
+
+size_t RequestCapture::dropped() const
+{
+  return d->d_dropped.load(std::memory_order_relaxed);
+}
+
+void RequestCapture::read(std::string const &path, std::vector<Request> &requests)
+{
+  FILE *file = fopen(path.c_str(), "rb");
+
+  if (file == NULL) {
+    throw ErrnoException(errno);
+  }
+
+  FileHeader header;
+
+  if (fread(&header, sizeof(header), 1, file) != 1 ||
+      memcmp(header.magic, s_magic, sizeof(s_magic)) != 0 ||
+      header.version != FILE_VERSION) {
+    fclose(file);
+    throw std::runtime_error(path + " is not a request capture file");
+  }
+
+  FileRecord record;
+
+  while (fread(&record, sizeof(record), 1, file) == 1) {
+    if (record.headerLength > MAX_HEADER_SIZE) {
+      fclose(file);
+      throw std::runtime_error(path + " has an invalid record");
+    }
+
+    Request request;
+    request.time = record.time;
+    request.connection = record.connection;
+    request.header.resize(record.headerLength);
+
+    // A record cut short at the end of the file is ignored.
+    if (fread(&request.header[0], 1, record.headerLength, file) != record.headerLength) {
+      break;
+    }
+
+    requests.push_back(std::move(request));
+  }
+
+  fclose(file);
+}
@@ -0,0 +1,123 @@
+#ifndef __INC_PLAIN_REQUESTCAPTURE_H__
+#define __INC_PLAIN_REQUESTCAPTURE_H__
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+namespace plain {
+
+  /**
+   *  Captures raw request headers to a file, for replay with plain-bench.
+   *
+   *  Works like the access log: the server thread copies the header into a
+   *  fixed size record in a lock free ring buffer, and a background thread
+   *  writes the records to the file. When the ring buffer is full the request
+   *  is not captured.
+   *
+   *  The file starts with a FileHeader, followed by a FileRecord plus the
+   *  header bytes per request, in host byte order. Captures are appended to an
+   *  existing file.
+   *
+   *  Note: there should only be a single thread filling in records.
+   */
+  class RequestCapture {
+  public:
+
+    enum {
+      // The maximum size of a captured header, the size of the server receive buffer.
+      MAX_HEADER_SIZE = 8192,
+
+      FILE_VERSION = 1,
+    };
+
+    /**
+     *  The ring buffer record.
+     */
+    struct Record {
+      // The wall clock time the first byte of the request arrived, in microseconds since the epoch.
+      uint64_t time;
+
+      // The sequence number of the connection the request came in on.
+      uint32_t connection;
+
+      // The size of the header, including the terminating empty line.
+      uint32_t headerLength;
+
+      char header[MAX_HEADER_SIZE];
+    };
+
+    struct FileHeader {
+      // "PLAINCAP"
+      char magic[8];
+      uint32_t version;
+      uint32_t reserved;
+    };
+
+    struct FileRecord {
+      uint64_t time;
+      uint32_t connection;
+      uint32_t headerLength;
+    };
+
+    /**
+     *  A captured request, as read back from a file.
+     */
+    struct Request {
+      uint64_t time;
+      uint32_t connection;
+      std::string header;
+    };
+
+    /**
+     *  Opens the capture file.
+     *
+     *  @param path the path of the capture file, it is appended to.
+     *  @param sampleInterval capture one in every sampleInterval requests.
+     *  @throw ErrnoException when the file cannot be opened.
+     */
+    RequestCapture(std::string const &path, size_t sampleInterval = 1);
+
+    ~RequestCapture();
+
+    /**
+     *  Reserve the next record, when the request is sampled.
+     *
+     *  @return the record to fill in, or NULL when the request is not sampled
+     *          or the ring buffer is full. In the latter case the request is
+     *          counted as dropped.
+     */
+    Record *reserve();
+
+    /**
+     *  Publish the record returned by reserve() to the background thread.
+     */
+    void commit();
+
+    /**
+     *  @return the number of sampled requests dropped because the ring buffer was full.
+     */
+    size_t dropped() const;
+
+    /**
+     *  Reads a capture file.
+     *
+     *  @param path the path of the capture file.
+     *  @param requests the requests are appended to this, in file order.
+     *  @throw ErrnoException when the file cannot be read.
+     *  @throw std::runtime_error when the file is not a capture file.
+     */
+    static void read(std::string const &path, std::vector<Request> &requests);
+
+  private:
+
+    struct Internal;
+    std::unique_ptr<Internal> d;
+
+  };
+
+}
+
+#endif // __INC_PLAIN_REQUESTCAPTURE_H__
@@ -0,0 +1,105 @@
+#!/bin/bash
+#
+# Profile guided optimization of plain, run by "make pgo".
+#
+# Builds and measures the release build, builds instrumented binaries and
+# trains them, then rebuilds with the profile and measures again. Training
+# serves the data/ files with plain, large generated files with
+# plain-filebench, and runs the micro and simulated loop benchmarks. Both
+# measurements use the load generator of the release build, so only the
+# server differs.
+#
+# PLAIN_PGO_PORT (default 18090) and PLAIN_PGO_DURATION (seconds per run,
+# default 10) change the defaults. The binaries are left built with the
+# profile.
+
+set -e
+
+cd "$(dirname "$0")"
+
+PORT=${PLAIN_PGO_PORT:-18090}
+DURATION=${PLAIN_PGO_DURATION:-10}
+DATA=$(cd ../data && pwd)
+PROFILE_DIR=$(pwd)/pgo-profile
+BENCH=$PROFILE_DIR/plain-bench.release
+
+# The micro benchmarks that are compared.
+MICRO="findEndOfHeader/browser parseHttpRequestHeaders/browser parseHttpRequestHeaders/bot ioSchedulerScheduleRun timeoutListRemoveAdd"
+
+# Starts plain on the data directory and waits until it accepts connections.
+start_server()
+{
+  PLAIN_DATA=$DATA ./plain $PORT > /dev/null &
+  SERVER=$!
+
+  for i in $(seq 50); do
+    if (exec 3<>/dev/tcp/127.0.0.1/$PORT) 2> /dev/null; then
+      return
+    fi
+    sleep 0.1
+  done
+
+  echo "pgo.sh: plain did not start" >&2
+  exit 1
+}
+
+# Stops plain with a GET /exit, so an instrumented build writes its profile.
+stop_server()
+{
+  exec 3<>/dev/tcp/127.0.0.1/$PORT
+  printf 'GET /exit HTTP/1.1\r\nHost: localhost\r\n\r\n' >&3
+  exec 3<&-
+  wait $SERVER || true
+}
+
+# Prints the small file throughput in requests/s.
+measure_server()
+{
+  start_server
+  $BENCH -c 64 -d $DURATION 127.0.0.1 $PORT | awk '/^throughput/ { print $2 }'
+  stop_server
+}
+
+# Prints "name ns/op" for the compared micro benchmarks.
+measure_micro()
+{
+  for name in $MICRO; do
+    ./plain-microbench $name | awk -v name=$name '$1 == name { print $1, $3 }'
+  done
+}
+
+rm -rf "$PROFILE_DIR"
+mkdir -p "$PROFILE_DIR"
+
+echo "Release build."
+make release > /dev/null
+cp plain-bench "$BENCH"
+RELEASE_SERVER=$(measure_server)
+RELEASE_MICRO=$(measure_micro)
+
+echo "Instrumented build."
+make pgo-generate > /dev/null
+
+echo "Training."
+start_server
+./plain-bench -c 64 -d $DURATION 127.0.0.1 $PORT > /dev/null
+./plain-bench -c 16 -d $DURATION -r 2000 127.0.0.1 $PORT > /dev/null
+stop_server
+./plain-filebench -d 2 -s 1M,16M > /dev/null
+./plain-microbench > /dev/null
+./plain-simbench -n 20000 -e 200000 > /dev/null
+
+echo "Build with the profile."
+make pgo-use > /dev/null
+PGO_SERVER=$(measure_server)
+PGO_MICRO=$(measure_micro)
+
+echo
+printf "%-40s %12s %12s %8s\n" "" "release" "pgo" "speedup"
+printf "%-40s %12.1f %12.1f %7.2fx\n" "throughput (requests/s)" $RELEASE_SERVER $PGO_SERVER \
+       $(echo "$PGO_SERVER $RELEASE_SERVER" | awk '{ print $1 / $2 }')
+
+paste -d ' ' <(echo "$RELEASE_MICRO") <(echo "$PGO_MICRO") | while read name release other pgo; do
+  printf "%-40s %12.1f %12.1f %7.2fx\n" "$name (ns/op)" $release $pgo \
+	 $(echo "$release $pgo" | awk '{ print $1 / $2 }')
+done